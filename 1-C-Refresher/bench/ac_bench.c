@@ -0,0 +1,170 @@
+/*
+ *  ac_bench.c
+ *
+ *  Multi-pattern replacement with 1, 10 and 1000 search/replace pairs.
+ *  The Aho-Corasick automaton (see stringfun_ac.c) makes one pass over the
+ *  text for all of them.  The baseline is what running -x once per pattern
+ *  amounts to: one bmh_find() replace-all pass per pattern, each over the
+ *  output of the one before.  The text is random words, the patterns are
+ *  words from the same vocabulary so every pattern finds matches.
+ *
+ *  Prints one JSON object per pattern count and method:
+ *
+ *      {"bench":"pairs","method":"aho_corasick","patterns":1000,
+ *       "matches":...,"mb":8,"ms":...,"gb_per_sec":...,"speedup":...}
+ *
+ *  usage:  ac_bench [mb]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../stringfun.h"
+#include "bench_util.h"
+
+#define PAIRS_FILE  "ac_bench.pairs"
+#define DEFAULT_MB  8
+#define VOCABULARY  5000
+
+static const int PATTERN_COUNTS[] = {1, 10, 1000};
+#define N_COUNTS (int)(sizeof(PATTERN_COUNTS) / sizeof(PATTERN_COUNTS[0]))
+
+static char vocab[VOCABULARY][12];
+
+static void make_vocab(void){
+    unsigned int seed = 283;
+    for (int w = 0; w < VOCABULARY; w++) {
+        int len = 4 + rand_r(&seed) % 7;
+        for (int k = 0; k < len; k++) {
+            vocab[w][k] = 'a' + rand_r(&seed) % 26;
+        }
+        vocab[w][len] = '\0';
+    }
+}
+
+static void make_vocab_text(char *text, size_t len){
+    unsigned int seed = 2830;
+    size_t i = 0;
+    while (i < len) {
+        const char *w = vocab[rand_r(&seed) % VOCABULARY];
+        for (; *w && i < len; w++) {
+            text[i++] = *w;
+        }
+        if (i < len) {
+            text[i++] = ' ';
+        }
+    }
+}
+
+typedef struct sink {
+    char  *buff;
+    size_t len;
+} sink_t;
+
+static void emit_sink(void *arg, char *text, int n){
+    sink_t *out = (sink_t *)arg;
+    memcpy(out->buff + out->len, text, n);
+    out->len += n;
+}
+
+static long run_ac(ac_t *ac, char *text, int len, char *out){
+    sink_t sink = { out, 0 };
+    int state = 0;
+    int flushed = 0;
+    long matches = ac_scan(ac, text, 0, len, &state, &flushed, emit_sink, &sink);
+    emit_sink(&sink, text + flushed, len - flushed);
+    return matches;
+}
+
+//one replace-all pass per pattern, ping-ponging between two buffers
+static long run_passes(ac_t *ac, char *text, int len, char *a, char *b){
+    long matches = 0;
+    char *in = text;
+    char *out = a;
+    for (int p = 0; p < ac->n_pairs; p++) {
+        bmh_t bmh;
+        bmh_init(&bmh, ac->search[p], ac->search_len[p]);
+        int pos = 0;
+        size_t done = 0;
+        char *hit;
+        while ((hit = bmh_find(&bmh, in + pos, len - pos)) != NULL) {
+            memcpy(out + done, in + pos, hit - (in + pos));
+            done += hit - (in + pos);
+            memcpy(out + done, ac->replace[p], ac->replace_len[p]);
+            done += ac->replace_len[p];
+            pos = hit - in + ac->search_len[p];
+            matches++;
+        }
+        memcpy(out + done, in + pos, len - pos);
+        len = done + len - pos;
+        in = out;
+        out = (out == a) ? b : a;
+    }
+    return matches;
+}
+
+int main(int argc, char *argv[]){
+    int mb = (argc > 1) ? atoi(argv[1]) : DEFAULT_MB;
+    if (mb < 1) {
+        fprintf(stderr, "mb must be at least 1\n");
+        return 1;
+    }
+
+    int len = mb << 20;
+    char *text = malloc(len);
+    char *a = malloc((size_t)len * 2);
+    char *b = malloc((size_t)len * 2);
+    if (text == NULL || a == NULL || b == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 99;
+    }
+    make_vocab();
+    make_vocab_text(text, len);
+
+    for (int c = 0; c < N_COUNTS; c++) {
+        // Replacements are the same length so passes do not grow the text
+        FILE *fp = fopen(PAIRS_FILE, "w");
+        if (fp == NULL) {
+            perror(PAIRS_FILE);
+            return 2;
+        }
+        for (int p = 0; p < PATTERN_COUNTS[c]; p++) {
+            fprintf(fp, "%s\t%.*s\n", vocab[p * (VOCABULARY / PATTERN_COUNTS[c])],
+                    (int)strlen(vocab[p * (VOCABULARY / PATTERN_COUNTS[c])]), "XXXXXXXXXXX");
+        }
+        fclose(fp);
+
+        ac_t ac;
+        double start = now_ms();
+        int rc = ac_load(&ac, PAIRS_FILE);
+        double build_ms = now_ms() - start;
+        unlink(PAIRS_FILE);
+        if (rc != 0) {
+            fprintf(stderr, "loading pairs failed, rc = %d\n", rc);
+            return 2;
+        }
+
+        start = now_ms();
+        long passes = run_passes(&ac, text, len, a, b);
+        double passes_ms = now_ms() - start;
+
+        start = now_ms();
+        long matches = run_ac(&ac, text, len, a);
+        double ac_ms = now_ms() - start + build_ms;
+
+        printf("{\"bench\":\"pairs\",\"method\":\"pass_per_pattern\",\"patterns\":%d,"
+               "\"matches\":%ld,\"mb\":%d,\"ms\":%.3f,\"gb_per_sec\":%.2f,\"speedup\":1.00}\n",
+               PATTERN_COUNTS[c], passes, mb, passes_ms, (len / 1e9) / (passes_ms / 1000.0));
+        printf("{\"bench\":\"pairs\",\"method\":\"aho_corasick\",\"patterns\":%d,"
+               "\"matches\":%ld,\"mb\":%d,\"ms\":%.3f,\"gb_per_sec\":%.2f,\"speedup\":%.2f}\n",
+               PATTERN_COUNTS[c], matches, mb, ac_ms, (len / 1e9) / (ac_ms / 1000.0),
+               passes_ms / ac_ms);
+        ac_free(&ac);
+    }
+
+    free(text);
+    free(a);
+    free(b);
+    return 0;
+}
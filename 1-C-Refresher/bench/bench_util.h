@@ -0,0 +1,74 @@
+/*
+ *  bench_util.h
+ *
+ *  Timing and test input shared by the benchmarks in this directory.  Every
+ *  generator is seeded the same way, so each run of a benchmark works on
+ *  the same bytes.
+ */
+#ifndef __BENCH_UTIL_H__
+#define __BENCH_UTIL_H__
+
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+static inline double now_ms(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+//fill text with words, runs of blanks and newlines
+static inline void make_text(char *text, size_t len){
+    unsigned int seed = 283;
+    size_t i = 0;
+    while (i < len) {
+        int r = rand_r(&seed) % 100;
+        if (r < 70) {
+            int word = 1 + rand_r(&seed) % 9;
+            for (int k = 0; k < word && i < len; k++) {
+                text[i++] = 'a' + rand_r(&seed) % 26;
+            }
+            if (i < len) {
+                text[i++] = ' ';
+            }
+        } else if (r < 90) {
+            int run = 1 + rand_r(&seed) % 6;
+            for (int k = 0; k < run && i < len; k++) {
+                text[i++] = (rand_r(&seed) % 3) ? ' ' : '\t';
+            }
+        } else {
+            text[i++] = '\n';
+        }
+    }
+}
+
+//write mb megabytes of words, blank runs and newlines
+static inline int build_file(int fd, int mb){
+    static char chunk[1 << 20];
+    unsigned int seed = 283;
+
+    for (int m = 0; m < mb; m++) {
+        size_t i = 0;
+        while (i < sizeof(chunk)) {
+            int r = rand_r(&seed) % 10;
+            if (r < 8) {
+                int word = 1 + rand_r(&seed) % 9;
+                for (int k = 0; k < word && i < sizeof(chunk); k++) {
+                    chunk[i++] = 'a' + rand_r(&seed) % 26;
+                }
+                if (i < sizeof(chunk)) {
+                    chunk[i++] = ' ';
+                }
+            } else {
+                chunk[i++] = (r == 8) ? '\t' : '\n';
+            }
+        }
+        if (write(fd, chunk, sizeof(chunk)) != (ssize_t)sizeof(chunk)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+#endif
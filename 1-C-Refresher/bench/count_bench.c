@@ -0,0 +1,93 @@
+/*
+ *  count_bench.c
+ *
+ *  Throughput of each word counting kernel used by streaming mode (see
+ *  count_words_chunk() in stringfun.c and stringfun_simd.c) over the same
+ *  text, fed to it one STREAM_CHUNK_SZ chunk at a time the way
+ *  stream_count_words() does.  The text is the same log-like mix of words,
+ *  blank runs and newlines as norm_bench uses.  Every kernel's count is
+ *  checked against the scalar one before it is timed.
+ *
+ *  Prints one JSON object per kernel:
+ *
+ *      {"bench":"count","kernel":"avx2","mb":256,"words":...,"ms":...,
+ *       "gb_per_sec":...,"speedup":...}
+ *
+ *  usage:  count_bench [mb]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../stringfun.h"
+#include "bench_util.h"
+
+#define DEFAULT_MB  256
+#define ROUNDS      5
+
+typedef struct kernel {
+    const char *name;
+    count_fn_t  fn;
+} kernel_t;
+
+static const kernel_t KERNELS[] = {
+    {"scalar", count_words_chunk},
+    {"sse2",   count_words_chunk_sse2},
+    {"avx2",   count_words_chunk_avx2},
+};
+#define N_KERNELS (int)(sizeof(KERNELS) / sizeof(KERNELS[0]))
+
+static long run_kernel(count_fn_t fn, char *text, size_t len){
+    long words = 0;
+    int  in_word = 0;
+    for (size_t off = 0; off < len; off += STREAM_CHUNK_SZ) {
+        int chunk = (len - off < STREAM_CHUNK_SZ) ? (int)(len - off) : STREAM_CHUNK_SZ;
+        words += fn(text + off, chunk, &in_word);
+    }
+    return words;
+}
+
+int main(int argc, char *argv[]){
+    int mb = (argc > 1) ? atoi(argv[1]) : DEFAULT_MB;
+    if (mb < 1) {
+        fprintf(stderr, "mb must be at least 1\n");
+        return 1;
+    }
+
+    size_t len = (size_t)mb << 20;
+    char *text = malloc(len);
+    if (text == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 99;
+    }
+    make_text(text, len);
+    long want = run_kernel(count_words_chunk, text, len);
+
+    double scalar_ms = 0;
+    for (int k = 0; k < N_KERNELS; k++) {
+        if (run_kernel(KERNELS[k].fn, text, len) != want) {
+            fprintf(stderr, "%s count differs from scalar\n", KERNELS[k].name);
+            return 2;
+        }
+
+        double best = 0;
+        for (int r = 0; r < ROUNDS; r++) {
+            double start = now_ms();
+            run_kernel(KERNELS[k].fn, text, len);
+            double ms = now_ms() - start;
+            if (r == 0 || ms < best) {
+                best = ms;
+            }
+        }
+        if (k == 0) {
+            scalar_ms = best;
+        }
+
+        printf("{\"bench\":\"count\",\"kernel\":\"%s\",\"mb\":%d,\"words\":%ld,\"ms\":%.3f,"
+               "\"gb_per_sec\":%.2f,\"speedup\":%.2f}\n",
+               KERNELS[k].name, mb, want, best, (len / 1e9) / (best / 1000.0), scalar_ms / best);
+    }
+
+    free(text);
+    return 0;
+}
@@ -0,0 +1,103 @@
+/*
+ *  mmap_bench.c
+ *
+ *  Streaming mode reading a file with read() against mapping it (see
+ *  stream_open() in stringfun.c).  A file of log-like text is written once
+ *  and read through once so it is in the page cache, then word count, word
+ *  print and reverse are run over it with STRINGFUN_MMAP off and on.  The
+ *  output of word print and reverse goes to /dev/null.
+ *
+ *  Prints one JSON object per operation and mode:
+ *
+ *      {"bench":"mmap","op":"count","mmap":"on","mb":256,"ms":...,
+ *       "gb_per_sec":...}
+ *
+ *  usage:  mmap_bench [mb]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../stringfun.h"
+#include "bench_util.h"
+
+#define BENCH_FILE  "mmap_bench.txt"
+#define DEFAULT_MB  256
+#define ROUNDS      3
+
+static int run_op(char op){
+    stream_t s;
+    int rc;
+
+    if (stream_open(&s, BENCH_FILE) != 0) {
+        return -1;
+    }
+    switch (op) {
+        case 'c':
+            rc = (stream_count_words(&s) < 0) ? -1 : 0;
+            break;
+        case 'w':
+            rc = stream_word_print(&s);
+            fflush(stdout);
+            break;
+        default:
+            rc = stream_reverse(&s);
+            break;
+    }
+    stream_close(&s);
+    return rc;
+}
+
+int main(int argc, char *argv[]){
+    int mb = (argc > 1) ? atoi(argv[1]) : DEFAULT_MB;
+    if (mb < 1) {
+        fprintf(stderr, "mb must be at least 1\n");
+        return 1;
+    }
+
+    int fd = open(BENCH_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || build_file(fd, mb) != 0) {
+        perror(BENCH_FILE);
+        unlink(BENCH_FILE);
+        return 2;
+    }
+    close(fd);
+
+    // Results go to the real stdout, what the operations print is dropped
+    FILE *results = fdopen(dup(STDOUT_FILENO), "w");
+    int devnull = open("/dev/null", O_WRONLY);
+    if (results == NULL || devnull < 0) {
+        unlink(BENCH_FILE);
+        return 2;
+    }
+    fflush(stdout);
+    dup2(devnull, STDOUT_FILENO);
+
+    const char ops[] = {'c', 'w', 'r'};
+    const char *names[] = {"count", "print", "reverse"};
+    int rc = 0;
+    run_op('c');    //warms the cache
+    for (int o = 0; o < 3 && rc == 0; o++) {
+        for (int m = 0; m < 2 && rc == 0; m++) {
+            setenv(MMAP_ENV, m ? "on" : "off", 1);
+            double best = 0;
+            for (int r = 0; r < ROUNDS && rc == 0; r++) {
+                double start = now_ms();
+                rc = run_op(ops[o]);
+                double ms = now_ms() - start;
+                if (r == 0 || ms < best) {
+                    best = ms;
+                }
+            }
+            fprintf(results, "{\"bench\":\"mmap\",\"op\":\"%s\",\"mmap\":\"%s\",\"mb\":%d,"
+                    "\"ms\":%.3f,\"gb_per_sec\":%.2f}\n",
+                    names[o], m ? "on" : "off", mb, best, (((size_t)mb << 20) / 1e9) / (best / 1000.0));
+            fflush(results);
+        }
+    }
+
+    unlink(BENCH_FILE);
+    return rc ? 2 : 0;
+}
@@ -0,0 +1,100 @@
+/*
+ *  norm_bench.c
+ *
+ *  Throughput of each whitespace normalizer used by streaming mode (see
+ *  normalize_chunk_scalar() in stringfun.c and stringfun_simd.c) over the
+ *  same text, fed to it one STREAM_CHUNK_SZ chunk at a time the way
+ *  stream_next() does.  The text is mostly single spaced words with some
+ *  runs of spaces and tabs and some newlines, like a log file.  Every
+ *  kernel's output is checked against the scalar one before it is timed.
+ *
+ *  Prints one JSON object per kernel:
+ *
+ *      {"bench":"normalize","kernel":"avx2","mb":64,"ms":...,
+ *       "gb_per_sec":...,"speedup":...}
+ *
+ *  usage:  norm_bench [mb]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../stringfun.h"
+#include "bench_util.h"
+
+#define DEFAULT_MB  64
+#define ROUNDS      5
+
+typedef struct kernel {
+    const char     *name;
+    normalize_fn_t  fn;
+} kernel_t;
+
+static const kernel_t KERNELS[] = {
+    {"scalar", normalize_chunk_scalar},
+    {"sse2",   normalize_chunk_sse2},
+    {"avx2",   normalize_chunk_avx2},
+};
+#define N_KERNELS (int)(sizeof(KERNELS) / sizeof(KERNELS[0]))
+
+//normalizes all of text into out chunk by chunk, returns the output length
+static size_t run_kernel(normalize_fn_t fn, char *text, size_t len, char *out){
+    stream_t s;
+    memset(&s, 0, sizeof(s));
+    size_t done = 0;
+    for (size_t off = 0; off < len; off += STREAM_CHUNK_SZ) {
+        int chunk = (len - off < STREAM_CHUNK_SZ) ? (int)(len - off) : STREAM_CHUNK_SZ;
+        done += fn(&s, text + off, out + done, chunk);
+    }
+    return done;
+}
+
+int main(int argc, char *argv[]){
+    int mb = (argc > 1) ? atoi(argv[1]) : DEFAULT_MB;
+    if (mb < 1) {
+        fprintf(stderr, "mb must be at least 1\n");
+        return 1;
+    }
+
+    size_t len = (size_t)mb << 20;
+    char *text = malloc(len);
+    char *want = malloc(len + 64);
+    char *got = malloc(len + 64);
+    if (text == NULL || want == NULL || got == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 99;
+    }
+    make_text(text, len);
+    size_t want_len = run_kernel(normalize_chunk_scalar, text, len, want);
+
+    double scalar_ms = 0;
+    for (int k = 0; k < N_KERNELS; k++) {
+        size_t got_len = run_kernel(KERNELS[k].fn, text, len, got);
+        if (got_len != want_len || memcmp(got, want, want_len) != 0) {
+            fprintf(stderr, "%s output differs from scalar\n", KERNELS[k].name);
+            return 2;
+        }
+
+        double best = 0;
+        for (int r = 0; r < ROUNDS; r++) {
+            double start = now_ms();
+            run_kernel(KERNELS[k].fn, text, len, got);
+            double ms = now_ms() - start;
+            if (r == 0 || ms < best) {
+                best = ms;
+            }
+        }
+        if (k == 0) {
+            scalar_ms = best;
+        }
+
+        printf("{\"bench\":\"normalize\",\"kernel\":\"%s\",\"mb\":%d,\"ms\":%.3f,"
+               "\"gb_per_sec\":%.2f,\"speedup\":%.2f}\n",
+               KERNELS[k].name, mb, best, (len / 1e9) / (best / 1000.0), scalar_ms / best);
+    }
+
+    free(text);
+    free(want);
+    free(got);
+    return 0;
+}
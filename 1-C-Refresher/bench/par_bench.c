@@ -0,0 +1,80 @@
+/*
+ *  par_bench.c
+ *
+ *  Scaling of -j word counting (see parallel_count_words() in stringfun.c)
+ *  from 1 to 16 threads.  A file of log-like text is written once and read
+ *  through once so it is in the page cache, then it is counted with 1, 2,
+ *  4, 8 and 16 threads.  Every count is checked against the one thread
+ *  count.  Threads past the number of CPUs can not speed anything up, so
+ *  the CPU count is printed with each result.
+ *
+ *  Prints one JSON object per thread count:
+ *
+ *      {"bench":"parallel","threads":4,"cpus":8,"mb":512,"words":...,
+ *       "ms":...,"gb_per_sec":...,"speedup":...}
+ *
+ *  usage:  par_bench [mb]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../stringfun.h"
+#include "bench_util.h"
+
+#define BENCH_FILE  "par_bench.txt"
+#define DEFAULT_MB  512
+#define ROUNDS      3
+
+static const int THREADS[] = {1, 2, 4, 8, 16};
+#define N_THREADS (int)(sizeof(THREADS) / sizeof(THREADS[0]))
+
+int main(int argc, char *argv[]){
+    int mb = (argc > 1) ? atoi(argv[1]) : DEFAULT_MB;
+    if (mb < 1) {
+        fprintf(stderr, "mb must be at least 1\n");
+        return 1;
+    }
+
+    int fd = open(BENCH_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || build_file(fd, mb) != 0) {
+        perror(BENCH_FILE);
+        unlink(BENCH_FILE);
+        return 2;
+    }
+    off_t size = (off_t)mb << 20;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    long want = parallel_count_words(fd, size, 1);  //also warms the cache
+    double one_ms = 0;
+    int rc = 0;
+    for (int t = 0; t < N_THREADS && rc == 0; t++) {
+        double best = 0;
+        for (int r = 0; r < ROUNDS; r++) {
+            double start = now_ms();
+            long got = parallel_count_words(fd, size, THREADS[t]);
+            double ms = now_ms() - start;
+            if (got != want) {
+                fprintf(stderr, "%d threads counted %ld, not %ld\n", THREADS[t], got, want);
+                rc = 2;
+                break;
+            }
+            if (r == 0 || ms < best) {
+                best = ms;
+            }
+        }
+        if (t == 0) {
+            one_ms = best;
+        }
+
+        printf("{\"bench\":\"parallel\",\"threads\":%d,\"cpus\":%ld,\"mb\":%d,\"words\":%ld,"
+               "\"ms\":%.3f,\"gb_per_sec\":%.2f,\"speedup\":%.2f}\n",
+               THREADS[t], cpus, mb, want, best, (size / 1e9) / (best / 1000.0), one_ms / best);
+    }
+
+    close(fd);
+    unlink(BENCH_FILE);
+    return rc;
+}
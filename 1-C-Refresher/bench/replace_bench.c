@@ -0,0 +1,152 @@
+/*
+ *  replace_bench.c
+ *
+ *  Replace-all over the same text with the nested loop search that
+ *  replace_string() used to do, with bmh_find() (see stringfun.c), and
+ *  with glibc's memmem() for reference.  Each one writes the replaced
+ *  text into an output buffer in one pass, and the outputs are checked
+ *  against each other.  The text is random lower case words, so short
+ *  patterns match often and long ones almost never.
+ *
+ *  Prints one JSON object per pattern and search:
+ *
+ *      {"bench":"replace","search":"bmh","pattern_len":8,"matches":...,
+ *       "mb":64,"ms":...,"gb_per_sec":...,"speedup":...}
+ *
+ *  usage:  replace_bench [mb]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../stringfun.h"
+#include "bench_util.h"
+
+#define DEFAULT_MB  64
+#define ROUNDS      3
+
+static const char *PATTERNS[] = {"the", "overflow", "abcdefghijklmnop"};
+#define N_PATTERNS (int)(sizeof(PATTERNS) / sizeof(PATTERNS[0]))
+
+static const char *SEARCHES[] = {"naive", "bmh", "memmem"};
+#define N_SEARCHES (int)(sizeof(SEARCHES) / sizeof(SEARCHES[0]))
+
+static void make_word_text(char *text, size_t len){
+    static const char *words[] = {"the", "a", "string", "overflow", "buffer",
+                                  "there", "other", "flow", "over", "test"};
+    unsigned int seed = 283;
+    size_t i = 0;
+    while (i < len) {
+        const char *w = words[rand_r(&seed) % 10];
+        for (; *w && i < len; w++) {
+            text[i++] = *w;
+        }
+        if (i < len) {
+            text[i++] = (rand_r(&seed) % 12) ? ' ' : '\n';
+        }
+    }
+}
+
+static char *naive_find(char *text, int n, const char *pat, int m){
+    for (int i = 0; i <= n - m; i++) {
+        int j = 0;
+        while (j < m && text[i + j] == pat[j]) {
+            j++;
+        }
+        if (j == m) {
+            return text + i;
+        }
+    }
+    return NULL;
+}
+
+//replaces every match, returns the output length and the match count
+static size_t replace_all(int search, char *text, int n, char *pat, char *rep, char *out, long *matches){
+    int m = strlen(pat);
+    int r = strlen(rep);
+    bmh_t bmh;
+    bmh_init(&bmh, pat, m);
+
+    size_t done = 0;
+    int pos = 0;
+    *matches = 0;
+    for (;;) {
+        char *hit;
+        if (search == 0) {
+            hit = naive_find(text + pos, n - pos, pat, m);
+        } else if (search == 1) {
+            hit = bmh_find(&bmh, text + pos, n - pos);
+        } else {
+            hit = memmem(text + pos, n - pos, pat, m);
+        }
+        if (hit == NULL) {
+            break;
+        }
+        memcpy(out + done, text + pos, hit - (text + pos));
+        done += hit - (text + pos);
+        memcpy(out + done, rep, r);
+        done += r;
+        pos = hit - text + m;
+        (*matches)++;
+    }
+    memcpy(out + done, text + pos, n - pos);
+    return done + n - pos;
+}
+
+int main(int argc, char *argv[]){
+    int mb = (argc > 1) ? atoi(argv[1]) : DEFAULT_MB;
+    if (mb < 1) {
+        fprintf(stderr, "mb must be at least 1\n");
+        return 1;
+    }
+
+    int len = mb << 20;
+    char *text = malloc(len);
+    char *want = malloc((size_t)len * 2);
+    char *got = malloc((size_t)len * 2);
+    if (text == NULL || want == NULL || got == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 99;
+    }
+    make_word_text(text, len);
+
+    for (int p = 0; p < N_PATTERNS; p++) {
+        char *pat = (char *)PATTERNS[p];
+        char *rep = "REPLACED";
+        long matches;
+        size_t want_len = replace_all(0, text, len, pat, rep, want, &matches);
+
+        double naive_ms = 0;
+        for (int k = 0; k < N_SEARCHES; k++) {
+            size_t got_len = replace_all(k, text, len, pat, rep, got, &matches);
+            if (got_len != want_len || memcmp(got, want, want_len) != 0) {
+                fprintf(stderr, "%s output differs from naive\n", SEARCHES[k]);
+                return 2;
+            }
+
+            double best = 0;
+            for (int r = 0; r < ROUNDS; r++) {
+                double start = now_ms();
+                replace_all(k, text, len, pat, rep, got, &matches);
+                double ms = now_ms() - start;
+                if (r == 0 || ms < best) {
+                    best = ms;
+                }
+            }
+            if (k == 0) {
+                naive_ms = best;
+            }
+
+            printf("{\"bench\":\"replace\",\"search\":\"%s\",\"pattern_len\":%d,\"matches\":%ld,"
+                   "\"mb\":%d,\"ms\":%.3f,\"gb_per_sec\":%.2f,\"speedup\":%.2f}\n",
+                   SEARCHES[k], (int)strlen(pat), matches, mb, best,
+                   (len / 1e9) / (best / 1000.0), naive_ms / best);
+        }
+    }
+
+    free(text);
+    free(want);
+    free(got);
+    return 0;
+}
@@ -0,0 +1,118 @@
+/*
+ *  reverse_bench.c
+ *
+ *  Throughput of each in-place reverse kernel (see reverse_string_scalar()
+ *  in stringfun.c and stringfun_simd.c) over the same text, one
+ *  STREAM_CHUNK_SZ chunk at a time the way stream_reverse() hands chunks
+ *  to reverse_string().  Every kernel's output is checked against the
+ *  scalar one before it is timed.  Reversing twice gives the text back, so
+ *  an even number of rounds leaves the buffer as it started.
+ *
+ *  Prints one JSON object per kernel:
+ *
+ *      {"bench":"reverse","kernel":"avx2","mb":256,"ms":...,
+ *       "gb_per_sec":...,"speedup":...}
+ *
+ *  usage:  reverse_bench [mb]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../stringfun.h"
+#include "bench_util.h"
+
+#define DEFAULT_MB  256
+#define ROUNDS      6
+
+typedef struct kernel {
+    const char  *name;
+    reverse_fn_t fn;
+} kernel_t;
+
+static const kernel_t KERNELS[] = {
+    {"scalar", reverse_string_scalar},
+    {"sse2",   reverse_string_sse2},
+    {"avx2",   reverse_string_avx2},
+};
+#define N_KERNELS (int)(sizeof(KERNELS) / sizeof(KERNELS[0]))
+
+static void make_ascii_text(char *text, size_t len){
+    unsigned int seed = 283;
+    for (size_t i = 0; i < len; i++) {
+        text[i] = ' ' + rand_r(&seed) % 95;
+    }
+}
+
+static void reverse_chunks(reverse_fn_t fn, char *text, size_t len){
+    for (size_t off = 0; off < len; off += STREAM_CHUNK_SZ) {
+        size_t n = (len - off < STREAM_CHUNK_SZ) ? len - off : STREAM_CHUNK_SZ;
+        fn(text + off, n);
+    }
+}
+
+int main(int argc, char *argv[]){
+    int mb = (argc > 1) ? atoi(argv[1]) : DEFAULT_MB;
+    if (mb < 1) {
+        fprintf(stderr, "mb must be at least 1\n");
+        return 1;
+    }
+
+    size_t len = (size_t)mb << 20;
+    char *text = malloc(len);
+    char *want = malloc(len);
+    char *got = malloc(len);
+    if (text == NULL || want == NULL || got == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 99;
+    }
+    make_ascii_text(text, len);
+
+    // Odd lengths and offsets catch a kernel that gets its tail wrong
+    for (int n = 0; n < 300; n++) {
+        memcpy(want, text + 3, n);
+        reverse_string_scalar(want, n);
+        for (int k = 1; k < N_KERNELS; k++) {
+            memcpy(got, text + 3, n);
+            KERNELS[k].fn(got, n);
+            if (memcmp(got, want, n) != 0) {
+                fprintf(stderr, "%s reverses %d bytes differently from scalar\n", KERNELS[k].name, n);
+                return 2;
+            }
+        }
+    }
+    memcpy(want, text, len);
+    reverse_chunks(reverse_string_scalar, want, len);
+
+    double scalar_ms = 0;
+    for (int k = 0; k < N_KERNELS; k++) {
+        memcpy(got, text, len);
+        reverse_chunks(KERNELS[k].fn, got, len);
+        if (memcmp(got, want, len) != 0) {
+            fprintf(stderr, "%s output differs from scalar\n", KERNELS[k].name);
+            return 2;
+        }
+
+        double best = 0;
+        for (int r = 0; r < ROUNDS; r++) {
+            double start = now_ms();
+            reverse_chunks(KERNELS[k].fn, got, len);
+            double ms = now_ms() - start;
+            if (r == 0 || ms < best) {
+                best = ms;
+            }
+        }
+        if (k == 0) {
+            scalar_ms = best;
+        }
+
+        printf("{\"bench\":\"reverse\",\"kernel\":\"%s\",\"mb\":%d,\"ms\":%.3f,"
+               "\"gb_per_sec\":%.2f,\"speedup\":%.2f}\n",
+               KERNELS[k].name, mb, best, (len / 1e9) / (best / 1000.0), scalar_ms / best);
+    }
+
+    free(text);
+    free(want);
+    free(got);
+    return 0;
+}
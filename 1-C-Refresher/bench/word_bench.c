@@ -0,0 +1,170 @@
+/*
+ *  word_bench.c
+ *
+ *  Streaming word print (see stream_word_print() in stringfun.c) against
+ *  the version it replaced, which printed every word with printf() and
+ *  fwrite().  A file of log-like text is written once and read through
+ *  once so it is in the page cache.  Both versions first print it to a
+ *  file and the two files are compared, then each is timed printing to
+ *  /dev/null.
+ *
+ *  Prints one JSON object per version:
+ *
+ *      {"bench":"word_print","output":"buffered","mb":64,"ms":...,
+ *       "gb_per_sec":...,"speedup":...}
+ *
+ *  usage:  word_bench [mb]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../stringfun.h"
+#include "bench_util.h"
+
+#define BENCH_FILE  "word_bench.txt"
+#define STDIO_OUT   "word_bench.stdio"
+#define BUFFER_OUT  "word_bench.buffered"
+#define DEFAULT_MB  64
+#define ROUNDS      3
+
+//stream_word_print() as it was, through stdio
+static int stdio_word_print(stream_t *s){
+    long word_count = 0;
+    long word_length = 0;
+    int  str_len;
+
+    printf("Word Print\n----------\n");
+
+    while ((str_len = stream_read(s)) > 0) {
+        int i = 0;
+        while (i < str_len) {
+            if (IS_SEPARATOR(*(s->data+i))){
+                if (word_length > 0){
+                    printf("(%ld)\n", word_length);
+                    word_length = 0;
+                }
+                i++;
+                continue;
+            }
+
+            int word_start = i;
+            while (i < str_len && !IS_SEPARATOR(*(s->data+i))) {
+                i++;
+            }
+            if (word_length == 0){
+                word_count++;
+                printf("%ld. ", word_count);
+            }
+            fwrite(s->data+word_start, 1, i-word_start, stdout);
+            word_length += i-word_start;
+        }
+    }
+    if (word_length > 0){
+        printf("(%ld)\n", word_length);
+    }
+
+    printf("\nNumber of words returned: %ld\n", word_count);
+    fflush(stdout);
+    return (str_len < 0) ? -1 : 0;
+}
+
+//runs one version with stdout sent to path
+static int run_print(int buffered, const char *path){
+    stream_t s;
+    int rc;
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || stream_open(&s, BENCH_FILE) != 0) {
+        return -1;
+    }
+    fflush(stdout);
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+
+    rc = buffered ? stream_word_print(&s) : stdio_word_print(&s);
+    stream_close(&s);
+    return rc;
+}
+
+static int same_file(const char *a, const char *b){
+    FILE *fa = fopen(a, "r");
+    FILE *fb = fopen(b, "r");
+    int same = (fa != NULL && fb != NULL);
+    while (same) {
+        int ca = getc(fa);
+        int cb = getc(fb);
+        if (ca != cb) {
+            same = 0;
+        }
+        if (ca == EOF) {
+            break;
+        }
+    }
+    if (fa != NULL) {
+        fclose(fa);
+    }
+    if (fb != NULL) {
+        fclose(fb);
+    }
+    return same;
+}
+
+int main(int argc, char *argv[]){
+    int mb = (argc > 1) ? atoi(argv[1]) : DEFAULT_MB;
+    if (mb < 1) {
+        fprintf(stderr, "mb must be at least 1\n");
+        return 1;
+    }
+
+    int fd = open(BENCH_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || build_file(fd, mb) != 0) {
+        perror(BENCH_FILE);
+        unlink(BENCH_FILE);
+        return 2;
+    }
+    close(fd);
+
+    // Results go to the real stdout, run_print() moves the rest around
+    FILE *results = fdopen(dup(STDOUT_FILENO), "w");
+    if (results == NULL) {
+        unlink(BENCH_FILE);
+        return 2;
+    }
+
+    int rc = 0;
+    if (run_print(0, STDIO_OUT) != 0 || run_print(1, BUFFER_OUT) != 0) {
+        rc = 2;
+    } else if (!same_file(STDIO_OUT, BUFFER_OUT)) {
+        fprintf(stderr, "buffered output differs from stdio\n");
+        rc = 2;
+    }
+    unlink(STDIO_OUT);
+    unlink(BUFFER_OUT);
+
+    const char *names[] = {"stdio", "buffered"};
+    double stdio_ms = 0;
+    for (int b = 0; b < 2 && rc == 0; b++) {
+        double best = 0;
+        for (int r = 0; r < ROUNDS && rc == 0; r++) {
+            double start = now_ms();
+            rc = run_print(b, "/dev/null");
+            double ms = now_ms() - start;
+            if (r == 0 || ms < best) {
+                best = ms;
+            }
+        }
+        if (b == 0) {
+            stdio_ms = best;
+        }
+        fprintf(results, "{\"bench\":\"word_print\",\"output\":\"%s\",\"mb\":%d,\"ms\":%.3f,"
+                "\"gb_per_sec\":%.2f,\"speedup\":%.2f}\n",
+                names[b], mb, best, (((size_t)mb << 20) / 1e9) / (best / 1000.0), stdio_ms / best);
+        fflush(results);
+    }
+
+    unlink(BENCH_FILE);
+    return rc;
+}
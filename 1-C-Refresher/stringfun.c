@@ -1,21 +1,15 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 
-
-#define BUFFER_SZ 50
-
-//prototypes
-void usage(char *);
-void print_buff(char *, int);
-int  setup_buff(char *, char *, int);
-
-//prototypes for functions to handle required functionality
-int  count_words(char *, int, int);
-//add additional prototypes here
-int reverse_string(char *, int);
-int word_print(char *, int);
-int replace_string(char *, int, int, char *, char *);
+#include "stringfun.h"
 
 int setup_buff(char *buff, char *user_str, int len){
     //TODO: #4:  Implement the setup buff as per the directions
@@ -68,6 +62,13 @@ void print_buff(char *buff, int len){
 
 void usage(char *exename){
     printf("usage: %s [-h|c|r|w|x] \"string\" [other args]\n", exename);
+    printf("       %s [-c|r|w|x|a|v|f] -s [file|-] [other args]\n", exename);
+    printf("       %s -c -s file -j threads\n", exename);
+    printf("       %s -a \"string\" [search arg] [replace arg]\n", exename);
+    printf("       %s -v \"string\"\n", exename);
+    printf("       %s -f [\"string\"|-s file] [number of words]\n", exename);
+    printf("       %s -x [\"string\"|-s file] -p [pairs file]\n", exename);
+    printf("       (-x reads a search arg of -p as a pairs file, -a replaces it)\n");
 
 }
 
@@ -77,15 +78,25 @@ int count_words(char *buff, int len, int str_len){
         return -2; // Return an error code
     }
 
-    int word_count = 0;     //tracks the number of words in the buffer
     int in_word = 0;        //tracks if the current character is in a word
 
+    return count_words_chunk(buff, str_len, &in_word);
+}
+
+// Counts the words that start in buff[0..len).  *in_word says whether the
+// byte before buff was part of a word and is updated for the next chunk,
+// so a word split across two chunks is only counted once.  Tabs and
+// newlines separate words too, so text that was never normalized gives
+// the same count.
+int count_words_chunk(char *buff, int len, int *in_word){
+    int word_count = 0;     //tracks the number of words in the buffer
+
     // Count the number of words in the buffer
-    for (int i=0; i<str_len; i++) {
-        if (*(buff+i) == ' '){
-            in_word = 0;
-        } else if (!in_word) {
-            in_word = 1;
+    for (int i=0; i<len; i++) {
+        if (IS_SEPARATOR(*(buff+i))){
+            *in_word = 0;
+        } else if (!*in_word) {
+            *in_word = 1;
             word_count++;
         }
     }
@@ -95,8 +106,17 @@ int count_words(char *buff, int len, int str_len){
 
 //ADD OTHER HELPER FUNCTIONS HERE FOR OTHER REQUIRED PROGRAM OPTIONS
 
+// Reverses buff[0..str_len) in place with the widest kernel this CPU
+// has, see pick_reverser() in stringfun_simd.c
 int reverse_string(char *buff, int str_len){
-    char reversed_string[str_len];  //holds the reversed string
+    static reverse_fn_t reverse = NULL;
+    if (reverse == NULL){
+        reverse = pick_reverser();
+    }
+    return reverse(buff, str_len);
+}
+
+int reverse_string_scalar(char *buff, int str_len){
     char temp_char;                 //used to swap characters
 
     // Reverse the string in the buffer
@@ -106,34 +126,74 @@ int reverse_string(char *buff, int str_len){
         *(buff+i) = temp_char;
     }
 
-    // Copy the reversed string into a new string to be printed without the periods
-    for(int i=0; i<str_len; i++){
-        *(reversed_string+i) = *(buff+i);
+    return 0;
+}
+
+// Reverses every word of buff[0..len) in place and leaves the words in
+// the same order.
+int reverse_words(char *buff, int len){
+    int i = 0;
+    while (i < len) {
+        while (i < len && IS_SEPARATOR(*(buff+i))) {
+            i++;
+        }
+        int word_start = i;
+        while (i < len && !IS_SEPARATOR(*(buff+i))) {
+            i++;
+        }
+        reverse_string(buff+word_start, i-word_start);
     }
+    return 0;
+}
 
-    *(reversed_string+str_len) = '\0';  //null terminate the reversed string
+// Number of words for -f, or -1 unless arg is a whole number from 1 up
+int parse_top(char *arg){
+    char *end;
+    long top = strtol(arg, &end, 10);
 
-    //printf("Reversed String: %s\n", reversed_string);
-    return 0;
+    if (end == arg || *end != '\0' || top < 1 || top > INT_MAX){
+        return -1;
+    }
+    return (int)top;
+}
+
+// Prints the top most frequent words in buff[0..str_len)
+int word_freq(char *buff, int str_len, int top){
+    freq_t f;
+    int rc = freq_init(&f);
+
+    if (rc == 0){
+        rc = freq_add_words(&f, buff, str_len);
+    }
+    if (rc == 0){
+        rc = freq_print(&f, top);
+    }
+    freq_free(&f);
+    return rc;
 }
 
 int word_print(char *buff, int str_len){
-    printf("Word Print\n----------\n");
+    out_t out = { .fd = STDOUT_FILENO, .len = 0 };
+    int rc = 0;
+
+    fflush(stdout);
+    out_bytes(&out, "Word Print\n----------\n", 22);
 
     int word_start = 0;    //index of the start of the current word
     int word_length = 0;   //length of the current word
     int word_count = 0;    //tracks the number of words in the buffer
 
     // Print the words in the buffer
-    for (int i=0; i<=str_len; i++) {
-        if (*(buff+i) == ' ' || i == str_len) {
+    for (int i=0; i<=str_len && rc == 0; i++) {
+        if (i == str_len || IS_SEPARATOR(*(buff+i))) {
             if (word_length > 0) {
                 word_count++;
-                printf("%d. ", word_count);
-                for (int j = word_start; j<word_start+word_length; j++) {
-                    putchar(*(buff+j));
-                }
-                printf("(%d)\n", word_length);
+                out_long(&out, word_count);
+                out_bytes(&out, ". ", 2);
+                out_bytes(&out, buff+word_start, word_length);
+                out_bytes(&out, "(", 1);
+                out_long(&out, word_length);
+                rc = out_bytes(&out, ")\n", 2);
                 word_length = 0;
             }
         } else {
@@ -144,11 +204,18 @@ int word_print(char *buff, int str_len){
         }
     }
 
-    printf("\nNumber of words returned: %d\n", word_count);
+    out_bytes(&out, "\nNumber of words returned: ", 27);
+    out_long(&out, word_count);
+    out_bytes(&out, "\n", 1);
+    if (out_flush(&out) < 0 || rc < 0){
+        return -1;
+    }
     return 0;
 }
 
-int replace_string(char *buff, int len, int str_len, char *search, char *replace){
+// Replaces the first match of search in buff, or every match if all is
+// set, in one pass.  The result is cut off at len and padded with periods.
+int replace_in_buff(char *buff, int len, int str_len, char *search, char *replace, int all){
     int search_len = 0;    //length of the search string
     int replace_len = 0;   //length of the replace string
 
@@ -180,65 +247,930 @@ int replace_string(char *buff, int len, int str_len, char *search, char *replace
         return -4;
     }
 
-    // Find the first occurrence of the search string
-    char *match_start = NULL;
-    for (int i = 0; i <= str_len-search_len; i++) {
-        int match = 1;
-        for (int j = 0; j < search_len; j++) {
-            if (*(buff+i+j) != *(search+j)) {
-                match = 0;
-                break;
+    // Build the new string in a scratch copy, every part of it cut off
+    // at the end of the buffer
+    char *new = (char *)malloc(len);
+    if (new == NULL){
+        return -99;
+    }
+    int new_str_len = 0;
+    int pos = 0;            //where the search for the next match starts
+    int found = 0;
+
+    bmh_t bmh;
+    bmh_init(&bmh, search, search_len);
+    char *match_start;
+    while ((found == 0 || all) &&
+           (match_start = bmh_find(&bmh, buff+pos, str_len-pos)) != NULL) {
+        new_str_len = append_capped(new, new_str_len, len, buff+pos, match_start-(buff+pos));
+        new_str_len = append_capped(new, new_str_len, len, replace, replace_len);
+        pos = match_start-buff+search_len;
+        found = 1;
+    }
+
+    // If the search string is not found, return an error
+    if (!found) {
+        free(new);
+        return -5;
+    }
+    new_str_len = append_capped(new, new_str_len, len, buff+pos, str_len-pos);
+
+    // Copy the new string back into the buffer
+    memcpy(buff, new, new_str_len);
+    free(new);
+
+    // Fill the rest of the buffer with periods
+    while (new_str_len < len){
+        *(buff+new_str_len++) = '.';
+    }
+
+    return 0;
+}
+
+int replace_string(char *buff, int len, int str_len, char *search, char *replace){
+    return replace_in_buff(buff, len, str_len, search, replace, 0);
+}
+
+int replace_all_string(char *buff, int len, int str_len, char *search, char *replace){
+    return replace_in_buff(buff, len, str_len, search, replace, 1);
+}
+
+// Appends n bytes of src to dst[0..at), stopping at cap.  Returns the new
+// length of dst.
+int append_capped(char *dst, int at, int cap, char *src, int n){
+    if (n > cap-at){
+        n = cap-at;
+    }
+    memcpy(dst+at, src, n);
+    return at+n;
+}
+
+//collects what ac_scan() lets through for replace_pairs_in_buff()
+typedef struct capped {
+    char *buff;
+    int   len;
+    int   cap;
+} capped_t;
+
+static void emit_capped(void *arg, char *text, int n){
+    capped_t *out = (capped_t *)arg;
+    out->len = append_capped(out->buff, out->len, out->cap, text, n);
+}
+
+// Replaces every match of every pair in ac, in one pass, cut off at len
+// and padded with periods like replace_in_buff().  Finding no match is
+// not an error.  Returns 0 or -99 if the scratch copy can not be
+// allocated.
+int replace_pairs_in_buff(char *buff, int len, int str_len, ac_t *ac){
+    capped_t new = { (char *)malloc(len), 0, len };
+    if (new.buff == NULL){
+        return -99;
+    }
+
+    int state = 0;
+    int flushed = 0;
+    ac_scan(ac, buff, 0, str_len, &state, &flushed, emit_capped, &new);
+    emit_capped(&new, buff+flushed, str_len-flushed);
+
+    memcpy(buff, new.buff, new.len);
+    free(new.buff);
+    while (new.len < len){
+        *(buff+new.len++) = '.';
+    }
+    return 0;
+}
+
+// Boyer-Moore-Horspool.  skip[c] is how far the pattern can slide when c
+// is the text byte under its last byte and the window did not match, so
+// most windows are rejected after looking at one byte.
+void bmh_init(bmh_t *bmh, char *pattern, int len){
+    bmh->pattern = pattern;
+    bmh->len = len;
+    for (int c = 0; c < 256; c++) {
+        bmh->skip[c] = len;
+    }
+    for (int i = 0; i < len-1; i++) {
+        bmh->skip[(unsigned char)*(pattern+i)] = len-1-i;
+    }
+}
+
+// Returns the first match of the pattern in text[0..n), or NULL.
+char *bmh_find(bmh_t *bmh, char *text, int n){
+    int m = bmh->len;
+    if (m == 1){
+        return memchr(text, *bmh->pattern, n);
+    }
+
+    unsigned char last = *(bmh->pattern+m-1);
+    for (int i = 0; i <= n-m; ) {
+        unsigned char c = *(text+i+m-1);
+        if (c == last && memcmp(text+i, bmh->pattern, m-1) == 0){
+            return text+i;
+        }
+        i += bmh->skip[c];
+    }
+    return NULL;
+}
+
+//STREAMING MODE: the same operations over a file or stdin of any size,
+//read STREAM_CHUNK_SZ bytes at a time so memory use does not grow
+
+// Opens path ("-" is stdin) for streaming.  A regular file is mapped so
+// chunks can be handed out without copying them, unless STRINGFUN_MMAP is
+// off.  Returns 0, -1 if the file can not be opened or -99 if the chunk
+// buffer can not be allocated.
+int stream_open(stream_t *s, char *path){
+    struct stat st;
+    char *use_mmap = getenv(MMAP_ENV);
+
+    if (strcmp(path, "-") == 0) {
+        s->fd = STDIN_FILENO;
+    } else {
+        s->fd = open(path, O_RDONLY);
+        if (s->fd < 0){
+            return -1;
+        }
+    }
+
+    s->buff = (char *)malloc(STREAM_NEXT_SZ);
+    if (s->buff == NULL){
+        if (s->fd != STDIN_FILENO){
+            close(s->fd);
+        }
+        return -99;
+    }
+
+    // Anything that can not be mapped is read() instead
+    s->map = NULL;
+    s->map_len = 0;
+    s->map_off = 0;
+    if ((use_mmap == NULL || strcmp(use_mmap, "off") != 0) &&
+        fstat(s->fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0){
+        s->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, s->fd, 0);
+        if (s->map == MAP_FAILED){
+            s->map = NULL;
+        } else {
+            s->map_len = st.st_size;
+            madvise(s->map, s->map_len, MADV_SEQUENTIAL);
+        }
+    }
+
+    s->data = s->buff;
+    s->line_has_word = 0;
+    s->pending_space = 0;
+    s->normalize = pick_normalizer();
+    s->count = pick_counter();
+    return 0;
+}
+
+void stream_close(stream_t *s){
+    if (s->map != NULL){
+        munmap(s->map, s->map_len);
+    }
+    if (s->fd != STDIN_FILENO){
+        close(s->fd);
+    }
+    free(s->buff);
+}
+
+// Normalizes src[0..len) into dst the way setup_buff() does, line by
+// line: runs of spaces and tabs become one space and are dropped at the
+// start and end of a line.  Newlines are kept.  The state lives in s so
+// a run of blanks split across two chunks is still collapsed.  The space
+// owed from the last chunk can make the output one byte longer than len,
+// so dst may be src-1 but no later.  Returns the output length.
+int normalize_chunk_scalar(stream_t *s, char *src, char *dst, int len){
+    char *out = dst;
+
+    for (int i=0; i<len; i++) {
+        char c = *(src+i);
+        if (c == ' ' || c == '\t'){
+            if (s->line_has_word){
+                s->pending_space = 1;
             }
+        } else if (c == '\n'){
+            *out++ = '\n';
+            s->line_has_word = 0;
+            s->pending_space = 0;
+        } else {
+            if (s->pending_space){
+                *out++ = ' ';
+                s->pending_space = 0;
+            }
+            *out++ = c;
+            s->line_has_word = 1;
         }
-        if (match) {
-            match_start = buff+i;
-            break;
+    }
+
+    return out-dst;
+}
+
+// Reads and normalizes the next chunk into s->buff.  A read() chunk is
+// read one byte in so normalizing it in place can not overrun it, a
+// mapped one is normalized straight out of the mapping.  Returns its
+// length, 0 at the end of the input or -1 on a read error.
+int stream_next(stream_t *s){
+    int str_len = 0;
+
+    // A chunk of nothing but blanks normalizes to nothing, keep reading
+    while (str_len == 0) {
+        int n = stream_read(s);
+        if (n <= 0){
+            return n;
         }
+        str_len = s->normalize(s, s->data, s->buff, n);
     }
 
-    // If the search string is not found, return an error
-    if (!match_start) {
-        return -5;
+    return str_len;
+}
+
+// Points s->data at the next chunk as it is, without normalizing it.  For
+// a mapped file that is the mapping itself, otherwise it is read() into
+// s->buff.  Returns its length, 0 at the end of the input or -1 on a read
+// error.
+int stream_read(stream_t *s){
+    if (s->map != NULL){
+        off_t left = s->map_len - s->map_off;
+        int   n = (left < STREAM_CHUNK_SZ) ? left : STREAM_CHUNK_SZ;
+        s->data = s->map + s->map_off;
+        s->map_off += n;
+        return n;
     }
 
-    char new[len];        //store the new modified string
-    char *new_ptr = new;  //pointer to the new string
+    ssize_t n = read(s->fd, s->buff+1, STREAM_CHUNK_SZ);
+    s->data = s->buff+1;
+    return (n < 0) ? -1 : (int)n;
+}
 
-    // Copy the buffer into the new string with the search string replaced
-    for (char *ptr = buff; ptr < match_start; ptr++) {
-        *new_ptr++ = *ptr;
+int write_all(int fd, char *buff, int len){
+    while (len > 0) {
+        ssize_t n = write(fd, buff, len);
+        if (n < 0){
+            return -1;
+        }
+        buff += n;
+        len -= n;
     }
-    for (char *ptr = replace; *ptr != '\0'; ptr++) {
-        if (new_ptr-new >= len) {
+    return 0;
+}
+
+/*
+ *  Word print writes many small pieces, a number, a word, a length, and
+ *  printf() and putchar() take the stdio lock and parse a format for each
+ *  of them.  An out_t gathers the pieces in one buffer and writes it when
+ *  it fills.  A piece that does not fit goes out in the same writev() as
+ *  the buffer, so a long word is not copied.  Whatever was printed with
+ *  stdio before has to be flushed with fflush() first.
+ *
+ *  Each returns 0, or -1 if the write fails.
+ */
+int out_bytes(out_t *o, char *p, int n){
+    if (o->len+n <= OUT_BUF_SZ){
+        memcpy(o->buff+o->len, p, n);
+        o->len += n;
+        return 0;
+    }
+
+    struct iovec iov[2] = {{o->buff, o->len}, {p, n}};
+    int first = 0;
+    while (first < 2) {
+        ssize_t done = writev(o->fd, iov+first, 2-first);
+        if (done < 0){
+            return -1;
+        }
+        for (; first < 2 && (size_t)done >= iov[first].iov_len; first++) {
+            done -= iov[first].iov_len;
+        }
+        if (first < 2){
+            iov[first].iov_base = (char *)iov[first].iov_base+done;
+            iov[first].iov_len -= done;
+        }
+    }
+    o->len = 0;
+    return 0;
+}
+
+// Formats v in decimal, the digits come out last first
+int out_long(out_t *o, unsigned long v){
+    char digits[20];
+    int  i = sizeof(digits);
+
+    do {
+        digits[--i] = '0'+v%10;
+        v /= 10;
+    } while (v > 0);
+    return out_bytes(o, digits+i, sizeof(digits)-i);
+}
+
+int out_flush(out_t *o){
+    int rc = write_all(o->fd, o->buff, o->len);
+    o->len = 0;
+    return rc;
+}
+
+// Appends n bytes to the word carried into the next chunk, growing it to
+// twice what it needs so a long word is not copied once per chunk.  The
+// caller frees buff.  Returns 0, or -99 if the word can not be held.
+int carry_append(carry_t *c, char *p, int n){
+    if (c->len+n > c->cap){
+        int   cap = (c->len+n)*2;
+        char *grown = (char *)realloc(c->buff, cap);
+        if (grown == NULL){
+            return -99;
+        }
+        c->buff = grown;
+        c->cap = cap;
+    }
+    memcpy(c->buff+c->len, p, n);
+    c->len += n;
+    return 0;
+}
+
+// Normalizing never changes where words start, so the count is taken
+// straight from the input without it.
+long stream_count_words(stream_t *s){
+    long word_count = 0;    //a large file can hold more than INT_MAX words
+    int  in_word = 0;       //carried between chunks
+    int  str_len;
+
+    while ((str_len = stream_read(s)) > 0) {
+        word_count += s->count(s->data, str_len, &in_word);
+    }
+
+    return (str_len < 0) ? -1 : word_count;
+}
+
+// Same output as word_print().  A word is printed as its bytes arrive and
+// its length is printed when it ends, so a word longer than a chunk needs
+// no extra memory.  Output is gathered in an out_t and written
+// OUT_BUF_SZ at a time rather than going through stdio per word.
+// Normalizing only changes the blanks between words, so the words are
+// taken straight from the input.
+int stream_word_print(stream_t *s){
+    out_t out = { .fd = STDOUT_FILENO, .len = 0 };
+    long word_count = 0;    //tracks the number of words so far
+    long word_length = 0;   //length of the current word, 0 between words
+    int  str_len;
+    int  rc = 0;
+
+    fflush(stdout);
+    out_bytes(&out, "Word Print\n----------\n", 22);
+
+    while (rc == 0 && (str_len = stream_read(s)) > 0) {
+        int i = 0;
+        while (i < str_len && rc == 0) {
+            if (IS_SEPARATOR(*(s->data+i))){
+                if (word_length > 0){
+                    out_bytes(&out, "(", 1);
+                    out_long(&out, word_length);
+                    rc = out_bytes(&out, ")\n", 2);
+                    word_length = 0;
+                }
+                i++;
+                continue;
+            }
+
+            // Print the rest of the word that is inside this chunk
+            int word_start = i;
+            while (i < str_len && !IS_SEPARATOR(*(s->data+i))) {
+                i++;
+            }
+            if (word_length == 0){
+                word_count++;
+                out_long(&out, word_count);
+                out_bytes(&out, ". ", 2);
+            }
+            rc = out_bytes(&out, s->data+word_start, i-word_start);
+            word_length += i-word_start;
+        }
+    }
+    if (word_length > 0){
+        out_bytes(&out, "(", 1);
+        out_long(&out, word_length);
+        out_bytes(&out, ")\n", 2);
+    }
+
+    out_bytes(&out, "\nNumber of words returned: ", 27);
+    out_long(&out, word_count);
+    out_bytes(&out, "\n", 1);
+    if (out_flush(&out) < 0){
+        rc = -1;
+    }
+    return (str_len < 0 || rc < 0) ? -1 : 0;
+}
+
+// One slice of the file for parallel_count_words().  A word that crosses
+// into the next slice is counted by both, so each slice also says whether
+// it starts and ends inside a word.
+typedef struct count_job {
+    int   fd;
+    off_t start;            //first byte of the slice
+    off_t end;              //one past the last byte
+    long  words;            //words starting in the slice, or -1 on error
+    int   starts_in_word;   //first byte is part of a word
+    int   ends_in_word;     //last byte is part of a word
+} count_job_t;
+
+static void *count_slice(void *arg){
+    count_job_t *job = (count_job_t *)arg;
+    count_fn_t   count = pick_counter();
+    char        *buff = (char *)malloc(STREAM_CHUNK_SZ);
+    int          in_word = 0;
+
+    job->words = 0;
+    if (buff == NULL){
+        job->words = -1;
+        return NULL;
+    }
+
+    for (off_t off = job->start; off < job->end; ) {
+        int want = (job->end-off < STREAM_CHUNK_SZ) ? job->end-off : STREAM_CHUNK_SZ;
+        ssize_t n = pread(job->fd, buff, want, off);
+        if (n <= 0){
+            job->words = -1;
             break;
         }
-        *new_ptr++ = *ptr;
+        if (off == job->start){
+            job->starts_in_word = !IS_SEPARATOR(*buff);
+        }
+        job->words += count(buff, n, &in_word);
+        off += n;
     }
-    for (char *ptr = match_start+search_len; ptr < buff+str_len; ptr++) {
-         if (new_ptr-new >= len) {
+    job->ends_in_word = in_word;
+
+    free(buff);
+    return NULL;
+}
+
+// Counts the words of the first size bytes of fd with the file split
+// into one slice per thread.  Where one slice ends inside a word and the
+// next starts inside it, that word was counted twice.  Returns the count
+// or -1 on an error.
+long parallel_count_words(int fd, off_t size, int n_threads){
+    count_job_t jobs[MAX_THREADS];
+    pthread_t   tids[MAX_THREADS];
+    long        word_count = 0;
+    int         started;
+
+    // Slices smaller than a chunk are not worth a thread
+    if (size < (off_t)n_threads*STREAM_CHUNK_SZ){
+        n_threads = (size+STREAM_CHUNK_SZ-1) / STREAM_CHUNK_SZ;
+    }
+    if (n_threads < 1){
+        n_threads = 1;
+    }
+
+    for (started = 0; started < n_threads; started++) {
+        count_job_t *job = &jobs[started];
+        job->fd = fd;
+        job->start = size*started / n_threads;
+        job->end = size*(started+1) / n_threads;
+        job->starts_in_word = 0;
+        job->ends_in_word = 0;
+        if (pthread_create(&tids[started], NULL, count_slice, job) != 0){
             break;
         }
-        *new_ptr++ = *ptr;
     }
 
-    // Null terminate the new string
-    *new_ptr = '\0';
+    for (int i = 0; i < started; i++) {
+        pthread_join(tids[i], NULL);
+        if (jobs[i].words < 0 || word_count < 0){
+            word_count = -1;
+            continue;
+        }
+        word_count += jobs[i].words;
+        if (i > 0 && jobs[i-1].ends_in_word && jobs[i].starts_in_word){
+            word_count--;
+        }
+    }
 
-    // Copy the new string back into the buffer
-    int new_str_len = new_ptr-new;
-    for (int i = 0; i < new_str_len; i++) {
-        *(buff+i) = *(new+i);
+    return (started < n_threads) ? -1 : word_count;
+}
+
+// Reverses a mapped file one chunk at a time from its end.  Normalizing
+// reads the same forwards and backwards, so each chunk is reversed first
+// and then normalized, with the normalizer state carried towards the
+// start of the file.
+static int reverse_mapped(stream_t *s){
+    fflush(stdout);
+    for (off_t end = s->map_len; end > 0; ) {
+        int chunk = (end < STREAM_CHUNK_SZ) ? end : STREAM_CHUNK_SZ;
+        end -= chunk;
+        if (end > 0){
+            off_t ahead = (end < STREAM_CHUNK_SZ) ? end : STREAM_CHUNK_SZ;
+            madvise(s->map+end-ahead, ahead, MADV_WILLNEED);
+        }
+
+        memcpy(s->buff+1, s->map+end, chunk);
+        reverse_string(s->buff+1, chunk);
+        int str_len = s->normalize(s, s->buff+1, s->buff, chunk);
+        if (write_all(STDOUT_FILENO, s->buff, str_len) < 0){
+            return -2;
+        }
     }
+    return 0;
+}
 
-    // Fill the rest of the buffer with periods
-    while (new_str_len < len){
-        *(buff+new_str_len++) = '.';
+// Writes the normalized input to stdout back to front.  A mapped file is
+// walked from its end.  The end of any other stream is only known once
+// it has all been read, so its normalized chunks are spooled to a
+// temporary file which is then read back one chunk at a time from its
+// end.  Returns 0, -1 on a read error or -2 if the temporary file can not
+// be created or the output written.
+int stream_reverse(stream_t *s){
+    if (s->map != NULL){
+        return reverse_mapped(s);
+    }
+
+    FILE *spool = tmpfile();
+    if (spool == NULL){
+        return -2;
+    }
+    int   spool_fd = fileno(spool);
+    off_t spool_len = 0;
+    int   str_len;
+
+    while ((str_len = stream_next(s)) > 0) {
+        if (write_all(spool_fd, s->buff, str_len) < 0){
+            fclose(spool);
+            return -2;
+        }
+        spool_len += str_len;
+    }
+    if (str_len < 0){
+        fclose(spool);
+        return -1;
+    }
+
+    fflush(stdout);
+    while (spool_len > 0) {
+        int chunk = (spool_len < STREAM_CHUNK_SZ) ? spool_len : STREAM_CHUNK_SZ;
+        spool_len -= chunk;
+        if (pread(spool_fd, s->buff, chunk, spool_len) != chunk){
+            fclose(spool);
+            return -2;
+        }
+        reverse_string(s->buff, chunk);
+        if (write_all(STDOUT_FILENO, s->buff, chunk) < 0){
+            fclose(spool);
+            return -2;
+        }
+    }
+
+    fclose(spool);
+    return 0;
+}
+
+// Writes the normalized input to stdout with every word reversed.  Words
+// inside a chunk are reversed where they are.  A word cut by the end of
+// a chunk is copied aside until its end turns up, so memory grows with
+// the longest word but not with the input.  Returns 0, -1 on a read
+// error, -2 if the output can not be written or -99 if the word can not
+// be held.
+int stream_reverse_words(stream_t *s){
+    carry_t word = {0};     //the start of a word cut by a chunk boundary
+    int     str_len;
+
+    fflush(stdout);
+    while ((str_len = stream_next(s)) > 0) {
+        int start = 0;
+        int end = str_len;
+
+        // Finish the word carried over from the last chunk
+        if (word.len > 0){
+            while (start < str_len && !IS_SEPARATOR(*(s->buff+start))) {
+                start++;
+            }
+            if (carry_append(&word, s->buff, start) != 0){
+                free(word.buff);
+                return -99;
+            }
+            if (start == str_len){
+                continue;
+            }
+            reverse_string(word.buff, word.len);
+            if (write_all(STDOUT_FILENO, word.buff, word.len) < 0){
+                free(word.buff);
+                return -2;
+            }
+            word.len = 0;
+        }
+
+        // Hold back a word that runs into the next chunk
+        while (end > start && !IS_SEPARATOR(*(s->buff+end-1))) {
+            end--;
+        }
+        reverse_words(s->buff+start, end-start);
+        if (write_all(STDOUT_FILENO, s->buff+start, end-start) < 0){
+            free(word.buff);
+            return -2;
+        }
+
+        if (carry_append(&word, s->buff+end, str_len-end) != 0){
+            free(word.buff);
+            return -99;
+        }
+    }
+    reverse_string(word.buff, word.len);
+    int wr = write_all(STDOUT_FILENO, word.buff, word.len);
+    free(word.buff);
+
+    if (wr < 0){
+        return -2;
+    }
+    return (str_len < 0) ? -1 : 0;
+}
+
+// Writes the normalized input to stdout with the first match of search
+// replaced, or every match if all is set, like replace_in_buff() but never
+// truncated.  The last search_len-1 bytes of each chunk are held back and
+// searched again with the next chunk so a match split across two chunks
+// is still found.  Returns 0, -1/-2 for an empty search/replace string,
+// -2 if the output can not be written, -5 if search was not found (the
+// input has still been written), -6 on a read error or -99 if the window
+// can not be allocated.
+int stream_replace(stream_t *s, char *search, char *replace, int all){
+    int search_len = strlen(search);
+    int replace_len = strlen(replace);
+
+    if (search_len == 0){
+        return -1;
+    }
+    if (replace_len == 0){
+        return -2;
+    }
+
+    // The held back tail followed by the next chunk
+    char *window = (char *)malloc(search_len-1 + STREAM_NEXT_SZ);
+    if (window == NULL){
+        return -99;
+    }
+
+    bmh_t bmh;
+    bmh_init(&bmh, search, search_len);
+    int keep = 0;       //bytes held back at the front of window
+    int found = 0;
+    int wr = 0;         //-1 once a write has failed
+    int str_len;
+
+    fflush(stdout);
+    while (wr == 0 && (str_len = stream_next(s)) > 0) {
+        if (found && !all){
+            wr = write_all(STDOUT_FILENO, s->buff, str_len);
+            continue;
+        }
+
+        memcpy(window+keep, s->buff, str_len);
+        int win_len = keep+str_len;
+        int pos = 0;    //everything before pos has been written
+
+        char *match;
+        while (wr == 0 && (found == 0 || all) &&
+               (match = bmh_find(&bmh, window+pos, win_len-pos)) != NULL) {
+            wr = write_all(STDOUT_FILENO, window+pos, match-(window+pos));
+            wr |= write_all(STDOUT_FILENO, replace, replace_len);
+            pos = match-window+search_len;
+            found = 1;
+        }
+
+        if (found && !all){
+            wr |= write_all(STDOUT_FILENO, window+pos, win_len-pos);
+            keep = 0;
+            continue;
+        }
+
+        // Everything but a possible partial match goes out
+        int flush = win_len-(search_len-1);
+        if (flush < pos){
+            flush = pos;
+        }
+        wr |= write_all(STDOUT_FILENO, window+pos, flush-pos);
+        memmove(window, window+flush, win_len-flush);
+        keep = win_len-flush;
+    }
+    if (wr == 0){
+        wr = write_all(STDOUT_FILENO, window, keep);
+    }
+    free(window);
+
+    if (wr < 0){
+        return -2;
+    }
+    if (str_len < 0){
+        return -6;
+    }
+    return found ? 0 : -5;
+}
+
+// ac_scan() callback, arg is an int that is set to -1 once a write fails
+static void emit_stdout(void *arg, char *text, int n){
+    int *wr = (int *)arg;
+    if (*wr == 0){
+        *wr = write_all(STDOUT_FILENO, text, n);
+    }
+}
+
+// Writes the normalized input to stdout with every match of every pair in
+// ac replaced, in one pass over it.  The bytes the automaton is still
+// inside of at the end of a chunk, at most the longest search string, are
+// held back until the next chunk shows whether they match.  Finding no
+// match is not an error.  Returns 0, -2 if the output can not be written,
+// -6 on a read error or -99 if the window can not be allocated.
+int stream_replace_pairs(stream_t *s, ac_t *ac){
+    char *window = (char *)malloc(ac->max_len-1 + STREAM_NEXT_SZ);
+    if (window == NULL){
+        return -99;
+    }
+
+    int keep = 0;       //bytes held back at the front of window
+    int state = 0;
+    int wr = 0;         //-1 once a write has failed
+    int str_len = 0;
+
+    fflush(stdout);
+    while (wr == 0 && (str_len = stream_next(s)) > 0) {
+        memcpy(window+keep, s->buff, str_len);
+        int win_len = keep+str_len;
+        int flushed = 0;
+
+        ac_scan(ac, window, keep, win_len, &state, &flushed, emit_stdout, &wr);
+
+        // Only the bytes the automaton is inside of can still match
+        int safe = win_len-ac->depth[state];
+        emit_stdout(&wr, window+flushed, safe-flushed);
+        memmove(window, window+safe, win_len-safe);
+        keep = win_len-safe;
+    }
+    emit_stdout(&wr, window, keep);
+    free(window);
+
+    if (wr < 0){
+        return -2;
+    }
+    return (str_len < 0) ? -6 : 0;
+}
+
+// Same output as word_freq().  Words are counted straight from the input
+// like stream_word_print() does.  A word cut by the end of a chunk is
+// copied aside until its end turns up.  Returns 0, -1 on a read error or
+// -99 if memory runs out.
+int stream_word_freq(stream_t *s, int top){
+    freq_t  f;
+    carry_t word = {0};     //the start of a word cut by a chunk boundary
+    int     str_len = 0;
+    int     rc = freq_init(&f);
+
+    while (rc == 0 && (str_len = stream_read(s)) > 0) {
+        int start = 0;
+        int end = str_len;
+
+        while (start < str_len && !IS_SEPARATOR(*(s->data+start))) {
+            start++;
+        }
+        // A chunk with no separator at all is the middle of a word
+        if (start == str_len){
+            end = 0;
+        } else {
+            while (!IS_SEPARATOR(*(s->data+end-1))) {
+                end--;
+            }
+        }
+
+        rc = carry_append(&word, s->data, start);
+        if (rc != 0 || end == 0){
+            continue;
+        }
+
+        if (word.len > 0){
+            rc = freq_add(&f, word.buff, word.len);
+        }
+        if (rc == 0){
+            rc = freq_add_words(&f, s->data+start, end-start);
+        }
+
+        // Keep the word that runs into the next chunk
+        word.len = 0;
+        if (rc == 0){
+            rc = carry_append(&word, s->data+end, str_len-end);
+        }
+    }
+    if (rc == 0 && word.len > 0){
+        rc = freq_add(&f, word.buff, word.len);
+    }
+    if (rc == 0 && str_len < 0){
+        rc = -1;
+    }
+    if (rc == 0){
+        rc = freq_print(&f, top);
     }
 
-    //printf("Modified String: %s\n", new);
+    free(word.buff);
+    freq_free(&f);
+    return rc;
+}
+
+// Handles ./stringfun -<opt> -s [file|-] [other args].  Errors go to
+// stderr because stdout carries the reversed or replaced text.
+int run_stream(char opt, int argc, char *argv[]){
+    char    *path = (argc > 3) ? argv[3] : "-";
+    stream_t s;
+    struct stat st;
+    ac_t     ac;
+    long     words;
+    int      threads = 1;
+    int      pairs = (opt == 'x' && argc == 6 && strcmp(argv[4], "-p") == 0);    //see usage()
+    int      top = FREQ_TOP;
+    int      rc;
+
+    if ((opt == 'x' || opt == 'a') && argc < 6){
+        printf("usage: %s -%c -s [file|-] [search arg] [replace arg]\n", argv[0], opt);
+        return 1;
+    }
+    if (opt != 'c' && opt != 'r' && opt != 'w' && opt != 'x' && opt != 'a' && opt != 'v' && opt != 'f'){
+        usage(argv[0]);
+        return 1;
+    }
+    if (opt == 'c' && argc > 4){
+        threads = (argc > 5 && strcmp(argv[4], "-j") == 0) ? atoi(argv[5]) : 0;
+        if (threads < 1 || threads > MAX_THREADS){
+            printf("usage: %s -c -s file -j [1-%d]\n", argv[0], MAX_THREADS);
+            return 1;
+        }
+    }
+    if (opt == 'f' && argc > 4){
+        top = parse_top(argv[4]);
+        if (top < 1){
+            printf("usage: %s -f -s [file|-] [number of words]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (pairs){
+        rc = ac_load(&ac, argv[5]);
+        if (rc < 0){
+            fprintf(stderr, "Error loading pairs from %s, rc = %d\n", argv[5], rc);
+            ac_free(&ac);
+            return 2;
+        }
+    }
+
+    rc = stream_open(&s, path);
+    if (rc < 0 && pairs){
+        ac_free(&ac);
+    }
+    if (rc == -99){
+        printf("Error allocating buffer, error = %d\n", 99);
+        return 99;
+    }
+    if (rc < 0){
+        fprintf(stderr, "Error opening %s\n", path);
+        return 2;
+    }
+
+    switch (opt){
+        case 'c':
+            // Only a regular file can be split, a pipe is read in order
+            if (threads > 1 && fstat(s.fd, &st) == 0 && S_ISREG(st.st_mode)){
+                words = parallel_count_words(s.fd, st.st_size, threads);
+            } else {
+                words = stream_count_words(&s);
+            }
+            rc = (words < 0) ? -1 : 0;
+            if (rc == 0){
+                printf("Word Count: %ld\n", words);
+            }
+            break;
+        case 'r':
+            rc = stream_reverse(&s);
+            break;
+        case 'v':
+            rc = stream_reverse_words(&s);
+            break;
+        case 'w':
+            rc = stream_word_print(&s);
+            break;
+        case 'f':
+            rc = stream_word_freq(&s, top);
+            break;
+        default:
+            if (pairs){
+                rc = stream_replace_pairs(&s, &ac);
+                ac_free(&ac);
+            } else {
+                rc = stream_replace(&s, argv[4], argv[5], opt == 'a');
+            }
+            break;
+    }
+    stream_close(&s);
+
+    if (rc < 0){
+        fprintf(stderr, "Error streaming %s, rc = %d\n", path, rc);
+        return 2;
+    }
     return 0;
 }
 
+#ifndef STRINGFUN_NO_MAIN
 int main(int argc, char *argv[]){
 
     char *buff;             //placehoder for the internal buffer
@@ -246,6 +1178,7 @@ int main(int argc, char *argv[]){
     char opt;               //used to capture user option from cmd line
     int  rc;                //used for return codes
     int  user_str_len;      //length of user supplied string
+    int  top;               //number of words -f reports
 
     //TODO:  #1. WHY IS THIS SAFE, aka what if argv[1] does not exist?
     /* 
@@ -269,6 +1202,11 @@ int main(int argc, char *argv[]){
 
     //WE NOW WILL HANDLE THE REQUIRED OPERATIONS
 
+    //-s in place of the string streams a file or stdin instead
+    if (argc >= 3 && strcmp(argv[2], "-s") == 0){
+        exit(run_stream(opt, argc, argv));
+    }
+
     //TODO:  #2 Document the purpose of the if statement below
     /*
         This if statement checks to see if there are less than 3 arguments. If there are 
@@ -319,6 +1257,15 @@ int main(int argc, char *argv[]){
             }
             break;
 
+        case 'v':
+            rc = reverse_words(buff, user_str_len);
+            if (rc < 0){
+                printf("Error reversing words, rc = %d\n", rc);
+                free(buff);
+                exit(2);
+            }
+            break;
+
         case 'w':
             rc = word_print(buff, user_str_len);
             if (rc < 0){
@@ -336,7 +1283,33 @@ int main(int argc, char *argv[]){
                 exit(1);
             }
 
-            rc = replace_string(buff, BUFFER_SZ, user_str_len, argv[3], argv[4]);
+            // -p takes a file of tab separated search/replace pairs, so -x
+            // can not search for "-p" itself, -a can
+            if (argc == 5 && strcmp(argv[3], "-p") == 0) {
+                ac_t ac;
+                rc = ac_load(&ac, argv[4]);
+                if (rc == 0){
+                    rc = replace_pairs_in_buff(buff, BUFFER_SZ, user_str_len, &ac);
+                }
+                ac_free(&ac);
+            } else {
+                rc = replace_string(buff, BUFFER_SZ, user_str_len, argv[3], argv[4]);
+            }
+            if (rc < 0){
+                printf("Error searching and replacing words, rc = %d\n", rc);
+                free(buff);
+                exit(2);
+            }
+            break;
+
+        case 'a':
+            if (argc < 5) {
+                printf("usage: %s -a \"string\" [search arg] [replace arg]\n", argv[0]);
+                free(buff);
+                exit(1);
+            }
+
+            rc = replace_all_string(buff, BUFFER_SZ, user_str_len, argv[3], argv[4]);
             if (rc < 0){
                 printf("Error searching and replacing words, rc = %d\n", rc);
                 free(buff);
@@ -344,6 +1317,22 @@ int main(int argc, char *argv[]){
             }
             break;
 
+        case 'f':
+            top = (argc > 3) ? parse_top(argv[3]) : FREQ_TOP;
+            if (top < 1) {
+                printf("usage: %s -f \"string\" [number of words]\n", argv[0]);
+                free(buff);
+                exit(1);
+            }
+
+            rc = word_freq(buff, user_str_len, top);
+            if (rc < 0){
+                printf("Error counting word frequencies, rc = %d\n", rc);
+                free(buff);
+                exit(2);
+            }
+            break;
+
         default:
             usage(argv[0]);
             free(buff);
@@ -355,6 +1344,7 @@ int main(int argc, char *argv[]){
     free(buff);
     exit(0);
 }
+#endif
 
 //TODO:  #7  Notice all of the helper functions provided in the 
 //          starter take both the buffer as well as the length.  Why
@@ -0,0 +1,177 @@
+#ifndef __STRINGFUN_H__
+#define __STRINGFUN_H__
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#define BUFFER_SZ 50
+#define STREAM_CHUNK_SZ (1 << 20)   //bytes read per chunk in streaming mode
+#define STREAM_NEXT_SZ  (STREAM_CHUNK_SZ+1)    //most bytes stream_next() returns
+#define SIMD_ENV        "STRINGFUN_SIMD"    //scalar, sse2 or avx2, default best
+#define MAX_THREADS     64          //most threads -j takes
+#define MMAP_ENV        "STRINGFUN_MMAP"    //off reads files instead of mapping them
+#define OUT_BUF_SZ      (64 * 1024) //bytes word print gathers per write
+#define FREQ_TOP        10          //words -f reports when not told how many
+
+//bytes that end a word, before or after normalizing
+#define IS_SEPARATOR(c) ((c) == ' ' || (c) == '\t' || (c) == '\n')
+
+typedef struct stream stream_t;
+
+//search/replace pairs for -x -p, see ac_load() in stringfun_ac.c
+typedef struct ac {
+    char **search;
+    char **replace;
+    int   *search_len;
+    int   *replace_len;
+    int    n_pairs;
+    int    cap_pairs;
+    int    max_len;             //longest search string
+    int    byte_class[256];     //column of each byte in next
+    int    n_classes;
+    int   *next;                //n_states rows of n_classes transitions
+    int   *fail;
+    int   *depth;               //bytes from the root to each state
+    int   *out;                 //pair that matches at each state, or -1
+    int    n_states;
+    int    cap_states;
+} ac_t;
+
+//takes the text and replacements ac_scan() lets through
+typedef void (*ac_emit_fn)(void *, char *, int);
+
+//a pattern ready for bmh_find()
+typedef struct bmh {
+    char *pattern;
+    int   len;
+    int   skip[256];        //slide for each byte under the last one
+} bmh_t;
+
+//normalizes one chunk, see normalize_chunk_scalar()
+typedef int (*normalize_fn_t)(stream_t *, char *, char *, int);
+
+//counts the words starting in one chunk, see count_words_chunk()
+typedef int (*count_fn_t)(char *, int, int *);
+
+//reverses a buffer in place, see reverse_string_scalar()
+typedef int (*reverse_fn_t)(char *, int);
+
+//output gathered for one write, see out_bytes()
+typedef struct out {
+    int  fd;
+    int  len;
+    char buff[OUT_BUF_SZ];
+} out_t;
+
+//the start of a word cut by a chunk boundary, see carry_append()
+typedef struct carry {
+    char *buff;
+    int   len;
+    int   cap;
+} carry_t;
+
+//blocks the words of a freq_t are copied into, see stringfun_freq.c
+typedef struct arena_block arena_block_t;
+typedef struct arena {
+    arena_block_t *head;    //the block being filled, it links to the older ones
+} arena_t;
+
+//one distinct word and how often it was seen
+typedef struct freq_entry {
+    char         *word;     //in the arena, not terminated, NULL for a free slot
+    int           len;
+    unsigned long hash;
+    long          count;
+} freq_entry_t;
+
+//word counts for -f, see freq_add()
+typedef struct freq {
+    freq_entry_t *slots;
+    long          cap;      //a power of two
+    long          n_words;  //distinct words
+    arena_t       arena;
+} freq_t;
+
+//state for streaming mode, see stream_open()
+struct stream {
+    int   fd;               //input, a file or stdin
+    char *buff;             //one chunk, normalized in place, see stream_next()
+    char *data;             //the chunk stream_read() returned
+    char *map;              //a regular file mapped read only, or NULL
+    off_t map_len;
+    off_t map_off;          //where the next chunk of map starts
+    int   line_has_word;    //normalizer saw a word on the current line
+    int   pending_space;    //normalizer owes a space before the next word
+    normalize_fn_t normalize;   //kernel picked by pick_normalizer()
+    count_fn_t     count;       //kernel picked by pick_counter()
+};
+
+//prototypes
+void usage(char *);
+void print_buff(char *, int);
+int  setup_buff(char *, char *, int);
+
+//prototypes for functions to handle required functionality
+int  count_words(char *, int, int);
+//add additional prototypes here
+int reverse_string(char *, int);
+int reverse_string_scalar(char *, int);
+int reverse_words(char *, int);
+int word_print(char *, int);
+int replace_string(char *, int, int, char *, char *);
+int replace_all_string(char *, int, int, char *, char *);
+int replace_in_buff(char *, int, int, char *, char *, int);
+int append_capped(char *, int, int, char *, int);
+void bmh_init(bmh_t *, char *, int);
+char *bmh_find(bmh_t *, char *, int);
+int replace_pairs_in_buff(char *, int, int, ac_t *);
+int count_words_chunk(char *, int, int *);
+int parse_top(char *);
+int word_freq(char *, int, int);
+
+//prototypes for streaming mode
+int  stream_open(stream_t *, char *);
+void stream_close(stream_t *);
+int  stream_next(stream_t *);
+int  stream_read(stream_t *);
+int  normalize_chunk_scalar(stream_t *, char *, char *, int);
+int  write_all(int, char *, int);
+int  out_bytes(out_t *, char *, int);
+int  out_long(out_t *, unsigned long);
+int  out_flush(out_t *);
+int  carry_append(carry_t *, char *, int);
+long stream_count_words(stream_t *);
+long parallel_count_words(int, off_t, int);
+int  stream_word_print(stream_t *);
+int  stream_reverse(stream_t *);
+int  stream_reverse_words(stream_t *);
+int  stream_replace(stream_t *, char *, char *, int);
+int  stream_replace_pairs(stream_t *, ac_t *);
+int  stream_word_freq(stream_t *, int);
+int  run_stream(char, int, char *[]);
+
+//prototypes for the vector kernels in stringfun_simd.c
+int  normalize_chunk_sse2(stream_t *, char *, char *, int);
+int  normalize_chunk_avx2(stream_t *, char *, char *, int);
+int  count_words_chunk_sse2(char *, int, int *);
+int  count_words_chunk_avx2(char *, int, int *);
+int  reverse_string_sse2(char *, int);
+int  reverse_string_avx2(char *, int);
+normalize_fn_t pick_normalizer(void);
+count_fn_t     pick_counter(void);
+reverse_fn_t   pick_reverser(void);
+
+//prototypes for the Aho-Corasick automaton in stringfun_ac.c
+int  ac_load(ac_t *, char *);
+void ac_free(ac_t *);
+long ac_scan(ac_t *, char *, int, int, int *, int *, ac_emit_fn, void *);
+
+//prototypes for the word frequency table in stringfun_freq.c
+int  freq_init(freq_t *);
+void freq_free(freq_t *);
+int  freq_add(freq_t *, char *, int);
+int  freq_add_words(freq_t *, char *, int);
+int  freq_top(freq_t *, int, freq_entry_t **);
+int  freq_print(freq_t *, int);
+
+#endif
@@ -0,0 +1,258 @@
+/*
+ *  stringfun_ac.c
+ *
+ *  Aho-Corasick automaton for -x with a file of search/replace pairs.  All
+ *  the search strings go into one trie, the trie is turned into a DFA with
+ *  a transition for every state and byte, and the text is then run through
+ *  it once no matter how many pairs there are.
+ *
+ *  A match is replaced as soon as the automaton reaches its last byte and
+ *  the automaton starts again after it.  So where matches overlap the one
+ *  that ends first wins, and of those that end at the same byte the
+ *  longest wins.
+ *
+ *  Only bytes that appear in some search string get their own column in
+ *  the transition table, every other byte shares column 0, which keeps the
+ *  table small with many patterns.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stringfun.h"
+
+#define AC_INITIAL_STATES 64
+
+static int ac_add_state(ac_t *ac){
+    if (ac->n_states == ac->cap_states){
+        int cap = ac->cap_states ? ac->cap_states*2 : AC_INITIAL_STATES;
+        int *next = realloc(ac->next, (size_t)cap*ac->n_classes*sizeof(int));
+        int *fail = realloc(ac->fail, cap*sizeof(int));
+        int *depth = realloc(ac->depth, cap*sizeof(int));
+        int *out = realloc(ac->out, cap*sizeof(int));
+        if (next != NULL) ac->next = next;
+        if (fail != NULL) ac->fail = fail;
+        if (depth != NULL) ac->depth = depth;
+        if (out != NULL) ac->out = out;
+        if (next == NULL || fail == NULL || depth == NULL || out == NULL){
+            return -1;
+        }
+        ac->cap_states = cap;
+    }
+
+    int state = ac->n_states++;
+    memset(ac->next+(size_t)state*ac->n_classes, 0, ac->n_classes*sizeof(int));
+    ac->fail[state] = 0;
+    ac->depth[state] = 0;
+    ac->out[state] = -1;
+    return state;
+}
+
+// Splits one line of the pairs file at its tab and keeps both halves.
+// Returns 0, 1 for a line to skip, -2 for a line with no tab or nothing
+// before it, or -99 if memory runs out.
+static int ac_add_pair(ac_t *ac, char *line){
+    line[strcspn(line, "\r\n")] = '\0';
+    if (*line == '\0'){
+        return 1;
+    }
+
+    char *tab = strchr(line, '\t');
+    if (tab == NULL || tab == line){
+        return -2;
+    }
+    *tab = '\0';
+
+    if (ac->n_pairs == ac->cap_pairs){
+        int cap = ac->cap_pairs ? ac->cap_pairs*2 : 16;
+        char **search = realloc(ac->search, cap*sizeof(char *));
+        char **replace = realloc(ac->replace, cap*sizeof(char *));
+        if (search != NULL) ac->search = search;
+        if (replace != NULL) ac->replace = replace;
+        if (search == NULL || replace == NULL){
+            return -99;
+        }
+        ac->cap_pairs = cap;
+    }
+
+    ac->search[ac->n_pairs] = strdup(line);
+    ac->replace[ac->n_pairs] = strdup(tab+1);
+    if (ac->search[ac->n_pairs] == NULL || ac->replace[ac->n_pairs] == NULL){
+        free(ac->search[ac->n_pairs]);
+        free(ac->replace[ac->n_pairs]);
+        return -99;
+    }
+    ac->n_pairs++;
+    return 0;
+}
+
+// Builds the automaton once every pair is loaded: the trie first, then
+// the fail links breadth first, filling in the missing transitions from
+// them as it goes.
+static int ac_build(ac_t *ac){
+    // Bytes used by the patterns get columns 1.., the rest share column 0
+    memset(ac->byte_class, 0, sizeof(ac->byte_class));
+    ac->n_classes = 1;
+    for (int p = 0; p < ac->n_pairs; p++) {
+        for (unsigned char *c = (unsigned char *)ac->search[p]; *c; c++) {
+            if (ac->byte_class[*c] == 0){
+                ac->byte_class[*c] = ac->n_classes++;
+            }
+        }
+    }
+
+    if (ac_add_state(ac) < 0){
+        return -99;
+    }
+    for (int p = 0; p < ac->n_pairs; p++) {
+        int state = 0;
+        for (unsigned char *c = (unsigned char *)ac->search[p]; *c; c++) {
+            int *slot = ac->next+(size_t)state*ac->n_classes+ac->byte_class[*c];
+            if (*slot == 0){
+                int child = ac_add_state(ac);
+                if (child < 0){
+                    return -99;
+                }
+                slot = ac->next+(size_t)state*ac->n_classes+ac->byte_class[*c];
+                *slot = child;
+                ac->depth[child] = ac->depth[state]+1;
+            }
+            state = *slot;
+        }
+        // The same search string twice keeps the first replacement
+        if (ac->out[state] < 0){
+            ac->out[state] = p;
+        }
+        if (ac->depth[state] > ac->max_len){
+            ac->max_len = ac->depth[state];
+        }
+    }
+
+    ac->search_len = malloc(ac->n_pairs*sizeof(int));
+    ac->replace_len = malloc(ac->n_pairs*sizeof(int));
+    if (ac->search_len == NULL || ac->replace_len == NULL){
+        return -99;
+    }
+    for (int p = 0; p < ac->n_pairs; p++) {
+        ac->search_len[p] = strlen(ac->search[p]);
+        ac->replace_len[p] = strlen(ac->replace[p]);
+    }
+
+    int *queue = malloc(ac->n_states*sizeof(int));
+    if (queue == NULL){
+        return -99;
+    }
+    int head = 0, tail = 0;
+    for (int k = 0; k < ac->n_classes; k++) {
+        int child = ac->next[k];
+        if (child != 0){
+            queue[tail++] = child;
+        }
+    }
+    while (head < tail) {
+        int state = queue[head++];
+        int *row = ac->next+(size_t)state*ac->n_classes;
+        int *fail_row = ac->next+(size_t)ac->fail[state]*ac->n_classes;
+
+        // With no pattern ending here, a shorter one may end at the fail state
+        if (ac->out[state] < 0){
+            ac->out[state] = ac->out[ac->fail[state]];
+        }
+        for (int k = 0; k < ac->n_classes; k++) {
+            if (row[k] != 0){
+                ac->fail[row[k]] = fail_row[k];
+                queue[tail++] = row[k];
+            } else {
+                row[k] = fail_row[k];
+            }
+        }
+    }
+    free(queue);
+    return 0;
+}
+
+/*
+ *  Loads a file of search/replace pairs, one per line with a tab between
+ *  the search string and its replacement, and builds the automaton.  Blank
+ *  lines are skipped and the replacement may be empty.
+ *
+ *  returns:  0     the automaton is ready
+ *           -1     the file can not be opened
+ *           -2     a line has no tab, or nothing before it
+ *           -3     the file has no pairs
+ *          -99     out of memory
+ */
+int ac_load(ac_t *ac, char *path){
+    memset(ac, 0, sizeof(*ac));
+    ac->n_classes = 1;
+
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL){
+        return -1;
+    }
+
+    char  *line = NULL;
+    size_t line_cap = 0;
+    int    rc = 0;
+    while (rc >= 0 && getline(&line, &line_cap, fp) != -1) {
+        rc = ac_add_pair(ac, line);
+    }
+    free(line);
+    fclose(fp);
+
+    if (rc < 0){
+        return rc;
+    }
+    if (ac->n_pairs == 0){
+        return -3;
+    }
+    return ac_build(ac);
+}
+
+void ac_free(ac_t *ac){
+    for (int p = 0; p < ac->n_pairs; p++) {
+        free(ac->search[p]);
+        free(ac->replace[p]);
+    }
+    free(ac->search);
+    free(ac->replace);
+    free(ac->search_len);
+    free(ac->replace_len);
+    free(ac->next);
+    free(ac->fail);
+    free(ac->depth);
+    free(ac->out);
+    memset(ac, 0, sizeof(*ac));
+}
+
+/*
+ *  Runs text[from..len) through the automaton from *state.  text[*flushed..
+ *  from) is text already run through it but not yet emitted.  Each match
+ *  is replaced: emit() gets the text from *flushed up to the match and
+ *  then the replacement, and *flushed moves past the match.  Text after
+ *  the last match is not emitted, the caller emits it once it knows no
+ *  match can still start there, which is up to len-ac->depth[*state].
+ *  Returns the number of matches.
+ */
+long ac_scan(ac_t *ac, char *text, int from, int len, int *state, int *flushed, ac_emit_fn emit, void *arg){
+    int  s = *state;
+    long matches = 0;
+
+    for (int i = from; i < len; i++) {
+        s = ac->next[(size_t)s*ac->n_classes+ac->byte_class[(unsigned char)*(text+i)]];
+        int p = ac->out[s];
+        if (p < 0){
+            continue;
+        }
+
+        int match_at = i+1-ac->search_len[p];
+        emit(arg, text+*flushed, match_at-*flushed);
+        emit(arg, ac->replace[p], ac->replace_len[p]);
+        *flushed = i+1;
+        s = 0;
+        matches++;
+    }
+
+    *state = s;
+    return matches;
+}
@@ -0,0 +1,250 @@
+/*
+ *  stringfun_freq.c
+ *
+ *  Word frequencies for -f.  Each distinct word gets one slot in an open
+ *  addressing hash table with linear probing.  The table only holds a
+ *  pointer to the word, the bytes themselves are copied into an arena, a
+ *  list of large blocks handed out front to back and freed all at once,
+ *  so a file with millions of distinct words does not do a malloc() per
+ *  word.
+ *
+ *  The top N are picked with a min-heap of N slots: the heap root is the
+ *  weakest word kept so far and a word only gets in by beating it.  More
+ *  occurrences rank first, ties go to the word that sorts first, so the
+ *  output does not depend on the order of the table.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stringfun.h"
+
+#define FREQ_INITIAL_SLOTS  1024    //power of two, the table doubles
+#define ARENA_BLOCK_SZ      (1 << 20)
+
+struct arena_block {
+    arena_block_t *next;
+    size_t         used;
+    size_t         cap;
+    char           data[];
+};
+
+// Returns n bytes from the arena, NULL if memory runs out.  A word longer
+// than a block gets a block of its own.
+static char *arena_alloc(arena_t *a, size_t n){
+    arena_block_t *b = a->head;
+    if (b == NULL || b->cap-b->used < n){
+        size_t cap = (n > ARENA_BLOCK_SZ) ? n : ARENA_BLOCK_SZ;
+        b = malloc(sizeof(arena_block_t)+cap);
+        if (b == NULL){
+            return NULL;
+        }
+        b->used = 0;
+        b->cap = cap;
+        b->next = a->head;
+        a->head = b;
+    }
+    char *p = b->data+b->used;
+    b->used += n;
+    return p;
+}
+
+static void arena_free(arena_t *a){
+    while (a->head != NULL) {
+        arena_block_t *next = a->head->next;
+        free(a->head);
+        a->head = next;
+    }
+}
+
+// FNV-1a
+static unsigned long freq_hash(char *word, int len){
+    unsigned long h = 14695981039346656037UL;
+    for (int i = 0; i < len; i++) {
+        h ^= (unsigned char)*(word+i);
+        h *= 1099511628211UL;
+    }
+    return h;
+}
+
+int freq_init(freq_t *f){
+    memset(f, 0, sizeof(*f));
+    f->slots = calloc(FREQ_INITIAL_SLOTS, sizeof(freq_entry_t));
+    if (f->slots == NULL){
+        return -99;
+    }
+    f->cap = FREQ_INITIAL_SLOTS;
+    return 0;
+}
+
+void freq_free(freq_t *f){
+    free(f->slots);
+    arena_free(&f->arena);
+    memset(f, 0, sizeof(*f));
+}
+
+// Doubles the table, the words stay where they are in the arena
+static int freq_grow(freq_t *f){
+    long cap = f->cap*2;
+    freq_entry_t *slots = calloc(cap, sizeof(freq_entry_t));
+    if (slots == NULL){
+        return -99;
+    }
+    for (long i = 0; i < f->cap; i++) {
+        if (f->slots[i].word == NULL){
+            continue;
+        }
+        long j = f->slots[i].hash & (cap-1);
+        while (slots[j].word != NULL) {
+            j = (j+1) & (cap-1);
+        }
+        slots[j] = f->slots[i];
+    }
+    free(f->slots);
+    f->slots = slots;
+    f->cap = cap;
+    return 0;
+}
+
+// Counts one more of word[0..len).  Returns 0, or -99 if memory runs out.
+int freq_add(freq_t *f, char *word, int len){
+    // Kept under 3/4 full so probe runs stay short
+    if ((f->n_words+1)*4 > f->cap*3 && freq_grow(f) < 0){
+        return -99;
+    }
+
+    unsigned long h = freq_hash(word, len);
+    long i = h & (f->cap-1);
+    while (f->slots[i].word != NULL) {
+        freq_entry_t *e = f->slots+i;
+        if (e->hash == h && e->len == len && memcmp(e->word, word, len) == 0){
+            e->count++;
+            return 0;
+        }
+        i = (i+1) & (f->cap-1);
+    }
+
+    char *copy = arena_alloc(&f->arena, len);
+    if (copy == NULL){
+        return -99;
+    }
+    memcpy(copy, word, len);
+    f->slots[i].word = copy;
+    f->slots[i].len = len;
+    f->slots[i].hash = h;
+    f->slots[i].count = 1;
+    f->n_words++;
+    return 0;
+}
+
+// Counts every word of buff[0..len)
+int freq_add_words(freq_t *f, char *buff, int len){
+    int i = 0;
+    while (i < len) {
+        while (i < len && IS_SEPARATOR(*(buff+i))) {
+            i++;
+        }
+        int word_start = i;
+        while (i < len && !IS_SEPARATOR(*(buff+i))) {
+            i++;
+        }
+        if (i > word_start && freq_add(f, buff+word_start, i-word_start) < 0){
+            return -99;
+        }
+    }
+    return 0;
+}
+
+// Is a ranked below b?
+static int freq_below(freq_entry_t *a, freq_entry_t *b){
+    if (a->count != b->count){
+        return a->count < b->count;
+    }
+    int n = (a->len < b->len) ? a->len : b->len;
+    int cmp = memcmp(a->word, b->word, n);
+    return (cmp != 0) ? cmp > 0 : a->len > b->len;
+}
+
+static void heap_sift_down(freq_entry_t **heap, int n, int i){
+    for (;;) {
+        int low = i;
+        int left = 2*i+1;
+        int right = 2*i+2;
+        if (left < n && freq_below(heap[left], heap[low])){
+            low = left;
+        }
+        if (right < n && freq_below(heap[right], heap[low])){
+            low = right;
+        }
+        if (low == i){
+            return;
+        }
+        freq_entry_t *tmp = heap[i];
+        heap[i] = heap[low];
+        heap[low] = tmp;
+        i = low;
+    }
+}
+
+static void heap_sift_up(freq_entry_t **heap, int i){
+    while (i > 0 && freq_below(heap[i], heap[(i-1)/2])) {
+        freq_entry_t *tmp = heap[i];
+        heap[i] = heap[(i-1)/2];
+        heap[(i-1)/2] = tmp;
+        i = (i-1)/2;
+    }
+}
+
+/*
+ *  Puts the top k words in top[0..), most frequent first, and returns how
+ *  many there are, fewer than k if there are fewer distinct words.  Takes
+ *  n log k time for n distinct words.
+ */
+int freq_top(freq_t *f, int k, freq_entry_t **top){
+    int n = 0;
+
+    for (long i = 0; i < f->cap && k > 0; i++) {
+        freq_entry_t *e = f->slots+i;
+        if (e->word == NULL){
+            continue;
+        }
+        if (n < k){
+            top[n] = e;
+            heap_sift_up(top, n++);
+        } else if (freq_below(top[0], e)){
+            top[0] = e;
+            heap_sift_down(top, n, 0);
+        }
+    }
+
+    // Popping the root to the end leaves the heap sorted best first
+    for (int end = n-1; end > 0; end--) {
+        freq_entry_t *tmp = top[0];
+        top[0] = top[end];
+        top[end] = tmp;
+        heap_sift_down(top, end, 0);
+    }
+    return n;
+}
+
+// Prints the top k words of f, returns -99 if memory runs out
+int freq_print(freq_t *f, int k){
+    // There are never more than n_words to print, whatever k asks for
+    if (k > f->n_words){
+        k = (int)f->n_words;
+    }
+    freq_entry_t **top = malloc((size_t)(k > 0 ? k : 1)*sizeof(freq_entry_t *));
+    if (top == NULL){
+        return -99;
+    }
+    int n = freq_top(f, k, top);
+
+    printf("Word Frequency\n--------------\n");
+    for (int i = 0; i < n; i++) {
+        printf("%d. %.*s (%ld)\n", i+1, top[i]->len, top[i]->word, top[i]->count);
+    }
+    printf("\nDistinct words: %ld\n", f->n_words);
+
+    free(top);
+    return 0;
+}
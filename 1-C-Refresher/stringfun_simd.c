@@ -0,0 +1,496 @@
+/*
+ *  stringfun_simd.c
+ *
+ *  Vector versions of the streaming kernels in stringfun.c.  Every kernel
+ *  works on 64 byte blocks: the bytes are classified with SSE2 or AVX2
+ *  compares, the compare results are packed into one 64 bit mask per
+ *  class with movemask, and the rest of the work is done on those masks
+ *  with plain integer operations.  The tail of a chunk, and every machine
+ *  that is not x86, uses the scalar code.
+ *
+ *  The kernels are picked once at run time with pick_normalizer(),
+ *  pick_counter() and pick_reverser(), so the binary still runs on a CPU
+ *  without AVX2.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "stringfun.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+#ifdef HAVE_X86_SIMD
+
+/*
+ *  The normalizer on masks.  For one 64 byte block, bit i of
+ *
+ *      blank   is set if byte i is a space or a tab
+ *      nl      is set if byte i is a newline
+ *      word    is set if byte i is anything else
+ *
+ *  A run of blanks turns into one space only if a word came before it on
+ *  the same line and a word comes after it.  The runs that start right
+ *  after a word are
+ *
+ *      starts = blank & ((word << 1) | carry_in)
+ *
+ *  and adding starts to blank carries each of them through its run, which
+ *  clears the run and sets the bit just past its end.  So the bits of
+ *  (blank + starts) & ~blank are the bytes right after a run that began
+ *  after a word, and the ones that are words need a space in front.  The
+ *  last blank of such a run is kept and becomes that space.  A run that
+ *  is still open at the end of the block carries out of the add, which is
+ *  exactly the pending_space the scalar code keeps between chunks.
+ */
+typedef struct norm_masks {
+    uint64_t keep;          //bytes to keep, everything else is dropped
+    int      lead_space;    //a space from the last block goes first
+} norm_masks_t;
+
+static norm_masks_t normalize_masks(stream_t *s, uint64_t blank, uint64_t nl){
+    norm_masks_t m;
+    uint64_t word = ~(blank | nl);
+    uint64_t carry_in = (s->pending_space || s->line_has_word) ? 1 : 0;
+    uint64_t starts = blank & ((word << 1) | carry_in);
+    uint64_t sum = blank + starts;
+    uint64_t space_before = sum & ~blank & word;
+
+    m.lead_space = s->pending_space && (word & 1);
+    m.keep = word | nl | (space_before >> 1);
+
+    // State for the next block
+    s->pending_space = sum < blank;
+    if (word | nl){
+        int last = 63 - __builtin_clzll(word | nl);
+        s->line_has_word = (word >> last) & 1;
+    }
+    return m;
+}
+
+/*
+ *  SSE2
+ */
+static inline uint64_t movemask64_sse2(__m128i a, __m128i b, __m128i c, __m128i d){
+    return (uint64_t)(uint16_t)_mm_movemask_epi8(a)
+         | (uint64_t)(uint16_t)_mm_movemask_epi8(b) << 16
+         | (uint64_t)(uint16_t)_mm_movemask_epi8(c) << 32
+         | (uint64_t)(uint16_t)_mm_movemask_epi8(d) << 48;
+}
+
+int normalize_chunk_sse2(stream_t *s, char *src, char *dst, int len){
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i newline = _mm_set1_epi8('\n');
+    char *out = dst;
+    int   i = 0;
+
+    for (; i+64 <= len; i += 64) {
+        __m128i v[4], b[4], n[4];
+        for (int k = 0; k < 4; k++) {
+            v[k] = _mm_loadu_si128((__m128i *)(src+i+16*k));
+            b[k] = _mm_or_si128(_mm_cmpeq_epi8(v[k], space), _mm_cmpeq_epi8(v[k], tab));
+            n[k] = _mm_cmpeq_epi8(v[k], newline);
+            // Any blank that is kept is written as a space
+            v[k] = _mm_or_si128(_mm_andnot_si128(b[k], v[k]), _mm_and_si128(b[k], space));
+        }
+        norm_masks_t m = normalize_masks(s,
+                movemask64_sse2(b[0], b[1], b[2], b[3]),
+                movemask64_sse2(n[0], n[1], n[2], n[3]));
+
+        if (m.lead_space){
+            *out++ = ' ';
+        }
+        if (m.keep == UINT64_MAX){
+            for (int k = 0; k < 4; k++) {
+                _mm_storeu_si128((__m128i *)(out+16*k), v[k]);
+            }
+            out += 64;
+            continue;
+        }
+
+        // SSE2 has no byte shuffle, pick the kept bytes one by one
+        char block[64];
+        for (int k = 0; k < 4; k++) {
+            _mm_storeu_si128((__m128i *)(block+16*k), v[k]);
+        }
+        for (uint64_t keep = m.keep; keep; keep &= keep-1) {
+            *out++ = block[__builtin_ctzll(keep)];
+        }
+    }
+
+    out += normalize_chunk_scalar(s, src+i, out, len-i);
+    return out-dst;
+}
+
+/*
+ *  AVX2
+ *
+ *  Kept bytes are packed 8 at a time with pshufb: byte_pack[m] holds the
+ *  positions of the set bits of m in order, so shuffling a group of 8
+ *  bytes by it moves the kept ones to the front.  Unused positions are
+ *  0x80, which makes pshufb write 0.  The table is constant so the kernel
+ *  can be called before anything else has run.
+ */
+static const uint64_t byte_pack[256] = {
+    0x8080808080808080ULL, 0x8080808080808000ULL, 0x8080808080808001ULL,
+    0x8080808080800100ULL, 0x8080808080808002ULL, 0x8080808080800200ULL,
+    0x8080808080800201ULL, 0x8080808080020100ULL, 0x8080808080808003ULL,
+    0x8080808080800300ULL, 0x8080808080800301ULL, 0x8080808080030100ULL,
+    0x8080808080800302ULL, 0x8080808080030200ULL, 0x8080808080030201ULL,
+    0x8080808003020100ULL, 0x8080808080808004ULL, 0x8080808080800400ULL,
+    0x8080808080800401ULL, 0x8080808080040100ULL, 0x8080808080800402ULL,
+    0x8080808080040200ULL, 0x8080808080040201ULL, 0x8080808004020100ULL,
+    0x8080808080800403ULL, 0x8080808080040300ULL, 0x8080808080040301ULL,
+    0x8080808004030100ULL, 0x8080808080040302ULL, 0x8080808004030200ULL,
+    0x8080808004030201ULL, 0x8080800403020100ULL, 0x8080808080808005ULL,
+    0x8080808080800500ULL, 0x8080808080800501ULL, 0x8080808080050100ULL,
+    0x8080808080800502ULL, 0x8080808080050200ULL, 0x8080808080050201ULL,
+    0x8080808005020100ULL, 0x8080808080800503ULL, 0x8080808080050300ULL,
+    0x8080808080050301ULL, 0x8080808005030100ULL, 0x8080808080050302ULL,
+    0x8080808005030200ULL, 0x8080808005030201ULL, 0x8080800503020100ULL,
+    0x8080808080800504ULL, 0x8080808080050400ULL, 0x8080808080050401ULL,
+    0x8080808005040100ULL, 0x8080808080050402ULL, 0x8080808005040200ULL,
+    0x8080808005040201ULL, 0x8080800504020100ULL, 0x8080808080050403ULL,
+    0x8080808005040300ULL, 0x8080808005040301ULL, 0x8080800504030100ULL,
+    0x8080808005040302ULL, 0x8080800504030200ULL, 0x8080800504030201ULL,
+    0x8080050403020100ULL, 0x8080808080808006ULL, 0x8080808080800600ULL,
+    0x8080808080800601ULL, 0x8080808080060100ULL, 0x8080808080800602ULL,
+    0x8080808080060200ULL, 0x8080808080060201ULL, 0x8080808006020100ULL,
+    0x8080808080800603ULL, 0x8080808080060300ULL, 0x8080808080060301ULL,
+    0x8080808006030100ULL, 0x8080808080060302ULL, 0x8080808006030200ULL,
+    0x8080808006030201ULL, 0x8080800603020100ULL, 0x8080808080800604ULL,
+    0x8080808080060400ULL, 0x8080808080060401ULL, 0x8080808006040100ULL,
+    0x8080808080060402ULL, 0x8080808006040200ULL, 0x8080808006040201ULL,
+    0x8080800604020100ULL, 0x8080808080060403ULL, 0x8080808006040300ULL,
+    0x8080808006040301ULL, 0x8080800604030100ULL, 0x8080808006040302ULL,
+    0x8080800604030200ULL, 0x8080800604030201ULL, 0x8080060403020100ULL,
+    0x8080808080800605ULL, 0x8080808080060500ULL, 0x8080808080060501ULL,
+    0x8080808006050100ULL, 0x8080808080060502ULL, 0x8080808006050200ULL,
+    0x8080808006050201ULL, 0x8080800605020100ULL, 0x8080808080060503ULL,
+    0x8080808006050300ULL, 0x8080808006050301ULL, 0x8080800605030100ULL,
+    0x8080808006050302ULL, 0x8080800605030200ULL, 0x8080800605030201ULL,
+    0x8080060503020100ULL, 0x8080808080060504ULL, 0x8080808006050400ULL,
+    0x8080808006050401ULL, 0x8080800605040100ULL, 0x8080808006050402ULL,
+    0x8080800605040200ULL, 0x8080800605040201ULL, 0x8080060504020100ULL,
+    0x8080808006050403ULL, 0x8080800605040300ULL, 0x8080800605040301ULL,
+    0x8080060504030100ULL, 0x8080800605040302ULL, 0x8080060504030200ULL,
+    0x8080060504030201ULL, 0x8006050403020100ULL, 0x8080808080808007ULL,
+    0x8080808080800700ULL, 0x8080808080800701ULL, 0x8080808080070100ULL,
+    0x8080808080800702ULL, 0x8080808080070200ULL, 0x8080808080070201ULL,
+    0x8080808007020100ULL, 0x8080808080800703ULL, 0x8080808080070300ULL,
+    0x8080808080070301ULL, 0x8080808007030100ULL, 0x8080808080070302ULL,
+    0x8080808007030200ULL, 0x8080808007030201ULL, 0x8080800703020100ULL,
+    0x8080808080800704ULL, 0x8080808080070400ULL, 0x8080808080070401ULL,
+    0x8080808007040100ULL, 0x8080808080070402ULL, 0x8080808007040200ULL,
+    0x8080808007040201ULL, 0x8080800704020100ULL, 0x8080808080070403ULL,
+    0x8080808007040300ULL, 0x8080808007040301ULL, 0x8080800704030100ULL,
+    0x8080808007040302ULL, 0x8080800704030200ULL, 0x8080800704030201ULL,
+    0x8080070403020100ULL, 0x8080808080800705ULL, 0x8080808080070500ULL,
+    0x8080808080070501ULL, 0x8080808007050100ULL, 0x8080808080070502ULL,
+    0x8080808007050200ULL, 0x8080808007050201ULL, 0x8080800705020100ULL,
+    0x8080808080070503ULL, 0x8080808007050300ULL, 0x8080808007050301ULL,
+    0x8080800705030100ULL, 0x8080808007050302ULL, 0x8080800705030200ULL,
+    0x8080800705030201ULL, 0x8080070503020100ULL, 0x8080808080070504ULL,
+    0x8080808007050400ULL, 0x8080808007050401ULL, 0x8080800705040100ULL,
+    0x8080808007050402ULL, 0x8080800705040200ULL, 0x8080800705040201ULL,
+    0x8080070504020100ULL, 0x8080808007050403ULL, 0x8080800705040300ULL,
+    0x8080800705040301ULL, 0x8080070504030100ULL, 0x8080800705040302ULL,
+    0x8080070504030200ULL, 0x8080070504030201ULL, 0x8007050403020100ULL,
+    0x8080808080800706ULL, 0x8080808080070600ULL, 0x8080808080070601ULL,
+    0x8080808007060100ULL, 0x8080808080070602ULL, 0x8080808007060200ULL,
+    0x8080808007060201ULL, 0x8080800706020100ULL, 0x8080808080070603ULL,
+    0x8080808007060300ULL, 0x8080808007060301ULL, 0x8080800706030100ULL,
+    0x8080808007060302ULL, 0x8080800706030200ULL, 0x8080800706030201ULL,
+    0x8080070603020100ULL, 0x8080808080070604ULL, 0x8080808007060400ULL,
+    0x8080808007060401ULL, 0x8080800706040100ULL, 0x8080808007060402ULL,
+    0x8080800706040200ULL, 0x8080800706040201ULL, 0x8080070604020100ULL,
+    0x8080808007060403ULL, 0x8080800706040300ULL, 0x8080800706040301ULL,
+    0x8080070604030100ULL, 0x8080800706040302ULL, 0x8080070604030200ULL,
+    0x8080070604030201ULL, 0x8007060403020100ULL, 0x8080808080070605ULL,
+    0x8080808007060500ULL, 0x8080808007060501ULL, 0x8080800706050100ULL,
+    0x8080808007060502ULL, 0x8080800706050200ULL, 0x8080800706050201ULL,
+    0x8080070605020100ULL, 0x8080808007060503ULL, 0x8080800706050300ULL,
+    0x8080800706050301ULL, 0x8080070605030100ULL, 0x8080800706050302ULL,
+    0x8080070605030200ULL, 0x8080070605030201ULL, 0x8007060503020100ULL,
+    0x8080808007060504ULL, 0x8080800706050400ULL, 0x8080800706050401ULL,
+    0x8080070605040100ULL, 0x8080800706050402ULL, 0x8080070605040200ULL,
+    0x8080070605040201ULL, 0x8007060504020100ULL, 0x8080800706050403ULL,
+    0x8080070605040300ULL, 0x8080070605040301ULL, 0x8007060504030100ULL,
+    0x8080070605040302ULL, 0x8007060504030200ULL, 0x8007060504030201ULL,
+    0x0706050403020100ULL
+};
+
+__attribute__((target("avx2")))
+static inline uint64_t movemask64_avx2(__m256i lo, __m256i hi){
+    return (uint64_t)(uint32_t)_mm256_movemask_epi8(lo)
+         | (uint64_t)(uint32_t)_mm256_movemask_epi8(hi) << 32;
+}
+
+__attribute__((target("avx2")))
+int normalize_chunk_avx2(stream_t *s, char *src, char *dst, int len){
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    char *out = dst;
+    int   i = 0;
+
+    for (; i+64 <= len; i += 64) {
+        __m256i lo = _mm256_loadu_si256((__m256i *)(src+i));
+        __m256i hi = _mm256_loadu_si256((__m256i *)(src+i+32));
+        __m256i blo = _mm256_or_si256(_mm256_cmpeq_epi8(lo, space), _mm256_cmpeq_epi8(lo, tab));
+        __m256i bhi = _mm256_or_si256(_mm256_cmpeq_epi8(hi, space), _mm256_cmpeq_epi8(hi, tab));
+        norm_masks_t m = normalize_masks(s, movemask64_avx2(blo, bhi),
+                movemask64_avx2(_mm256_cmpeq_epi8(lo, newline), _mm256_cmpeq_epi8(hi, newline)));
+
+        // Any blank that is kept is written as a space
+        lo = _mm256_blendv_epi8(lo, space, blo);
+        hi = _mm256_blendv_epi8(hi, space, bhi);
+
+        if (m.lead_space){
+            *out++ = ' ';
+        }
+        if (m.keep == UINT64_MAX){
+            _mm256_storeu_si256((__m256i *)out, lo);
+            _mm256_storeu_si256((__m256i *)(out+32), hi);
+            out += 64;
+            continue;
+        }
+
+        // Each 8 byte store may write past the kept bytes, but never past
+        // the end of this block, which has already been read
+        char block[64];
+        _mm256_storeu_si256((__m256i *)block, lo);
+        _mm256_storeu_si256((__m256i *)(block+32), hi);
+        for (int g = 0; g < 8; g++) {
+            int keep = (m.keep >> (8*g)) & 0xFF;
+            __m128i bytes = _mm_loadl_epi64((__m128i *)(block+8*g));
+            __m128i idx = _mm_cvtsi64_si128((long long)byte_pack[keep]);
+            _mm_storel_epi64((__m128i *)out, _mm_shuffle_epi8(bytes, idx));
+            out += __builtin_popcount(keep);
+        }
+    }
+
+    out += normalize_chunk_scalar(s, src+i, out, len-i);
+    return out-dst;
+}
+
+/*
+ *  Word counting on masks.  With bit i of word set when byte i is not a
+ *  space, tab or newline, the words that start in a block are
+ *
+ *      word & ~((word << 1) | in_word)
+ *
+ *  where in_word is the top bit of the last block, so a word split across
+ *  two blocks, or two chunks, is counted once.
+ */
+static inline int count_starts(uint64_t word, int *in_word){
+    uint64_t starts = word & ~((word << 1) | (uint64_t)*in_word);
+    *in_word = word >> 63;
+    return __builtin_popcountll(starts);
+}
+
+int count_words_chunk_sse2(char *buff, int len, int *in_word){
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i newline = _mm_set1_epi8('\n');
+    int word_count = 0;
+    int i = 0;
+
+    for (; i+64 <= len; i += 64) {
+        __m128i sep[4];
+        for (int k = 0; k < 4; k++) {
+            __m128i v = _mm_loadu_si128((__m128i *)(buff+i+16*k));
+            sep[k] = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+                                  _mm_cmpeq_epi8(v, newline));
+        }
+        word_count += count_starts(~movemask64_sse2(sep[0], sep[1], sep[2], sep[3]), in_word);
+    }
+
+    return word_count + count_words_chunk(buff+i, len-i, in_word);
+}
+
+__attribute__((target("avx2,popcnt")))
+int count_words_chunk_avx2(char *buff, int len, int *in_word){
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    int word_count = 0;
+    int i = 0;
+
+    for (; i+64 <= len; i += 64) {
+        __m256i lo = _mm256_loadu_si256((__m256i *)(buff+i));
+        __m256i hi = _mm256_loadu_si256((__m256i *)(buff+i+32));
+        __m256i slo = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(lo, space), _mm256_cmpeq_epi8(lo, tab)),
+                                      _mm256_cmpeq_epi8(lo, newline));
+        __m256i shi = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(hi, space), _mm256_cmpeq_epi8(hi, tab)),
+                                      _mm256_cmpeq_epi8(hi, newline));
+        word_count += count_starts(~movemask64_avx2(slo, shi), in_word);
+    }
+
+    return word_count + count_words_chunk(buff+i, len-i, in_word);
+}
+
+/*
+ *  Reversing in place from both ends: one vector is loaded from the front
+ *  and one from the back, each is reversed in its register and they are
+ *  stored at each other's place.  What is left in the middle, less than
+ *  two vectors, is done by the scalar loop.
+ *
+ *  SSE2 has no byte shuffle, so a 16 byte vector is reversed in three
+ *  steps: swap the bytes of each 16 bit word, reverse the words of each
+ *  half, then swap the halves.
+ */
+static inline __m128i reverse16_sse2(__m128i v){
+    v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+    return _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+int reverse_string_sse2(char *buff, int str_len){
+    char *lo = buff;
+    char *hi = buff+str_len;
+
+    while (hi-lo >= 32) {
+        hi -= 16;
+        __m128i front = _mm_loadu_si128((__m128i *)lo);
+        __m128i back = _mm_loadu_si128((__m128i *)hi);
+        _mm_storeu_si128((__m128i *)lo, reverse16_sse2(back));
+        _mm_storeu_si128((__m128i *)hi, reverse16_sse2(front));
+        lo += 16;
+    }
+
+    return reverse_string_scalar(lo, hi-lo);
+}
+
+/*
+ *  AVX2 reverses 32 bytes with vpshufb, which reverses each 16 byte lane,
+ *  and vpermq to swap the lanes.  vpermb would do it in one step but
+ *  needs AVX-512 VBMI.
+ */
+__attribute__((target("avx2")))
+static inline __m256i reverse32_avx2(__m256i v){
+    const __m256i lanes_reversed = _mm256_setr_epi8(
+            15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+            15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    v = _mm256_shuffle_epi8(v, lanes_reversed);
+    return _mm256_permute4x64_epi64(v, _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+__attribute__((target("avx2")))
+int reverse_string_avx2(char *buff, int str_len){
+    char *lo = buff;
+    char *hi = buff+str_len;
+
+    while (hi-lo >= 64) {
+        hi -= 32;
+        __m256i front = _mm256_loadu_si256((__m256i *)lo);
+        __m256i back = _mm256_loadu_si256((__m256i *)hi);
+        _mm256_storeu_si256((__m256i *)lo, reverse32_avx2(back));
+        _mm256_storeu_si256((__m256i *)hi, reverse32_avx2(front));
+        lo += 32;
+    }
+
+    return reverse_string_sse2(lo, hi-lo);
+}
+
+#else
+
+// Not x86, the vector kernels are the scalar one
+int normalize_chunk_sse2(stream_t *s, char *src, char *dst, int len){
+    return normalize_chunk_scalar(s, src, dst, len);
+}
+
+int normalize_chunk_avx2(stream_t *s, char *src, char *dst, int len){
+    return normalize_chunk_scalar(s, src, dst, len);
+}
+
+int count_words_chunk_sse2(char *buff, int len, int *in_word){
+    return count_words_chunk(buff, len, in_word);
+}
+
+int count_words_chunk_avx2(char *buff, int len, int *in_word){
+    return count_words_chunk(buff, len, in_word);
+}
+
+int reverse_string_sse2(char *buff, int str_len){
+    return reverse_string_scalar(buff, str_len);
+}
+
+int reverse_string_avx2(char *buff, int str_len){
+    return reverse_string_scalar(buff, str_len);
+}
+
+#endif
+
+/*
+ *  The widest vector unit this CPU has, or the one named by the
+ *  STRINGFUN_SIMD environment variable (scalar, sse2 or avx2) so each
+ *  kernel can be tested and benchmarked.  Asking for one the CPU lacks
+ *  falls back to the best one it has.  The parallel counters pick their
+ *  kernel from worker threads, so the level is worked out once under
+ *  pthread_once().
+ */
+enum { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+
+static int level = SIMD_SCALAR;
+static pthread_once_t level_once = PTHREAD_ONCE_INIT;
+
+static void simd_detect(void){
+    char *want = getenv(SIMD_ENV);
+#ifdef HAVE_X86_SIMD
+    if (want != NULL && strcmp(want, "scalar") == 0){
+        level = SIMD_SCALAR;
+    } else if ((want == NULL || strcmp(want, "sse2") != 0) && __builtin_cpu_supports("avx2")){
+        level = SIMD_AVX2;
+    } else {
+        level = SIMD_SSE2;
+    }
+#else
+    (void)want;
+    level = SIMD_SCALAR;
+#endif
+}
+
+static int simd_level(void){
+    pthread_once(&level_once, simd_detect);
+    return level;
+}
+
+normalize_fn_t pick_normalizer(void){
+    switch (simd_level()){
+        case SIMD_AVX2:
+            return normalize_chunk_avx2;
+        case SIMD_SSE2:
+            return normalize_chunk_sse2;
+        default:
+            return normalize_chunk_scalar;
+    }
+}
+
+count_fn_t pick_counter(void){
+    switch (simd_level()){
+        case SIMD_AVX2:
+            return count_words_chunk_avx2;
+        case SIMD_SSE2:
+            return count_words_chunk_sse2;
+        default:
+            return count_words_chunk;
+    }
+}
+
+reverse_fn_t pick_reverser(void){
+    switch (simd_level()){
+        case SIMD_AVX2:
+            return reverse_string_avx2;
+        case SIMD_SSE2:
+            return reverse_string_sse2;
+        default:
+            return reverse_string_scalar;
+    }
+}
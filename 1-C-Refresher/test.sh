@@ -97,4 +97,171 @@ Buffer:  [Lets get a lot of words to test...................]" ]
     run ./stringfun -x "This is a super long string for testing my program" program  app
     [ "$output" = "Buffer:  [This is a super long string for testing my app....]" ] || 
     [ "$output" = "Not Implemented!" ]
-}
\ No newline at end of file
+}
+
+@test "stream mode handles words across chunk boundaries" {
+    yes "alpha  beta	gamma   " | head -n 200000 > stream_test.txt
+    run ./stringfun -c -s stream_test.txt
+    [ "$status" -eq 0 ]
+    [ "$output" = "Word Count: 600000" ]
+    run bash -c "./stringfun -w -s < stream_test.txt | tail -n 1"
+    [ "$output" = "Number of words returned: 600000" ]
+    run bash -c "./stringfun -x -s - alpha omega < stream_test.txt | head -n 2"
+    [ "$output" = "omega beta gamma
+alpha beta gamma" ]
+    rm -f stream_test.txt
+}
+
+@test "vector normalizers match the scalar one" {
+    yes "a  b	 	cc   dd
+  	 eee f  ghij	k   " | head -n 50000 > simd_test.txt
+    scalar=$(STRINGFUN_SIMD=scalar ./stringfun -r -s simd_test.txt | cksum)
+    sse2=$(STRINGFUN_SIMD=sse2 ./stringfun -r -s simd_test.txt | cksum)
+    best=$(./stringfun -r -s simd_test.txt | cksum)
+    rm -f simd_test.txt
+    [ "$scalar" = "$sse2" ]
+    [ "$scalar" = "$best" ]
+}
+
+@test "vector word counts match the scalar one" {
+    yes "a  b	 	cc   dd
+  	 eee f  ghij	k   " | head -n 50000 > count_test.txt
+    run env STRINGFUN_SIMD=scalar ./stringfun -c -s count_test.txt
+    [ "$output" = "Word Count: 200000" ]
+    run env STRINGFUN_SIMD=sse2 ./stringfun -c -s count_test.txt
+    [ "$output" = "Word Count: 200000" ]
+    run ./stringfun -c -s count_test.txt
+    [ "$output" = "Word Count: 200000" ]
+    rm -f count_test.txt
+}
+
+@test "parallel word count matches one thread" {
+    yes "alpha  beta	gamma   " | head -n 200000 > parallel_test.txt
+    run ./stringfun -c -s parallel_test.txt -j 4
+    [ "$status" -eq 0 ]
+    [ "$output" = "Word Count: 600000" ]
+    run ./stringfun -c -s parallel_test.txt -j 0
+    [ "$status" -eq 1 ]
+    rm -f parallel_test.txt
+}
+
+@test "mapped and read input give the same output" {
+    yes "a  b	 	cc   dd
+  	 eee f  ghij	k   " | head -n 50000 > mmap_test.txt
+    for op in -c -w -r; do
+        mapped=$(./stringfun $op -s mmap_test.txt | cksum)
+        read=$(STRINGFUN_MMAP=off ./stringfun $op -s mmap_test.txt | cksum)
+        [ "$mapped" = "$read" ]
+    done
+    rm -f mmap_test.txt
+}
+
+@test "replace all in buffer and stream" {
+    run ./stringfun -a "a b a b a b a" a XYZ
+    [ "$status" -eq 0 ]
+    [ "$output" = "Buffer:  [XYZ b XYZ b XYZ b XYZ.............................]" ]
+    yes "alpha  beta	gamma   " | head -n 200000 > replace_test.txt
+    run bash -c "./stringfun -a -s replace_test.txt a 'a longer replacement' | ./stringfun -c -s -"
+    [ "$output" = "Word Count: 2600000" ]
+    rm -f replace_test.txt
+}
+
+@test "search replace pairs file" {
+    printf 'is\tIS\nbad\tgood\nthis\tTHAT\n' > pairs_test.txt
+    run ./stringfun -x "This is a bad test of this" -p pairs_test.txt
+    [ "$status" -eq 0 ]
+    [ "$output" = "Buffer:  [ThIS IS a good test of THAT.......................]" ]
+    run bash -c "printf 'this  is\n a bad\tone\n' | ./stringfun -x -s - -p pairs_test.txt"
+    [ "$output" = "THAT IS
+a good one" ]
+    run ./stringfun -a "use -p here" -p P
+    [ "$output" = "Buffer:  [use P here........................................]" ]
+    run bash -c "./stringfun -x -s test.sh -p pairs_test.txt > /dev/full"
+    [ "$status" -eq 2 ]
+    [ "$output" = "Error streaming test.sh, rc = -2" ]
+    rm -f pairs_test.txt
+}
+
+@test "reverse each word in buffer and stream" {
+    run ./stringfun -v "Reversed sentences  look very weird"
+    [ "$status" -eq 0 ]
+    [ "$output" = "Buffer:  [desreveR secnetnes kool yrev driew................]" ]
+    head -c 3000000 /dev/zero | tr '\0' 'x' > reverse_test.txt
+    yes "ab  cde	fghi" | head -n 300000 >> reverse_test.txt
+    words=$(./stringfun -v -s reverse_test.txt | ./stringfun -v -s - | cksum)
+    whole=$(./stringfun -r -s reverse_test.txt | ./stringfun -r -s - | cksum)
+    [ "$words" = "$whole" ]
+    rm -f reverse_test.txt
+}
+
+@test "word print of a word longer than the output buffer" {
+    run bash -c "{ head -c 100000 /dev/zero | tr '\0' 'x'; echo ' b'; } | ./stringfun -w -s - | tail -n 4 | sed 's/xx*/x/'"
+    [ "$status" -eq 0 ]
+    [ "$output" = "1. x(100000)
+2. b(1)
+
+Number of words returned: 2" ]
+}
+
+@test "top word frequencies in buffer and stream" {
+    run ./stringfun -f "the cat and the dog and the bird" 2
+    [ "$status" -eq 0 ]
+    [ "$output" = "Word Frequency
+--------------
+1. the (3)
+2. and (2)
+
+Distinct words: 5
+Buffer:  [the cat and the dog and the bird..................]" ]
+    { head -c 3000000 /dev/zero | tr '\0' 'x'; yes " c	a
+b a" | head -n 100000; } > freq_test.txt
+    run bash -c "cat freq_test.txt | ./stringfun -f -s - 3"
+    [ "$output" = "Word Frequency
+--------------
+1. a (100000)
+2. b (50000)
+3. c (50000)
+
+Distinct words: 4" ]
+    [ "$(./stringfun -f -s freq_test.txt 4 | awk 'NR == 6 {print $1, length($2), $3}')" = "4. 3000000 (1)" ]
+
+    # asking for more words than there are prints them all, none is an error
+    run ./stringfun -f -s freq_test.txt 2000000000
+    [ "$status" -eq 0 ]
+    [ "${lines[6]}" = "Distinct words: 4" ]
+    run ./stringfun -f -s freq_test.txt 0
+    [ "$status" -eq 1 ]
+    run ./stringfun -f "the cat" -3
+    [ "$status" -eq 1 ]
+    run ./stringfun -f "the cat" 2x
+    [ "$status" -eq 1 ]
+    rm -f freq_test.txt
+}
+
+@test "stream modes fail when the output can not be written" {
+    run bash -c "./stringfun -x -s test.sh test exam > /dev/full"
+    [ "$status" -eq 2 ]
+    [ "$output" = "Error streaming test.sh, rc = -2" ]
+    run bash -c "./stringfun -a -s test.sh test exam > /dev/full"
+    [ "$status" -eq 2 ]
+    run bash -c "./stringfun -v -s test.sh > /dev/full"
+    [ "$status" -eq 2 ]
+    [ "$output" = "Error streaming test.sh, rc = -2" ]
+}
+
+@test "stream replace with a blank at the chunk boundary" {
+    { head -c 1048575 /dev/zero | tr '\0' 'a'; printf ' '; head -c 1048576 /dev/zero | tr '\0' 'b'; echo; } > boundary_test.txt
+    [ "$(./stringfun -x -s boundary_test.txt "a b" X | cksum)" = "$(sed 's/a b/X/' boundary_test.txt | cksum)" ]
+    printf 'a b\tX\n' > pairs_test.txt
+    [ "$(./stringfun -x -s boundary_test.txt -p pairs_test.txt | cksum)" = "$(sed 's/a b/X/' boundary_test.txt | cksum)" ]
+    rm -f pairs_test.txt
+    rm -f boundary_test.txt
+}
+
+@test "buffer word count and word print agree on tabs and newlines" {
+    run ./stringfun -c $'one\ntwo\tthree'
+    [ "${lines[0]}" = "Word Count: 3" ]
+    run ./stringfun -w $'one\ntwo\tthree'
+    [ "${lines[5]}" = "Number of words returned: 3" ]
+    [ "${lines[3]}" = "2. two(3)" ]
+}
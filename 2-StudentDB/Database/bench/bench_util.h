@@ -0,0 +1,62 @@
+/*
+ *  bench_util.h
+ *
+ *  Timing, sorting and database setup shared by the benchmarks in this
+ *  directory.
+ */
+#ifndef __BENCH_UTIL_H__
+    #define __BENCH_UTIL_H__
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../db.h"
+#include "../sdbsc.h"
+
+static inline double now_ms(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static inline double now_us(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+//qsort() order for latencies
+static inline int cmp_double(const void *a, const void *b){
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+//write records 1..n in large chunks so setup is not what we measure
+static inline int build_db(int fd, int n){
+    student_t chunk[RECORDS_PER_PAGE * 16];
+    int id = 0;
+    while (id <= n) {
+        int cnt = 0;
+        for (; cnt < (int)(sizeof(chunk) / sizeof(chunk[0])) && id <= n; cnt++, id++) {
+            memset(&chunk[cnt], 0, sizeof(student_t));
+            if (id == 0) {
+                continue;
+            }
+            chunk[cnt].id = id;
+            snprintf(chunk[cnt].fname, sizeof(chunk[cnt].fname), "first%d", id);
+            snprintf(chunk[cnt].lname, sizeof(chunk[cnt].lname), "last%d", id % 97);
+            chunk[cnt].gpa = id % (MAX_STD_GPA + 1);
+        }
+        off_t off = (off_t)(id - cnt) * STUDENT_RECORD_SIZE;
+        ssize_t len = cnt * STUDENT_RECORD_SIZE;
+        if (pwrite(fd, chunk, len, off) != len) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ *  engine_bench.c
+ *
+ *  Runs the same workload against every storage engine in sdb_engines[]
+ *  so they can be compared like for like.  Each engine gets a fresh
+ *  database in a scratch directory and goes through the steps below, all
+ *  but the shm engine, which only works against a daemon:
+ *
+ *      add     every id from 1 to records, in order
+ *      get     records lookups of random ids
+ *      scan    count_db_records() over the whole database
+ *      del     half of the ids, in random order
+ *
+ *  The database functions print a line per operation, so stdout is sent to
+ *  /dev/null while they run and results go to the original stdout as one
+ *  JSON object per engine and operation.
+ *
+ *  usage:  engine_bench [records]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#include "../db.h"
+#include "../sdbsc.h"
+#include "bench_util.h"
+
+#define BENCH_DB_FILE   "engine_bench.db"
+#define DEFAULT_RECORDS 10000
+#define SCAN_REPEATS    10
+
+static FILE *results;
+
+static void report(const char *engine, const char *op, int ops, double ms){
+    fprintf(results, "{\"bench\":\"engine\",\"engine\":\"%s\",\"op\":\"%s\","
+            "\"ops\":%d,\"ms\":%.3f,\"ops_per_sec\":%.0f}\n",
+            engine, op, ops, ms, (ms > 0) ? ops / (ms / 1000.0) : 0.0);
+    fflush(results);
+}
+
+//same shuffled id order for every engine
+static void shuffle(int *ids, int n){
+    srand(283);
+    for (int i = n - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int t = ids[i];
+        ids[i] = ids[j];
+        ids[j] = t;
+    }
+}
+
+static int run_engine(const sdb_engine_t *engine, int *ids, int records){
+    sdb_t db;
+    student_t s;
+    double start;
+
+    set_engine((char *)engine->name);
+    if (open_db(&db, BENCH_DB_FILE, true) != NO_ERROR) {
+        return EXIT_FAIL_DB;
+    }
+
+    start = now_ms();
+    for (int id = 1; id <= records; id++) {
+        add_student(&db, id, "bench", "student", id % (MAX_STD_GPA + 1));
+    }
+    report(engine->name, "add", records, now_ms() - start);
+
+    start = now_ms();
+    for (int i = 0; i < records; i++) {
+        get_student(&db, ids[i], &s);
+    }
+    report(engine->name, "get", records, now_ms() - start);
+
+    start = now_ms();
+    for (int i = 0; i < SCAN_REPEATS; i++) {
+        count_db_records(&db, NULL);
+    }
+    report(engine->name, "scan", SCAN_REPEATS * records, now_ms() - start);
+
+    start = now_ms();
+    for (int i = 0; i < records / 2; i++) {
+        del_student(&db, ids[i]);
+    }
+    report(engine->name, "del", records / 2, now_ms() - start);
+
+    // engines with their own layout leave more than BENCH_DB_FILE behind
+    if (engine->files != NULL) {
+        char name[PATH_MAX];
+        bool keep;
+        for (int i = 0; engine->files(&db, i, name, sizeof(name), &keep) == NO_ERROR; i++) {
+            unlink(name);
+        }
+    }
+    close_db(&db);
+    return EXIT_OK;
+}
+
+int main(int argc, char *argv[]){
+    int records = (argc > 1) ? atoi(argv[1]) : DEFAULT_RECORDS;
+    if (records < 1 || records > MAX_STD_ID) {
+        fprintf(stderr, "records must be between %d and %d\n", MIN_STD_ID, MAX_STD_ID);
+        return EXIT_FAIL_ARGS;
+    }
+
+    // Work in a scratch directory so the change feed and database files
+    // never land next to a real student.db
+    char dir[] = "/tmp/sdb_bench.XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) == -1) {
+        perror("mkdtemp");
+        return EXIT_FAIL_DB;
+    }
+
+    int *ids = malloc(records * sizeof(int));
+    if (ids == NULL) {
+        return EXIT_FAIL_DB;
+    }
+    for (int i = 0; i < records; i++) {
+        ids[i] = i + 1;
+    }
+    shuffle(ids, records);
+
+    results = fdopen(dup(STDOUT_FILENO), "w");
+    freopen("/dev/null", "w", stdout);
+
+    int rc = EXIT_OK;
+    for (int e = 0; sdb_engines[e] != NULL && rc == EXIT_OK; e++) {
+        // shm needs a running daemon, shm_bench measures it
+        if (sdb_engines[e] == &shm_engine) {
+            continue;
+        }
+        rc = run_engine(sdb_engines[e], ids, records);
+        unlink(BENCH_DB_FILE);
+        unlink(BENCH_DB_FILE CDC_EXT);
+    }
+
+    rmdir(dir);
+    free(ids);
+    return rc;
+}
@@ -0,0 +1,98 @@
+/*
+ *  ra_bench.c
+ *
+ *  Latency of get_student() walking up the ids on a cold page cache, with
+ *  the file engine's read ahead (see file_readahead() in sdbsc.c) off and
+ *  on.  A dense database is written once, then for every stride and mode
+ *  it is evicted from the page cache and read back with one get per id,
+ *  visiting every stride'th id in ascending order.
+ *
+ *  Prints one JSON object per stride and mode:
+ *
+ *      {"bench":"readahead","readahead":"on","stride":1,"gets":100000,
+ *       "ms":...,"p50_us":...,"p99_us":...,"max_us":...}
+ *
+ *  Eviction uses POSIX_FADV_DONTNEED, which file systems such as tmpfs
+ *  ignore, so run it from a directory on a real disk.
+ *
+ *  usage:  ra_bench [records]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#include "../db.h"
+#include "../sdbsc.h"
+#include "bench_util.h"
+
+#define BENCH_DB_FILE   "ra_bench.db"
+#define DEFAULT_RECORDS MAX_STD_ID
+
+static const int STRIDES[] = {1, 8, 64};
+#define N_STRIDES (int)(sizeof(STRIDES) / sizeof(STRIDES[0]))
+
+static int run_walk(int records, int stride, bool readahead, double *lat){
+    sdb_t db;
+    student_t s;
+
+    setenv(READAHEAD_ENV, readahead ? "on" : "off", 1);
+    if (open_db(&db, BENCH_DB_FILE, false) != NO_ERROR) {
+        return EXIT_FAIL_DB;
+    }
+    posix_fadvise(db.fd, 0, 0, POSIX_FADV_DONTNEED);
+
+    int n = 0;
+    double start = now_us();
+    for (int id = MIN_STD_ID; id <= records; id += stride) {
+        double t = now_us();
+        get_student(&db, id, &s);
+        lat[n++] = now_us() - t;
+    }
+    double total = now_us() - start;
+    close_db(&db);
+
+    qsort(lat, n, sizeof(double), cmp_double);
+    printf("{\"bench\":\"readahead\",\"readahead\":\"%s\",\"stride\":%d,"
+           "\"gets\":%d,\"ms\":%.3f,\"p50_us\":%.2f,\"p99_us\":%.2f,"
+           "\"max_us\":%.2f}\n",
+           readahead ? "on" : "off", stride, n, total / 1000.0,
+           lat[(n - 1) / 2], lat[(int)((n - 1) * 0.99)], lat[n - 1]);
+    return EXIT_OK;
+}
+
+int main(int argc, char *argv[]){
+    int records = (argc > 1) ? atoi(argv[1]) : DEFAULT_RECORDS;
+    if (records < 1 || records > MAX_STD_ID) {
+        fprintf(stderr, "records must be between %d and %d\n", MIN_STD_ID, MAX_STD_ID);
+        return EXIT_FAIL_ARGS;
+    }
+
+    sdb_t db;
+    set_engine("file");
+    if (open_db(&db, BENCH_DB_FILE, true) != NO_ERROR || build_db(db.fd, records) != 0 ||
+        fsync(db.fd) != 0) {
+        perror(BENCH_DB_FILE);
+        return EXIT_FAIL_DB;
+    }
+    close_db(&db);
+
+    double *lat = malloc(records * sizeof(double));
+    if (lat == NULL) {
+        return EXIT_FAIL_DB;
+    }
+
+    int rc = EXIT_OK;
+    for (int i = 0; i < N_STRIDES && rc == EXIT_OK; i++) {
+        rc = run_walk(records, STRIDES[i], false, lat);
+        if (rc == EXIT_OK) {
+            rc = run_walk(records, STRIDES[i], true, lat);
+        }
+    }
+
+    free(lat);
+    unlink(BENCH_DB_FILE);
+    return rc;
+}
@@ -0,0 +1,218 @@
+/*
+ *  sdb_bench.c
+ *
+ *  Regression benchmark for the student database.  Drives the functions in
+ *  sdbsc.c directly, so no process is started per operation, and times
+ *  every call to report throughput and latency percentiles.
+ *
+ *  Each run starts from an empty database and goes through:
+ *
+ *      add      every id of the run
+ *      get      every id of the run
+ *      count    count_db_records(), SCAN_REPEATS times
+ *      print    print_db(), SCAN_REPEATS times
+ *      del      every other id of the run
+ *      compact  compress_db() once, on the half empty database
+ *
+ *  Runs cover RECORD_COUNTS records, laid out dense (ids 1..n) or sparse
+ *  (ids spread evenly over the whole id range), with the ids visited in
+ *  sequential or random order.  Sparse layouts that would not leave any
+ *  gaps are skipped.  The engine comes from SDB_ENGINE like in sdbsc, and
+ *  SDB_STATS adds the per operation system call report at exit.
+ *
+ *  Output is one JSON object per run and operation:
+ *
+ *      {"bench":"sdb","engine":"file","records":1000,"layout":"dense",
+ *       "order":"random","op":"get","ops":1000,"ops_per_sec":...,
+ *       "p50_us":...,"p99_us":...}
+ *
+ *  usage:  sdb_bench [max_records]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#include "../db.h"
+#include "../sdbsc.h"
+#include "bench_util.h"
+
+#define BENCH_DB_FILE   "sdb_bench.db"
+#define SCAN_REPEATS    5
+
+static const int RECORD_COUNTS[] = {1000, 10000, 100000};
+#define N_RECORD_COUNTS (int)(sizeof(RECORD_COUNTS) / sizeof(RECORD_COUNTS[0]))
+
+//what a single run looks like, printed with every result
+typedef struct bench_run {
+    const char *engine;
+    int records;
+    const char *layout;
+    const char *order;
+} bench_run_t;
+
+static FILE *results;
+static double *lat;         //per call latency in microseconds
+
+//sorts lat[0..n) and prints throughput and percentiles for one operation
+static void report(bench_run_t *run, const char *op, int n, double total_us){
+    qsort(lat, n, sizeof(double), cmp_double);
+    double p50 = lat[(n - 1) / 2];
+    double p99 = lat[(int)((n - 1) * 0.99)];
+
+    fprintf(results, "{\"bench\":\"sdb\",\"engine\":\"%s\",\"records\":%d,"
+            "\"layout\":\"%s\",\"order\":\"%s\",\"op\":\"%s\",\"ops\":%d,"
+            "\"ops_per_sec\":%.0f,\"p50_us\":%.2f,\"p99_us\":%.2f}\n",
+            run->engine, run->records, run->layout, run->order, op, n,
+            (total_us > 0) ? n / (total_us / 1000000.0) : 0.0, p50, p99);
+    fflush(results);
+}
+
+//ids of a run in visiting order, same sequence for every engine
+static void make_ids(int *ids, int n, bool sparse, bool random){
+    int stride = sparse ? MAX_STD_ID / n : 1;
+    for (int i = 0; i < n; i++) {
+        ids[i] = MIN_STD_ID + i * stride;
+    }
+
+    if (!random) {
+        return;
+    }
+    srand(283 + n);
+    for (int i = n - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int t = ids[i];
+        ids[i] = ids[j];
+        ids[j] = t;
+    }
+}
+
+static int run_bench(bench_run_t *run, int *ids){
+    sdb_t db;
+    student_t s;
+    double start, t;
+    int n = run->records;
+
+    if (open_db(&db, BENCH_DB_FILE, true) != NO_ERROR) {
+        return EXIT_FAIL_DB;
+    }
+
+    start = now_us();
+    for (int i = 0; i < n; i++) {
+        t = now_us();
+        add_student(&db, ids[i], "bench", "student", ids[i] % (MAX_STD_GPA + 1));
+        lat[i] = now_us() - t;
+    }
+    report(run, "add", n, now_us() - start);
+
+    start = now_us();
+    for (int i = 0; i < n; i++) {
+        t = now_us();
+        get_student(&db, ids[i], &s);
+        lat[i] = now_us() - t;
+    }
+    report(run, "get", n, now_us() - start);
+
+    start = now_us();
+    for (int i = 0; i < SCAN_REPEATS; i++) {
+        t = now_us();
+        count_db_records(&db, NULL);
+        lat[i] = now_us() - t;
+    }
+    report(run, "count", SCAN_REPEATS, now_us() - start);
+
+    start = now_us();
+    for (int i = 0; i < SCAN_REPEATS; i++) {
+        t = now_us();
+        print_db(&db, NULL);
+        lat[i] = now_us() - t;
+    }
+    report(run, "print", SCAN_REPEATS, now_us() - start);
+
+    start = now_us();
+    for (int i = 0; i < n; i += 2) {
+        t = now_us();
+        del_student(&db, ids[i]);
+        lat[i / 2] = now_us() - t;
+    }
+    report(run, "del", (n + 1) / 2, now_us() - start);
+
+    t = now_us();
+    int rc = compress_db(&db);
+    lat[0] = now_us() - t;
+    report(run, "compact", 1, lat[0]);
+
+    close_db(&db);
+    unlink(BENCH_DB_FILE);
+    unlink(BENCH_DB_FILE CDC_EXT);
+    return (rc == NO_ERROR) ? EXIT_OK : EXIT_FAIL_DB;
+}
+
+int main(int argc, char *argv[]){
+    int max_records = (argc > 1) ? atoi(argv[1]) : MAX_STD_ID;
+    char *engine = getenv(ENGINE_ENV);
+
+    if (max_records < 1) {
+        fprintf(stderr, "max_records must be at least 1\n");
+        return EXIT_FAIL_ARGS;
+    }
+    if (engine != NULL && set_engine(engine) != NO_ERROR) {
+        fprintf(stderr, M_ERR_ENGINE, engine);
+        return EXIT_FAIL_ARGS;
+    }
+    if (stats_init(getenv(STATS_ENV)) != NO_ERROR) {
+        return EXIT_FAIL_ARGS;
+    }
+
+    // Work in a scratch directory so the change feed and database files
+    // never land next to a real student.db
+    char dir[] = "/tmp/sdb_bench.XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) == -1) {
+        perror("mkdtemp");
+        return EXIT_FAIL_DB;
+    }
+
+    int *ids = malloc(MAX_STD_ID * sizeof(int));
+    lat = malloc(MAX_STD_ID * sizeof(double));
+    if (ids == NULL || lat == NULL) {
+        return EXIT_FAIL_DB;
+    }
+
+    // The database functions print a line per call, results go to the
+    // original stdout and everything else to /dev/null
+    results = fdopen(dup(STDOUT_FILENO), "w");
+    freopen("/dev/null", "w", stdout);
+
+    int rc = EXIT_OK;
+    for (int c = 0; c < N_RECORD_COUNTS && rc == EXIT_OK; c++) {
+        int n = RECORD_COUNTS[c];
+        if (n > max_records || n > MAX_STD_ID) {
+            continue;
+        }
+
+        for (int layout = 0; layout < 2 && rc == EXIT_OK; layout++) {
+            bool sparse = (layout == 1);
+            if (sparse && MAX_STD_ID / n < 2) {
+                continue;
+            }
+
+            for (int order = 0; order < 2 && rc == EXIT_OK; order++) {
+                bench_run_t run = {
+                    .engine = engine ? engine : "file",
+                    .records = n,
+                    .layout = sparse ? "sparse" : "dense",
+                    .order = order ? "random" : "sequential",
+                };
+                make_ids(ids, n, sparse, order == 1);
+                rc = run_bench(&run, ids);
+            }
+        }
+    }
+
+    rmdir(dir);
+    free(lat);
+    free(ids);
+    return rc;
+}
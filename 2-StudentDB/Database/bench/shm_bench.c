@@ -0,0 +1,142 @@
+/*
+ *  shm_bench.c
+ *
+ *  Read scaling of the shm engine against the file engine.  A database of
+ *  records students is written, a daemon (see serve_db() in sdb_shm.c) is
+ *  started for it in a child process, then for 1, 2, 4 ... readers up to
+ *  the number of CPUs each reader process opens the database and does
+ *  GETS_PER_READER random get_student() calls.  The aggregate rate shows
+ *  how close each engine gets to doubling with every doubling of readers.
+ *
+ *  Prints one JSON object per engine and reader count:
+ *
+ *      {"bench":"shm","engine":"shm","readers":4,"gets":800000,
+ *       "ms":...,"gets_per_sec":...}
+ *
+ *  usage:  shm_bench [records]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "../db.h"
+#include "../sdbsc.h"
+#include "bench_util.h"
+
+#define BENCH_DB_FILE   "shm_bench.db"
+#define DEFAULT_RECORDS MAX_STD_ID
+#define GETS_PER_READER 200000
+
+//one reader process, exits non zero if a get fails
+static void reader(int records, unsigned int seed){
+    sdb_t db;
+    student_t s;
+    if (open_db(&db, BENCH_DB_FILE, false) != NO_ERROR) {
+        exit(EXIT_FAIL_DB);
+    }
+
+    for (int i = 0; i < GETS_PER_READER; i++) {
+        int id = MIN_STD_ID + rand_r(&seed) % records;
+        if (get_student(&db, id, &s) != NO_ERROR) {
+            exit(EXIT_FAIL_DB);
+        }
+    }
+    close_db(&db);
+    exit(EXIT_OK);
+}
+
+static int run_readers(const char *engine, int records, int n_readers){
+    set_engine((char *)engine);
+
+    // Every reader is started before the clock so fork() is not measured,
+    // they wait on the pipe until all of them are ready
+    int go[2];
+    if (pipe(go) == -1) {
+        return EXIT_FAIL_DB;
+    }
+    for (int r = 0; r < n_readers; r++) {
+        if (fork() == 0) {
+            char c;
+            close(go[1]);
+            if (read(go[0], &c, 1) != 0) {
+                exit(EXIT_FAIL_DB);
+            }
+            reader(records, 283 + r);
+        }
+    }
+    close(go[0]);
+
+    double start = now_ms();
+    close(go[1]);
+    int failed = 0;
+    for (int r = 0; r < n_readers; r++) {
+        int status;
+        if (wait(&status) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_OK) {
+            failed++;
+        }
+    }
+    double ms = now_ms() - start;
+
+    long gets = (long)n_readers * GETS_PER_READER;
+    printf("{\"bench\":\"shm\",\"engine\":\"%s\",\"readers\":%d,\"gets\":%ld,"
+           "\"ms\":%.3f,\"gets_per_sec\":%.0f}\n",
+           engine, n_readers, gets, ms, gets / (ms / 1000.0));
+    fflush(stdout);
+    return failed ? EXIT_FAIL_DB : EXIT_OK;
+}
+
+int main(int argc, char *argv[]){
+    int records = (argc > 1) ? atoi(argv[1]) : DEFAULT_RECORDS;
+    if (records < 1 || records > MAX_STD_ID) {
+        fprintf(stderr, "records must be between %d and %d\n", MIN_STD_ID, MAX_STD_ID);
+        return EXIT_FAIL_ARGS;
+    }
+
+    int fd = open(BENCH_DB_FILE, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd == -1 || build_db(fd, records) != 0) {
+        perror(BENCH_DB_FILE);
+        return EXIT_FAIL_DB;
+    }
+    close(fd);
+
+    // The daemon prints one line once clients can connect, wait for it
+    int ready[2];
+    if (pipe(ready) == -1) {
+        return EXIT_FAIL_DB;
+    }
+    fflush(stdout);
+    pid_t daemon = fork();
+    if (daemon == 0) {
+        close(ready[0]);
+        dup2(ready[1], STDOUT_FILENO);
+        exit((serve_db(BENCH_DB_FILE) == NO_ERROR) ? EXIT_OK : EXIT_FAIL_DB);
+    }
+    close(ready[1]);
+    char line[256];
+    ssize_t n = read(ready[0], line, sizeof(line));
+    close(ready[0]);
+    if (n <= 0 || strncmp(line, "Serving", 7) != 0) {
+        fprintf(stderr, "daemon did not start\n");
+        unlink(BENCH_DB_FILE);
+        return EXIT_FAIL_DB;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *engines[] = { "file", "shm" };
+    int rc = EXIT_OK;
+    for (int e = 0; e < 2 && rc == EXIT_OK; e++) {
+        for (int n = 1; n <= cpus && rc == EXIT_OK; n *= 2) {
+            rc = run_readers(engines[e], records, n);
+        }
+    }
+
+    kill(daemon, SIGTERM);
+    waitpid(daemon, NULL, 0);
+    unlink(BENCH_DB_FILE);
+    return rc;
+}
@@ -31,5 +31,8 @@ static const int DELETED_STUDENT_ID = 0;
 
 #define DB_FILE     "student.db"            //name of database file
 #define TMP_DB_FILE ".tmp_student.db"       //for extra credit
+#define CDC_EXT     ".cdc"                  //change feed, next to the database, see cdc_emit()
+#define SNAP_LOG_EXT  ".snaplog"            //before images during a snapshot, next to the database
+#define SNAP_TMP_EXT  ".tmp"                //snapshot is written here, then renamed
 
 #endif
\ No newline at end of file
@@ -0,0 +1,466 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+//database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  block engine
+ *
+ *  For archived databases that are mostly read.  Students are grouped in
+ *  blocks of BLK_RECORDS ids, the same 4K a page of student.db holds, and
+ *  every block is stored compressed with the small LZ codec below:
+ *
+ *      <db>.bix   block index, blk_index_t for block B at offset B * 16,
+ *                 an all zero entry is a block with no students
+ *      <db>.blk   compressed blocks, wherever the index says
+ *
+ *  get reads one index entry and the one block it needs, and keeps the
+ *  last block it decompressed so runs of lookups in the same block only
+ *  cost the index read.  scan walks the index in id order and reads the
+ *  block file through a SCAN_BUFFER_SZ window, so a database that was
+ *  written in order streams in large sequential reads.
+ *
+ *  Changing a student decompresses its block, patches it and compresses
+ *  it again.  The new block is always appended and only then does the
+ *  index entry move to it, so a reader or a failed write never sees a
+ *  block that is half overwritten.  The old copy is left unused until
+ *  compress_db() rewrites the files.  put_many writes a whole block once
+ *  for every block it touches, so bulk loads and compaction pack the
+ *  blocks tightly.
+ */
+#define BLK_RECORDS         64
+#define BLK_RAW_SIZE        (BLK_RECORDS * (int)sizeof(student_t))
+#define BLK_MAX_SIZE        (BLK_RAW_SIZE + BLK_RAW_SIZE / 255 + 16)
+#define BLK_INDEX_EXT       ".bix"
+#define BLK_DATA_EXT        ".blk"
+
+#define BLK_FLAG_RAW        1   //stored as is, compressing made it bigger
+
+typedef struct blk_index {
+    long long offset;           //where the block starts in the block file
+    unsigned short len;         //compressed size, 0 for an empty block
+    unsigned short cap;         //bytes used at offset, the same as len
+    unsigned short flags;
+    unsigned short gen;         //bumped on every write, keeps caches honest
+} blk_index_t;
+
+typedef struct blk_state {
+    int data_fd;
+    int cached;                 //block held in raw, -1 if none
+    blk_index_t cached_ix;      //index entry raw was decompressed from
+    char raw[BLK_RAW_SIZE];
+    char packed[BLK_MAX_SIZE];
+} blk_state_t;
+
+/*
+ *  lz_compress / lz_decompress
+ *
+ *  A byte oriented LZ77 codec in the style of LZ4.  The input is a list
+ *  of sequences, each one a token byte whose high nibble is the number of
+ *  literal bytes and low nibble the match length minus LZ_MIN_MATCH,
+ *  followed by the literals, a 2 byte little endian match offset, and
+ *  then more length bytes for either nibble that was 15.  The last
+ *  sequence only has literals.  Zero padding and repeated names make up
+ *  most of a student block, which matches of up to 64K back cover well.
+ */
+#define LZ_MIN_MATCH        4
+#define LZ_HASH_BITS        12
+#define LZ_MAX_OFFSET       65535
+
+static unsigned int lz_read32(const unsigned char *p){
+    unsigned int v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static unsigned char *lz_put_len(unsigned char *op, int len){
+    for (; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = len;
+    return op;
+}
+
+static unsigned char *lz_sequence(unsigned char *op, const unsigned char *lit,
+                                  int lit_len, int offset, int match_len){
+    unsigned char *token = op++;
+    int m = match_len - LZ_MIN_MATCH;
+
+    *token = (lit_len < 15 ? lit_len : 15) << 4;
+    if (lit_len >= 15)
+        op = lz_put_len(op, lit_len - 15);
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+
+    if (match_len == 0)
+        return op;
+
+    *op++ = offset & 0xff;
+    *op++ = offset >> 8;
+    *token |= (m < 15 ? m : 15);
+    if (m >= 15)
+        op = lz_put_len(op, m - 15);
+    return op;
+}
+
+//returns the compressed size, out must hold BLK_MAX_SIZE bytes
+static int lz_compress(const unsigned char *in, int n, unsigned char *out){
+    int table[1 << LZ_HASH_BITS];
+    unsigned char *op = out;
+    int anchor = 0;
+    int ip = 0;
+
+    for (int i = 0; i < (1 << LZ_HASH_BITS); i++)
+        table[i] = -1;
+
+    while (ip + LZ_MIN_MATCH <= n) {
+        unsigned int seq = lz_read32(in + ip);
+        unsigned int h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+        int ref = table[h];
+        table[h] = ip;
+
+        if (ref < 0 || ip - ref > LZ_MAX_OFFSET || lz_read32(in + ref) != seq) {
+            ip++;
+            continue;
+        }
+
+        int len = LZ_MIN_MATCH;
+        while (ip + len < n && in[ref + len] == in[ip + len])
+            len++;
+
+        op = lz_sequence(op, in + anchor, ip - anchor, ip - ref, len);
+        ip += len;
+        anchor = ip;
+    }
+
+    op = lz_sequence(op, in + anchor, n - anchor, 0, 0);
+    return op - out;
+}
+
+//returns the decompressed size, or -1 if the input is damaged
+static int lz_decompress(const unsigned char *in, int n, unsigned char *out, int cap){
+    const unsigned char *ip = in;
+    const unsigned char *end = in + n;
+    unsigned char *op = out;
+
+    while (ip < end) {
+        int token = *ip++;
+        int lit_len = token >> 4;
+        if (lit_len == 15) {
+            int b;
+            do {
+                if (ip >= end)
+                    return -1;
+                b = *ip++;
+                lit_len += b;
+            } while (b == 255);
+        }
+        if (lit_len > end - ip || lit_len > out + cap - op)
+            return -1;
+        memcpy(op, ip, lit_len);
+        op += lit_len;
+        ip += lit_len;
+
+        if (ip >= end)
+            break;
+
+        if (end - ip < 2)
+            return -1;
+        int offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        int len = (token & 15) + LZ_MIN_MATCH;
+        if ((token & 15) == 15) {
+            int b;
+            do {
+                if (ip >= end)
+                    return -1;
+                b = *ip++;
+                len += b;
+            } while (b == 255);
+        }
+        if (offset == 0 || offset > op - out || len > out + cap - op)
+            return -1;
+
+        // Byte by byte, a match may overlap the bytes it produces
+        const unsigned char *match = op - offset;
+        while (len-- > 0)
+            *op++ = *match++;
+    }
+
+    return op - out;
+}
+
+static int blk_read_index(sdb_t *db, int block, blk_index_t *ix){
+    ssize_t n = sdb_pread(db->fd, ix, sizeof(*ix), (off_t)block * sizeof(*ix));
+    if (n < 0)
+        return ERR_DB_FILE;
+    if (n < (ssize_t)sizeof(*ix))
+        memset(ix, 0, sizeof(*ix));
+    return NO_ERROR;
+}
+
+//decompresses the block ix points at from packed into raw
+static int blk_unpack(blk_state_t *bs, blk_index_t *ix, const char *packed){
+    if (ix->flags & BLK_FLAG_RAW) {
+        if (ix->len != BLK_RAW_SIZE)
+            return ERR_DB_FILE;
+        memcpy(bs->raw, packed, BLK_RAW_SIZE);
+    } else if (lz_decompress((const unsigned char *)packed, ix->len,
+                             (unsigned char *)bs->raw, BLK_RAW_SIZE) != BLK_RAW_SIZE) {
+        return ERR_DB_FILE;
+    }
+    return NO_ERROR;
+}
+
+//makes bs->raw hold block, all zeros for an empty block
+static int blk_load(sdb_t *db, int block){
+    blk_state_t *bs = db->state;
+    blk_index_t ix;
+
+    if (blk_read_index(db, block, &ix) != NO_ERROR)
+        return ERR_DB_FILE;
+    if (bs->cached == block && memcmp(&ix, &bs->cached_ix, sizeof(ix)) == 0)
+        return NO_ERROR;
+
+    bs->cached = -1;
+    if (ix.len == 0) {
+        memset(bs->raw, 0, BLK_RAW_SIZE);
+    } else if (ix.len > BLK_MAX_SIZE ||
+               sdb_pread(bs->data_fd, bs->packed, ix.len, ix.offset) != ix.len ||
+               blk_unpack(bs, &ix, bs->packed) != NO_ERROR) {
+        return ERR_DB_FILE;
+    }
+
+    bs->cached = block;
+    bs->cached_ix = ix;
+    return NO_ERROR;
+}
+
+/*
+ *  blk_store
+ *
+ *  Compresses bs->raw and appends it to the block file, then points the
+ *  index entry for block at it.  The caller holds db_lock().
+ */
+static int blk_store(sdb_t *db, int block){
+    blk_state_t *bs = db->state;
+    blk_index_t old, ix = {0};
+
+    if (blk_read_index(db, block, &old) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    bool empty = true;
+    for (int i = 0; i < BLK_RAW_SIZE && empty; i += sizeof(student_t))
+        empty = ((student_t *)(bs->raw + i))->id == DELETED_STUDENT_ID;
+
+    const char *packed = bs->packed;
+    ix.gen = old.gen + 1;
+    if (!empty) {
+        ix.len = lz_compress((unsigned char *)bs->raw, BLK_RAW_SIZE,
+                             (unsigned char *)bs->packed);
+        if (ix.len >= BLK_RAW_SIZE) {
+            ix.len = BLK_RAW_SIZE;
+            ix.flags = BLK_FLAG_RAW;
+            packed = bs->raw;
+        }
+
+        // Never over the live copy, the index still points there
+        struct stat st;
+        if (fstat(bs->data_fd, &st) == -1)
+            return ERR_DB_FILE;
+        ix.offset = st.st_size;
+        ix.cap = ix.len;
+
+        if (sdb_pwrite(bs->data_fd, packed, ix.len, ix.offset) != ix.len)
+            return ERR_DB_FILE;
+    }
+
+    if (sdb_pwrite(db->fd, &ix, sizeof(ix), (off_t)block * sizeof(ix)) != sizeof(ix))
+        return ERR_DB_FILE;
+
+    bs->cached = block;
+    bs->cached_ix = ix;
+    return NO_ERROR;
+}
+
+static void blk_free(blk_state_t *bs){
+    if (bs == NULL)
+        return;
+    if (bs->data_fd >= 0)
+        close(bs->data_fd);
+    free(bs);
+}
+
+static int blk_open(sdb_t *db, char *dbFile, bool should_truncate){
+    size_t len = strlen(dbFile);
+    char *path = malloc(len + sizeof(BLK_INDEX_EXT) + sizeof(BLK_DATA_EXT));
+    blk_state_t *bs = malloc(sizeof(blk_state_t));
+    if (path == NULL || bs == NULL) {
+        free(path);
+        free(bs);
+        return ERR_DB_FILE;
+    }
+
+    sprintf(path, "%s%s", dbFile, BLK_INDEX_EXT);
+    db->fd = open_db_file(path, should_truncate);
+    sprintf(path, "%s%s", dbFile, BLK_DATA_EXT);
+    bs->data_fd = open_db_file(path, should_truncate);
+    bs->cached = -1;
+    free(path);
+
+    if (db->fd < 0 || bs->data_fd < 0) {
+        if (db->fd >= 0)
+            close(db->fd);
+        db->fd = -1;
+        blk_free(bs);
+        return ERR_DB_FILE;
+    }
+
+    db->state = bs;
+    return NO_ERROR;
+}
+
+static int blk_get(sdb_t *db, int id, student_t *s){
+    blk_state_t *bs = db->state;
+    if (blk_load(db, id / BLK_RECORDS) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    student_t *r = (student_t *)bs->raw + id % BLK_RECORDS;
+    if (r->id == DELETED_STUDENT_ID)
+        return SRCH_NOT_FOUND;
+    memcpy(s, r, sizeof(student_t));
+    return NO_ERROR;
+}
+
+static int blk_put(sdb_t *db, student_t *s){
+    blk_state_t *bs = db->state;
+    if (blk_load(db, s->id / BLK_RECORDS) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    memcpy((student_t *)bs->raw + s->id % BLK_RECORDS, s, sizeof(student_t));
+    return blk_store(db, s->id / BLK_RECORDS);
+}
+
+static int blk_put_many(sdb_t *db, student_t *s, int n){
+    blk_state_t *bs = db->state;
+    int i = 0;
+
+    while (i < n) {
+        int block = s[i].id / BLK_RECORDS;
+        if (blk_load(db, block) != NO_ERROR)
+            return ERR_DB_FILE;
+        for (; i < n && s[i].id / BLK_RECORDS == block; i++)
+            memcpy((student_t *)bs->raw + s[i].id % BLK_RECORDS, &s[i], sizeof(student_t));
+        if (blk_store(db, block) != NO_ERROR)
+            return ERR_DB_FILE;
+    }
+    return NO_ERROR;
+}
+
+static int blk_del(sdb_t *db, int id){
+    blk_state_t *bs = db->state;
+    if (blk_load(db, id / BLK_RECORDS) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    memset((student_t *)bs->raw + id % BLK_RECORDS, 0, sizeof(student_t));
+    return blk_store(db, id / BLK_RECORDS);
+}
+
+static int blk_scan(sdb_t *db, int min_id, int max_id, scan_fn_t fn, void *arg){
+    blk_state_t *bs = db->state;
+    int first = min_id / BLK_RECORDS;
+    int last = max_id / BLK_RECORDS;
+    int blocks = last - first + 1;
+
+    blk_index_t *index = calloc(blocks, sizeof(blk_index_t));
+    char *window = malloc(SCAN_BUFFER_SZ);
+    if (index == NULL || window == NULL) {
+        free(index);
+        free(window);
+        return ERR_DB_FILE;
+    }
+
+    // The whole index range in one read, short if the file ends early
+    int rc = NO_ERROR;
+    if (sdb_pread(db->fd, index, blocks * sizeof(blk_index_t),
+                  (off_t)first * sizeof(blk_index_t)) < 0)
+        rc = ERR_DB_FILE;
+
+    // window holds the block file from win_off to win_off + win_len
+    long long win_off = 0;
+    ssize_t win_len = 0;
+
+    for (int b = 0; b < blocks && rc == NO_ERROR; b++) {
+        blk_index_t *ix = &index[b];
+        if (ix->len == 0)
+            continue;
+        if (ix->len > BLK_MAX_SIZE) {
+            rc = ERR_DB_FILE;
+            break;
+        }
+
+        if (ix->offset < win_off || ix->offset + ix->len > win_off + win_len) {
+            win_off = ix->offset;
+            win_len = sdb_pread(bs->data_fd, window, SCAN_BUFFER_SZ, win_off);
+            if (win_len < ix->len) {
+                rc = ERR_DB_FILE;
+                break;
+            }
+        }
+
+        bs->cached = -1;
+        if (blk_unpack(bs, ix, window + (ix->offset - win_off)) != NO_ERROR) {
+            rc = ERR_DB_FILE;
+            break;
+        }
+        bs->cached = first + b;
+        bs->cached_ix = *ix;
+
+        for (int r = 0; r < BLK_RECORDS && rc == NO_ERROR; r++) {
+            student_t *s = (student_t *)bs->raw + r;
+            if (s->id == DELETED_STUDENT_ID || s->id < min_id || s->id > max_id)
+                continue;
+            rc = fn(s, arg);
+        }
+    }
+
+    free(window);
+    free(index);
+    return rc;
+}
+
+//the index, then the blocks
+static int blk_files(sdb_t *db, int i, char *name, size_t len, bool *keep){
+    if (i < 0 || i > 1)
+        return SRCH_NOT_FOUND;
+    snprintf(name, len, "%s%s", db->path, (i == 0) ? BLK_INDEX_EXT : BLK_DATA_EXT);
+    *keep = false;
+    return NO_ERROR;
+}
+
+static void blk_close(sdb_t *db){
+    blk_free(db->state);
+    db->state = NULL;
+    if (db->fd >= 0)
+        close(db->fd);
+}
+
+const sdb_engine_t block_engine = {
+    .name       = "block",
+    .open       = blk_open,
+    .get        = blk_get,
+    .put        = blk_put,
+    .put_many   = blk_put_many,
+    .del        = blk_del,
+    .scan       = blk_scan,
+    .files      = blk_files,
+    .close      = blk_close,
+    .own_layout = true,
+};
@@ -0,0 +1,327 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+//database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  compact engine
+ *
+ *  Most of a 64 byte student record is the zero padding after the names,
+ *  and many students share a first or last name.  This engine stores each
+ *  name once in a dictionary file and keeps 16 byte records that refer to
+ *  the names by their offset in that file:
+ *
+ *      <db>.cpt   cpt_rec_t for student id N at offset N * 16, all zero
+ *                 records are empty slots just like in student.db
+ *      <db>.dict  every name ever stored, each ending with a '\0'
+ *
+ *  Looking a student up is still one read at a fixed offset plus two
+ *  lookups in the copy of the dictionary held in memory, and scans read a
+ *  quarter of the bytes the student.db layout needs.
+ *
+ *  The dictionary only grows.  Writers append new names while they hold
+ *  db_lock(), and every process notices names appended by others from the
+ *  file size.  Names that are no longer used stay until compress_db()
+ *  rebuilds both files.
+ */
+typedef struct cpt_rec {
+    int id;
+    unsigned int fname;     //dictionary offset of the first name
+    unsigned int lname;     //dictionary offset of the last name
+    int gpa;
+} cpt_rec_t;
+
+typedef struct cpt_state {
+    int dict_fd;
+    char *dict;             //copy of the dictionary file
+    size_t dict_len;
+    size_t dict_cap;
+    unsigned int *index;    //open addressing table of offset + 1, 0 is empty
+    unsigned int index_cap; //power of two
+    unsigned int index_count;
+} cpt_state_t;
+
+#define CPT_REC_EXT         ".cpt"
+#define CPT_DICT_EXT        ".dict"
+#define CPT_REC_SIZE        ((off_t)sizeof(cpt_rec_t))
+#define CPT_INDEX_MIN_CAP   1024
+#define CPT_SCAN_RECORDS    (SCAN_BUFFER_SZ / sizeof(cpt_rec_t))
+
+//FNV-1a
+static unsigned int name_hash(const char *name){
+    unsigned int h = 2166136261u;
+    while (*name)
+        h = (h ^ (unsigned char)*name++) * 16777619u;
+    return h;
+}
+
+static void index_insert(cpt_state_t *cs, unsigned int ref){
+    unsigned int i = name_hash(cs->dict + ref) & (cs->index_cap - 1);
+    while (cs->index[i] != 0)
+        i = (i + 1) & (cs->index_cap - 1);
+    cs->index[i] = ref + 1;
+    cs->index_count++;
+}
+
+static int index_grow(cpt_state_t *cs){
+    unsigned int *old = cs->index;
+    unsigned int old_cap = cs->index_cap;
+    unsigned int cap = (old_cap == 0) ? CPT_INDEX_MIN_CAP : old_cap * 2;
+
+    cs->index = calloc(cap, sizeof(unsigned int));
+    if (cs->index == NULL) {
+        cs->index = old;
+        return ERR_DB_FILE;
+    }
+    cs->index_cap = cap;
+    cs->index_count = 0;
+    for (unsigned int i = 0; i < old_cap; i++) {
+        if (old[i] != 0)
+            index_insert(cs, old[i] - 1);
+    }
+    free(old);
+    return NO_ERROR;
+}
+
+/*
+ *  dict_refresh
+ *
+ *  Brings the copy of the dictionary in line with the file.  Names other
+ *  processes appended are read and indexed, and a dictionary that shrank
+ *  was rebuilt by compress_db() or zero_db() and is read again in full.
+ */
+static int dict_refresh(cpt_state_t *cs){
+    struct stat st;
+    if (fstat(cs->dict_fd, &st) == -1)
+        return ERR_DB_FILE;
+
+    size_t size = st.st_size;
+    if (size == cs->dict_len)
+        return NO_ERROR;
+
+    if (size < cs->dict_len) {
+        cs->dict_len = 0;
+        memset(cs->index, 0, cs->index_cap * sizeof(unsigned int));
+        cs->index_count = 0;
+    }
+
+    if (size > cs->dict_cap) {
+        size_t cap = (cs->dict_cap == 0) ? DB_PAGE_SIZE : cs->dict_cap;
+        while (cap < size)
+            cap *= 2;
+        char *grown = realloc(cs->dict, cap);
+        if (grown == NULL)
+            return ERR_DB_FILE;
+        cs->dict = grown;
+        cs->dict_cap = cap;
+    }
+
+    size_t got = cs->dict_len;
+    while (got < size) {
+        ssize_t n = sdb_pread(cs->dict_fd, cs->dict + got, size - got, got);
+        if (n <= 0)
+            return ERR_DB_FILE;
+        got += n;
+    }
+
+    // Index only whole names, a writer may be half way through appending
+    size_t ref = cs->dict_len;
+    for (size_t i = ref; i < size; i++) {
+        if (cs->dict[i] != '\0')
+            continue;
+        if ((cs->index_count + 1) * 2 > cs->index_cap && index_grow(cs) != NO_ERROR)
+            return ERR_DB_FILE;
+        index_insert(cs, ref);
+        ref = i + 1;
+    }
+    cs->dict_len = ref;
+    return NO_ERROR;
+}
+
+//copies the name at ref into dst, a field of len bytes
+static int dict_name(cpt_state_t *cs, unsigned int ref, char *dst, size_t len){
+    if (ref >= cs->dict_len && (dict_refresh(cs) != NO_ERROR || ref >= cs->dict_len))
+        return ERR_DB_FILE;
+
+    memset(dst, 0, len);
+    memcpy(dst, cs->dict + ref, strnlen(cs->dict + ref, len - 1));
+    return NO_ERROR;
+}
+
+//dictionary offset of name, appending it if it is new.  Runs under db_lock().
+static int dict_intern(cpt_state_t *cs, const char *name, size_t len, unsigned int *ref){
+    char key[64];
+    len = strnlen(name, len - 1);
+    memcpy(key, name, len);
+    key[len] = '\0';
+
+    if (dict_refresh(cs) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    unsigned int i = name_hash(key) & (cs->index_cap - 1);
+    while (cs->index_cap > 0 && cs->index[i] != 0) {
+        if (strcmp(cs->dict + cs->index[i] - 1, key) == 0) {
+            *ref = cs->index[i] - 1;
+            return NO_ERROR;
+        }
+        i = (i + 1) & (cs->index_cap - 1);
+    }
+
+    // New name, append it to the file and then pick it up like any other
+    *ref = cs->dict_len;
+    if (sdb_pwrite(cs->dict_fd, key, len + 1, cs->dict_len) != (ssize_t)(len + 1))
+        return ERR_DB_FILE;
+    return dict_refresh(cs);
+}
+
+static void rec_to_student(cpt_state_t *cs, cpt_rec_t *r, student_t *s, int *rc){
+    s->id = r->id;
+    s->gpa = r->gpa;
+    if (dict_name(cs, r->fname, s->fname, sizeof(s->fname)) != NO_ERROR ||
+        dict_name(cs, r->lname, s->lname, sizeof(s->lname)) != NO_ERROR)
+        *rc = ERR_DB_FILE;
+}
+
+static void cpt_free(cpt_state_t *cs){
+    if (cs == NULL)
+        return;
+    if (cs->dict_fd >= 0)
+        close(cs->dict_fd);
+    free(cs->dict);
+    free(cs->index);
+    free(cs);
+}
+
+static int cpt_open(sdb_t *db, char *dbFile, bool should_truncate){
+    size_t len = strlen(dbFile);
+    char *path = malloc(len + sizeof(CPT_DICT_EXT) + sizeof(CPT_REC_EXT));
+    cpt_state_t *cs = calloc(1, sizeof(cpt_state_t));
+    if (path == NULL || cs == NULL) {
+        free(path);
+        free(cs);
+        return ERR_DB_FILE;
+    }
+
+    sprintf(path, "%s%s", dbFile, CPT_REC_EXT);
+    db->fd = open_db_file(path, should_truncate);
+    sprintf(path, "%s%s", dbFile, CPT_DICT_EXT);
+    cs->dict_fd = open_db_file(path, should_truncate);
+    free(path);
+
+    if (db->fd < 0 || cs->dict_fd < 0 ||
+        index_grow(cs) != NO_ERROR || dict_refresh(cs) != NO_ERROR) {
+        if (db->fd >= 0)
+            close(db->fd);
+        db->fd = -1;
+        cpt_free(cs);
+        return ERR_DB_FILE;
+    }
+
+    db->state = cs;
+    return NO_ERROR;
+}
+
+static int cpt_get(sdb_t *db, int id, student_t *s){
+    cpt_rec_t r;
+    ssize_t n = sdb_pread(db->fd, &r, sizeof(r), id * CPT_REC_SIZE);
+    if (n < 0)
+        return ERR_DB_FILE;
+    if (n < CPT_REC_SIZE || r.id == DELETED_STUDENT_ID)
+        return SRCH_NOT_FOUND;
+
+    int rc = NO_ERROR;
+    rec_to_student(db->state, &r, s, &rc);
+    return rc;
+}
+
+static int cpt_put(sdb_t *db, student_t *s){
+    cpt_state_t *cs = db->state;
+    cpt_rec_t r = { .id = s->id, .gpa = s->gpa };
+
+    if (dict_intern(cs, s->fname, sizeof(s->fname), &r.fname) != NO_ERROR ||
+        dict_intern(cs, s->lname, sizeof(s->lname), &r.lname) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    if (sdb_pwrite(db->fd, &r, sizeof(r), s->id * CPT_REC_SIZE) != CPT_REC_SIZE)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+static int cpt_del(sdb_t *db, int id){
+    cpt_rec_t r = {0};
+    if (sdb_pwrite(db->fd, &r, sizeof(r), id * CPT_REC_SIZE) != CPT_REC_SIZE)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+static int cpt_scan(sdb_t *db, int min_id, int max_id, scan_fn_t fn, void *arg){
+    cpt_state_t *cs = db->state;
+    cpt_rec_t *buff = malloc(CPT_SCAN_RECORDS * sizeof(cpt_rec_t));
+    if (buff == NULL || dict_refresh(cs) != NO_ERROR) {
+        free(buff);
+        return ERR_DB_FILE;
+    }
+
+    int rc = NO_ERROR;
+    int id = min_id;
+    student_t s;
+    while (rc == NO_ERROR && id <= max_id) {
+        size_t want = max_id - id + 1;
+        if (want > CPT_SCAN_RECORDS)
+            want = CPT_SCAN_RECORDS;
+
+        ssize_t n = sdb_pread(db->fd, buff, want * sizeof(cpt_rec_t), id * CPT_REC_SIZE);
+        if (n < 0)
+            rc = ERR_DB_FILE;
+        if (n <= 0)
+            break;
+
+        int got = n / CPT_REC_SIZE;
+        for (int i = 0; i < got && rc == NO_ERROR; i++) {
+            if (buff[i].id == DELETED_STUDENT_ID)
+                continue;
+            rec_to_student(cs, &buff[i], &s, &rc);
+            if (rc == NO_ERROR)
+                rc = fn(&s, arg);
+        }
+        id += got;
+    }
+
+    free(buff);
+    return rc;
+}
+
+//the record file, then the dictionary
+static int cpt_files(sdb_t *db, int i, char *name, size_t len, bool *keep){
+    if (i < 0 || i > 1)
+        return SRCH_NOT_FOUND;
+    snprintf(name, len, "%s%s", db->path, (i == 0) ? CPT_REC_EXT : CPT_DICT_EXT);
+    *keep = false;
+    return NO_ERROR;
+}
+
+static void cpt_close(sdb_t *db){
+    cpt_free(db->state);
+    db->state = NULL;
+    if (db->fd >= 0)
+        close(db->fd);
+}
+
+const sdb_engine_t compact_engine = {
+    .name       = "compact",
+    .open       = cpt_open,
+    .get        = cpt_get,
+    .put        = cpt_put,
+    .del        = cpt_del,
+    .scan       = cpt_scan,
+    .files      = cpt_files,
+    .close      = cpt_close,
+    .own_layout = true,
+};
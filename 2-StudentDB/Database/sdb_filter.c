@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdbool.h>
+
+//database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  Filter expressions for -p, -c and -o.
+ *
+ *  A filter is one or more terms joined by "and":
+ *
+ *      gpa>=350 and lname=doe and id in 1000..2000
+ *
+ *  Each term is a field (id, gpa, fname or lname), a comparison (=, !=, <,
+ *  <=, > or >=) and a value, or a numeric field followed by "in lo..hi".
+ *  GPAs are written as 3 digit ints like in -a, and names compare the way
+ *  strncmp() orders them.  Numbers outside the ids or GPAs a student can
+ *  have are rejected rather than wrapped into range.
+ *
+ *  filter_compile() parses the expression once into a filter_t before the
+ *  scan starts.  Terms on id only narrow the id range, which scan_filtered()
+ *  hands to the engine so ids outside it are never read, and the other
+ *  terms are checked by filter_match() as each student comes by.
+ */
+static const char *filter_fields[] = { "id", "gpa", "fname", "lname" };
+
+static const struct {
+    const char *text;
+    int op;
+} filter_ops[] = {
+    // Two character operators first so "<=" is not read as "<"
+    { "<=", FILTER_OP_LE }, { ">=", FILTER_OP_GE }, { "!=", FILTER_OP_NE },
+    { "==", FILTER_OP_EQ }, { "=", FILTER_OP_EQ },  { "<", FILTER_OP_LT },
+    { ">", FILTER_OP_GT },
+};
+
+#define N_FILTER_FIELDS (int)(sizeof(filter_fields) / sizeof(filter_fields[0]))
+#define N_FILTER_OPS    (int)(sizeof(filter_ops) / sizeof(filter_ops[0]))
+
+static char *skip_space(char *p){
+    while (isspace((unsigned char)*p))
+        p++;
+    return p;
+}
+
+//true if p starts with the keyword word followed by a space or the end
+static bool keyword(char *p, const char *word){
+    size_t len = strlen(word);
+    return strncmp(p, word, len) == 0 && (p[len] == '\0' || isspace((unsigned char)p[len]));
+}
+
+//reads a whole number from min to max at *p and moves *p past it
+static bool parse_int(char **p, int min, int max, int *value){
+    char *end;
+    errno = 0;
+    long v = strtol(*p, &end, 10);
+    if (end == *p || errno == ERANGE || v < min || v > max)
+        return false;
+    *value = (int)v;
+    *p = end;
+    return true;
+}
+
+//narrows the id range of the filter by one id term
+static void narrow_ids(filter_t *f, filter_term_t *t){
+    int lo = MIN_STD_ID;
+    int hi = MAX_STD_ID;
+
+    switch (t->op) {
+        case FILTER_OP_EQ: lo = hi = t->lo;             break;
+        case FILTER_OP_LT: hi = t->lo - 1;              break;
+        case FILTER_OP_LE: hi = t->lo;                  break;
+        case FILTER_OP_GT: lo = t->lo + 1;              break;
+        case FILTER_OP_GE: lo = t->lo;                  break;
+        case FILTER_OP_IN: lo = t->lo; hi = t->hi;      break;
+    }
+    if (lo > f->min_id)
+        f->min_id = lo;
+    if (hi < f->max_id)
+        f->max_id = hi;
+}
+
+/*
+ *  filter_compile
+ *      words:    the filter expression, split into words by the shell
+ *      n_words:  number of words, 0 for a filter that matches everyone
+ *      filter:   filled in with the compiled filter
+ *
+ *  The words are joined back together with spaces, so the expression may
+ *  be passed quoted as one argument or unquoted as several.
+ *
+ *  returns:  NO_ERROR        on success
+ *            EXIT_FAIL_ARGS  if the expression is not valid
+ *
+ *  console:  M_ERR_FILTER    naming where the expression stopped making sense
+ */
+int filter_compile(char **words, int n_words, filter_t *filter){
+    char expr[256] = "";
+    size_t len = 0;
+
+    memset(filter, 0, sizeof(filter_t));
+    filter->min_id = MIN_STD_ID;
+    filter->max_id = MAX_STD_ID;
+
+    for (int w = 0; w < n_words; w++) {
+        len += snprintf(expr + len, sizeof(expr) - len, "%s%s", w ? " " : "", words[w]);
+        if (len >= sizeof(expr)) {
+            printf(M_ERR_FILTER, words[w]);
+            return EXIT_FAIL_ARGS;
+        }
+    }
+
+    char *p = skip_space(expr);
+    while (*p != '\0') {
+        char *start = p;
+        filter_term_t t = {0};
+
+        // field
+        size_t flen = 0;
+        while (isalpha((unsigned char)p[flen]))
+            flen++;
+        t.field = -1;
+        for (int i = 0; i < N_FILTER_FIELDS; i++) {
+            if (strlen(filter_fields[i]) == flen && strncmp(p, filter_fields[i], flen) == 0)
+                t.field = i;
+        }
+        p = skip_space(p + flen);
+
+        // comparison and value
+        bool ok = t.field >= 0 && filter->n_terms < MAX_FILTER_TERMS;
+        bool numeric = t.field == FILTER_ID || t.field == FILTER_GPA;
+        int min = (t.field == FILTER_ID) ? MIN_STD_ID : MIN_STD_GPA;
+        int max = (t.field == FILTER_ID) ? MAX_STD_ID : MAX_STD_GPA;
+        if (ok && numeric && keyword(p, "in")) {
+            t.op = FILTER_OP_IN;
+            p = skip_space(p + 2);
+            ok = parse_int(&p, min, max, &t.lo) && strncmp(p, "..", 2) == 0;
+            if (ok) {
+                p += 2;
+                ok = parse_int(&p, min, max, &t.hi) && t.lo <= t.hi;
+            }
+        } else if (ok) {
+            int op = -1;
+            for (int i = 0; i < N_FILTER_OPS && op < 0; i++) {
+                size_t olen = strlen(filter_ops[i].text);
+                if (strncmp(p, filter_ops[i].text, olen) == 0) {
+                    op = filter_ops[i].op;
+                    p = skip_space(p + olen);
+                }
+            }
+            t.op = op;
+            if (op < 0) {
+                ok = false;
+            } else if (numeric) {
+                ok = parse_int(&p, min, max, &t.lo);
+            } else {
+                size_t vlen = strcspn(p, " \t");
+                ok = vlen > 0 && vlen < sizeof(t.str);
+                if (ok)
+                    memcpy(t.str, p, vlen);
+                p += vlen;
+            }
+        }
+
+        // the term has to end the expression or be followed by "and"
+        p = skip_space(p);
+        if (ok && *p != '\0') {
+            ok = keyword(p, "and");
+            if (ok)
+                p = skip_space(p + 3);
+            ok = ok && *p != '\0';
+        }
+        if (!ok) {
+            printf(M_ERR_FILTER, start);
+            return EXIT_FAIL_ARGS;
+        }
+
+        // "id != n" is the only id term that cannot be a range
+        if (t.field == FILTER_ID && t.op != FILTER_OP_NE)
+            narrow_ids(filter, &t);
+        else
+            filter->terms[filter->n_terms++] = t;
+    }
+
+    return NO_ERROR;
+}
+
+static bool term_match(filter_term_t *t, student_t *s){
+    int c;
+    switch (t->field) {
+        case FILTER_ID:    c = (s->id > t->lo) - (s->id < t->lo);       break;
+        case FILTER_GPA:   c = (s->gpa > t->lo) - (s->gpa < t->lo);     break;
+        case FILTER_FNAME: c = strncmp(s->fname, t->str, sizeof(s->fname)); break;
+        default:           c = strncmp(s->lname, t->str, sizeof(s->lname)); break;
+    }
+
+    switch (t->op) {
+        case FILTER_OP_EQ: return c == 0;
+        case FILTER_OP_NE: return c != 0;
+        case FILTER_OP_LT: return c < 0;
+        case FILTER_OP_LE: return c <= 0;
+        case FILTER_OP_GT: return c > 0;
+        case FILTER_OP_GE: return c >= 0;
+    }
+
+    // FILTER_OP_IN, only on numeric fields
+    int v = (t->field == FILTER_ID) ? s->id : s->gpa;
+    return v >= t->lo && v <= t->hi;
+}
+
+/*
+ *  filter_match
+ *      filter:  compiled by filter_compile()
+ *      s:       student found by a scan
+ *
+ *  Checks the terms that are not part of the id range, the scan has
+ *  already kept to that.
+ *
+ *  returns:  true if s matches every term
+ */
+bool filter_match(filter_t *filter, student_t *s){
+    for (int i = 0; i < filter->n_terms; i++) {
+        if (!term_match(&filter->terms[i], s))
+            return false;
+    }
+    return true;
+}
+
+//scan_db() callback, passes the students that match on
+static int filter_record(student_t *s, void *arg){
+    filter_scan_t *fs = arg;
+    if (!filter_match(fs->filter, s))
+        return NO_ERROR;
+    return fs->fn(s, fs->arg);
+}
+
+/*
+ *  scan_filtered
+ *      db:      database handle from open_db()
+ *      filter:  compiled by filter_compile(), or NULL for every student
+ *      fn:      called for each student that matches
+ *      arg:     passed to fn
+ *
+ *  Like scan_db(), but only over the id range of the filter and only
+ *  calling fn for the students that match the rest of it.
+ *
+ *  returns:  whatever scan_db() returns
+ *
+ *  console:  Does not produce any console I/O
+ */
+int scan_filtered(sdb_t *db, filter_t *filter, scan_fn_t fn, void *arg){
+    if (filter == NULL)
+        return scan_db(db, MIN_STD_ID, MAX_STD_ID, fn, arg);
+    if (filter->min_id > filter->max_id)
+        return NO_ERROR;
+    if (filter->n_terms == 0)
+        return scan_db(db, filter->min_id, filter->max_id, fn, arg);
+
+    filter_scan_t fs = { .filter = filter, .fn = fn, .arg = arg };
+    return scan_db(db, filter->min_id, filter->max_id, filter_record, &fs);
+}
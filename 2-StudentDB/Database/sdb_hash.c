@@ -0,0 +1,334 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/stat.h>
+
+//database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  hash engine
+ *
+ *  Keeps every student in memory in an open addressing hash table keyed by
+ *  id, for session workloads that make many calls against one open
+ *  database (see -S).  open reads the whole database file with one
+ *  sequential read, after that get, put and del never touch the file.
+ *
+ *  Changed ids are marked in a dirty bitmap and written back by sync,
+ *  which close_db() and sync_db() call, and by put and del once
+ *  SDB_SYNC_SECS seconds have passed since the last write back.  Only the
+ *  dirty slots are written, so changes other processes made to other
+ *  students are kept, but a student changed by both sides ends up with
+ *  whatever was synced last.
+ *
+ *  Slots are student_t records with id 0 marking an empty slot, the same
+ *  convention the database file uses.  Collisions probe linearly and
+ *  deletes shift the following entries back instead of leaving
+ *  tombstones, so lookups never get slower as students come and go.
+ */
+typedef struct hash_state {
+    student_t *slots;
+    unsigned int cap;               //power of two
+    unsigned int count;
+    unsigned char *dirty;           //one bit per id, written back by sync
+    int n_dirty;
+    int sync_secs;                  //0 only syncs on demand
+    time_t last_sync;
+} hash_state_t;
+
+#define HASH_MIN_CAP    1024
+#define HASH_MAX_LOAD   2           //grow past 1/HASH_MAX_LOAD full
+
+static unsigned int hash_slot(hash_state_t *hs, int id){
+    // Multiplying by an odd constant scatters ids that share low bits
+    return ((unsigned int)id * 2654435769u) & (hs->cap - 1);
+}
+
+//slot holding id, or the empty slot where it would go
+static unsigned int hash_find(hash_state_t *hs, int id){
+    unsigned int i = hash_slot(hs, id);
+    while (hs->slots[i].id != DELETED_STUDENT_ID && hs->slots[i].id != id)
+        i = (i + 1) & (hs->cap - 1);
+    return i;
+}
+
+static int hash_resize(hash_state_t *hs, unsigned int cap){
+    student_t *old = hs->slots;
+    unsigned int old_cap = hs->cap;
+
+    hs->slots = calloc(cap, sizeof(student_t));
+    if (hs->slots == NULL) {
+        hs->slots = old;
+        return ERR_DB_OP;
+    }
+    hs->cap = cap;
+
+    for (unsigned int i = 0; i < old_cap; i++) {
+        if (old[i].id != DELETED_STUDENT_ID)
+            hs->slots[hash_find(hs, old[i].id)] = old[i];
+    }
+    free(old);
+    return NO_ERROR;
+}
+
+static void mark_dirty(hash_state_t *hs, int id){
+    unsigned char bit = 1 << (id & 7);
+    if (!(hs->dirty[id >> 3] & bit)) {
+        hs->dirty[id >> 3] |= bit;
+        hs->n_dirty++;
+    }
+}
+
+/*
+ *  hash_flush
+ *
+ *  Writes every dirty slot back to db->fd, one pwrite() per run of
+ *  adjacent dirty ids.  The caller holds db_lock().
+ */
+static int hash_flush(sdb_t *db){
+    hash_state_t *hs = db->state;
+    if (hs->n_dirty == 0)
+        return NO_ERROR;
+
+    student_t run[RECORDS_PER_PAGE];
+    int len = 0;
+    int start = 0;
+
+    for (int id = MIN_STD_ID; id <= MAX_STD_ID + 1; id++) {
+        bool dirty = id <= MAX_STD_ID && (hs->dirty[id >> 3] & (1 << (id & 7)));
+
+        // Write out the run when it ends or fills the buffer
+        if (len > 0 && (!dirty || len == RECORDS_PER_PAGE)) {
+            off_t offset = (off_t)start * STUDENT_RECORD_SIZE;
+            ssize_t bytes = len * STUDENT_RECORD_SIZE;
+            if (snap_log_range(db->path, db->fd, offset, bytes) != NO_ERROR ||
+                sdb_pwrite(db->fd, run, bytes, offset) != bytes)
+                return ERR_DB_FILE;
+            len = 0;
+        }
+        if (!dirty)
+            continue;
+
+        if (len == 0)
+            start = id;
+        unsigned int i = hash_find(hs, id);
+        run[len++] = (hs->slots[i].id == id) ? hs->slots[i] : EMPTY_STUDENT_RECORD;
+    }
+
+    memset(hs->dirty, 0, (MAX_STD_ID >> 3) + 1);
+    hs->n_dirty = 0;
+    hs->last_sync = time(NULL);
+    return NO_ERROR;
+}
+
+//periodic write back from put and del, which run under db_lock()
+static int hash_maybe_flush(sdb_t *db){
+    hash_state_t *hs = db->state;
+    if (hs->sync_secs > 0 && time(NULL) - hs->last_sync >= hs->sync_secs)
+        return hash_flush(db);
+    return NO_ERROR;
+}
+
+static void hash_free(hash_state_t *hs){
+    if (hs == NULL)
+        return;
+    free(hs->slots);
+    free(hs->dirty);
+    free(hs);
+}
+
+static int hash_open(sdb_t *db, char *dbFile, bool should_truncate){
+    db->fd = open_db_file(dbFile, should_truncate);
+    if (db->fd < 0)
+        return ERR_DB_FILE;
+
+    hash_state_t *hs = calloc(1, sizeof(hash_state_t));
+    struct stat st;
+    if (hs == NULL || fstat(db->fd, &st) == -1) {
+        free(hs);
+        close(db->fd);
+        return ERR_DB_FILE;
+    }
+
+    char *env = getenv(SYNC_SECS_ENV);
+    hs->sync_secs = (env != NULL) ? atoi(env) : 0;
+    hs->last_sync = time(NULL);
+    hs->dirty = calloc((MAX_STD_ID >> 3) + 1, 1);
+
+    // One sequential read of the whole file, then insert the live records
+    student_t *file = malloc(st.st_size + 1);
+    if (hs->dirty == NULL || file == NULL) {
+        free(file);
+        hash_free(hs);
+        close(db->fd);
+        return ERR_DB_FILE;
+    }
+
+    off_t got = 0;
+    while (got < st.st_size) {
+        ssize_t n = sdb_pread(db->fd, (char *)file + got, st.st_size - got, got);
+        if (n <= 0)
+            break;
+        got += n;
+    }
+
+    int records = got / STUDENT_RECORD_SIZE;
+    int live = 0;
+    for (int r = 0; r < records; r++) {
+        if (file[r].id != DELETED_STUDENT_ID)
+            live++;
+    }
+
+    // Size the table for what was loaded so loading never has to grow it
+    hs->cap = HASH_MIN_CAP;
+    while (hs->cap < (unsigned int)(HASH_MAX_LOAD * live))
+        hs->cap <<= 1;
+    hs->slots = calloc(hs->cap, sizeof(student_t));
+    if (hs->slots == NULL) {
+        free(file);
+        hash_free(hs);
+        close(db->fd);
+        return ERR_DB_FILE;
+    }
+
+    for (int r = 0; r < records; r++) {
+        if (file[r].id == DELETED_STUDENT_ID)
+            continue;
+        hs->slots[hash_find(hs, file[r].id)] = file[r];
+        hs->count++;
+    }
+    free(file);
+
+    db->state = hs;
+    return NO_ERROR;
+}
+
+static int hash_get(sdb_t *db, int id, student_t *s){
+    hash_state_t *hs = db->state;
+    unsigned int i = hash_find(hs, id);
+    if (hs->slots[i].id != id)
+        return SRCH_NOT_FOUND;
+
+    memcpy(s, &hs->slots[i], sizeof(student_t));
+    return NO_ERROR;
+}
+
+static int hash_put(sdb_t *db, student_t *s){
+    hash_state_t *hs = db->state;
+    if ((hs->count + 1) * HASH_MAX_LOAD > hs->cap &&
+        hash_resize(hs, hs->cap * 2) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    unsigned int i = hash_find(hs, s->id);
+    if (hs->slots[i].id == DELETED_STUDENT_ID)
+        hs->count++;
+    hs->slots[i] = *s;
+    mark_dirty(hs, s->id);
+    return hash_maybe_flush(db);
+}
+
+static int hash_del(sdb_t *db, int id){
+    hash_state_t *hs = db->state;
+    unsigned int mask = hs->cap - 1;
+    unsigned int i = hash_find(hs, id);
+    if (hs->slots[i].id != id)
+        return NO_ERROR;
+
+    // Backward shift: pull later entries of the probe chain into the hole
+    // unless that would move them in front of their home slot
+    unsigned int j = i;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (hs->slots[j].id == DELETED_STUDENT_ID)
+            break;
+        unsigned int home = hash_slot(hs, hs->slots[j].id);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            hs->slots[i] = hs->slots[j];
+            i = j;
+        }
+    }
+    hs->slots[i] = EMPTY_STUDENT_RECORD;
+    hs->count--;
+
+    mark_dirty(hs, id);
+    return hash_maybe_flush(db);
+}
+
+static int cmp_student_ptr(const void *a, const void *b){
+    return (*(student_t * const *)a)->id - (*(student_t * const *)b)->id;
+}
+
+static int hash_scan(sdb_t *db, int min_id, int max_id, scan_fn_t fn, void *arg){
+    hash_state_t *hs = db->state;
+
+    // Small ranges are cheaper to probe id by id than to sort the table
+    if ((unsigned int)(max_id - min_id) < hs->count) {
+        for (int id = min_id; id <= max_id; id++) {
+            unsigned int i = hash_find(hs, id);
+            if (hs->slots[i].id != id)
+                continue;
+            int rc = fn(&hs->slots[i], arg);
+            if (rc != NO_ERROR)
+                return rc;
+        }
+        return NO_ERROR;
+    }
+
+    student_t **order = malloc((hs->count + 1) * sizeof(student_t *));
+    if (order == NULL)
+        return ERR_DB_FILE;
+
+    unsigned int n = 0;
+    for (unsigned int i = 0; i < hs->cap; i++) {
+        int id = hs->slots[i].id;
+        if (id != DELETED_STUDENT_ID && id >= min_id && id <= max_id)
+            order[n++] = &hs->slots[i];
+    }
+    qsort(order, n, sizeof(student_t *), cmp_student_ptr);
+
+    int rc = NO_ERROR;
+    for (unsigned int k = 0; k < n && rc == NO_ERROR; k++)
+        rc = fn(order[k], arg);
+
+    free(order);
+    return rc;
+}
+
+static int hash_sync(sdb_t *db){
+    hash_state_t *hs = db->state;
+    if (hs->n_dirty == 0)
+        return NO_ERROR;
+
+    if (db_lock(db->fd) != NO_ERROR)
+        return ERR_DB_FILE;
+    int rc = hash_flush(db);
+    db_unlock(db->fd);
+    return rc;
+}
+
+static void hash_close(sdb_t *db){
+    if (db->state != NULL) {
+        if (hash_sync(db) != NO_ERROR)
+            printf(M_ERR_DB_WRITE);
+        hash_free(db->state);
+        db->state = NULL;
+    }
+    if (db->fd >= 0)
+        close(db->fd);
+}
+
+const sdb_engine_t hash_engine = {
+    .name   = "hash",
+    .open   = hash_open,
+    .get    = hash_get,
+    .put    = hash_put,
+    .del    = hash_del,
+    .scan   = hash_scan,
+    .sync   = hash_sync,
+    .close  = hash_close,
+};
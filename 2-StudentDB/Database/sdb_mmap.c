@@ -0,0 +1,168 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  mmap engine
+ *
+ *  Maps the database file shared and read/write, so lookups and scans are
+ *  plain memory copies with no system call per record.  The mapping covers
+ *  the largest possible database up front (every id up to MAX_STD_ID), so
+ *  it never has to be moved when the file grows.  Touching a mapped page
+ *  past the end of the file raises SIGBUS, so the engine remembers the
+ *  file size, refreshes it with fstat() before giving up on a slot, and
+ *  grows the file with ftruncate() before writing past the end.  Growing
+ *  that way leaves a hole, just like pwrite() past the end does.
+ *
+ *  The mapping is MAP_SHARED, so changes land in the same page cache pages
+ *  read() and write() use, and the other engines and tools see them.
+ */
+typedef struct mmap_state {
+    char *map;
+    size_t map_len;
+    off_t file_len;
+} mmap_state_t;
+
+#define MMAP_DB_LEN ((size_t)(MAX_STD_ID + 1) * sizeof(student_t))
+
+//true if the whole record for id is inside the file
+static bool mmap_covers(sdb_t *db, int id){
+    mmap_state_t *ms = db->state;
+    off_t end = (off_t)(id + 1) * STUDENT_RECORD_SIZE;
+    if (end <= ms->file_len)
+        return true;
+
+    // Another process may have grown the file since we last looked
+    struct stat st;
+    if (fstat(db->fd, &st) == -1)
+        return false;
+    ms->file_len = st.st_size;
+    return end <= ms->file_len;
+}
+
+static int mmap_open(sdb_t *db, char *dbFile, bool should_truncate){
+    db->fd = open_db_file(dbFile, should_truncate);
+    if (db->fd < 0)
+        return ERR_DB_FILE;
+
+    mmap_state_t *ms = calloc(1, sizeof(mmap_state_t));
+    struct stat st;
+    if (ms == NULL || fstat(db->fd, &st) == -1) {
+        free(ms);
+        close(db->fd);
+        return ERR_DB_FILE;
+    }
+
+    ms->map_len = MMAP_DB_LEN;
+    ms->file_len = st.st_size;
+    ms->map = mmap(NULL, ms->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, db->fd, 0);
+    if (ms->map == MAP_FAILED) {
+        free(ms);
+        close(db->fd);
+        return ERR_DB_FILE;
+    }
+
+    db->state = ms;
+    return NO_ERROR;
+}
+
+static int mmap_get(sdb_t *db, int id, student_t *s){
+    mmap_state_t *ms = db->state;
+    if (id < 0 || id > MAX_STD_ID || !mmap_covers(db, id))
+        return SRCH_NOT_FOUND;
+
+    memcpy(s, ms->map + (size_t)id * STUDENT_RECORD_SIZE, STUDENT_RECORD_SIZE);
+    return (s->id == DELETED_STUDENT_ID) ? SRCH_NOT_FOUND : NO_ERROR;
+}
+
+static int mmap_put(sdb_t *db, student_t *s){
+    mmap_state_t *ms = db->state;
+    off_t offset = (off_t)s->id * STUDENT_RECORD_SIZE;
+    if (s->id < 0 || s->id > MAX_STD_ID)
+        return ERR_DB_OP;
+
+    if (snap_log_range(db->path, db->fd, offset, STUDENT_RECORD_SIZE) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    if (!mmap_covers(db, s->id)) {
+        if (ftruncate(db->fd, offset + STUDENT_RECORD_SIZE) == -1)
+            return ERR_DB_FILE;
+        ms->file_len = offset + STUDENT_RECORD_SIZE;
+    }
+
+    memcpy(ms->map + offset, s, STUDENT_RECORD_SIZE);
+    return NO_ERROR;
+}
+
+static int mmap_del(sdb_t *db, int id){
+    mmap_state_t *ms = db->state;
+    if (id < 0 || id > MAX_STD_ID || !mmap_covers(db, id))
+        return NO_ERROR;
+
+    off_t offset = (off_t)id * STUDENT_RECORD_SIZE;
+    if (snap_log_range(db->path, db->fd, offset, STUDENT_RECORD_SIZE) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    memset(ms->map + offset, 0, STUDENT_RECORD_SIZE);
+    return NO_ERROR;
+}
+
+static int mmap_scan(sdb_t *db, int min_id, int max_id, scan_fn_t fn, void *arg){
+    mmap_state_t *ms = db->state;
+
+    // Refresh the size once, then stay inside it for the whole scan
+    mmap_covers(db, MAX_STD_ID);
+    int last = ms->file_len / STUDENT_RECORD_SIZE - 1;
+    if (last > max_id)
+        last = max_id;
+    if (min_id < 0)
+        min_id = 0;
+
+    if (last >= min_id) {
+        size_t start = ((size_t)min_id * STUDENT_RECORD_SIZE) & ~(size_t)(DB_PAGE_SIZE - 1);
+        madvise(ms->map + start, (size_t)(last + 1) * STUDENT_RECORD_SIZE - start,
+                MADV_SEQUENTIAL);
+    }
+
+    for (int id = min_id; id <= last; id++) {
+        student_t *s = (student_t *)(ms->map + (size_t)id * STUDENT_RECORD_SIZE);
+        if (memcmp(s, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0) {
+            int rc = fn(s, arg);
+            if (rc != NO_ERROR)
+                return rc;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+static void mmap_close(sdb_t *db){
+    mmap_state_t *ms = db->state;
+    if (ms != NULL) {
+        munmap(ms->map, ms->map_len);
+        free(ms);
+        db->state = NULL;
+    }
+    if (db->fd >= 0)
+        close(db->fd);
+}
+
+const sdb_engine_t mmap_engine = {
+    .name   = "mmap",
+    .open   = mmap_open,
+    .get    = mmap_get,
+    .put    = mmap_put,
+    .del    = mmap_del,
+    .scan   = mmap_scan,
+    .close  = mmap_close,
+};
@@ -0,0 +1,379 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+//database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  shard engine
+ *
+ *  Splits the id space over SDB_SHARDS files so writers to different
+ *  parts of it never wait on each other's lock, and scans read the files
+ *  in parallel:
+ *
+ *      <db>.shards   shard_hdr_t saying how the ids are split, this is
+ *                    db->fd and its lock is the whole database lock
+ *      <db>.0 ...    one file per shard in the student.db layout, with
+ *                    the student in slot shard_slot() of its shard
+ *
+ *  SDB_SHARD_BY=range gives each shard an equal run of ids, so scans of a
+ *  small id range only touch one or two files.  SDB_SHARD_BY=hash puts id
+ *  N in shard N % SDB_SHARDS, which spreads runs of new ids, the usual
+ *  batch of adds, over every shard.  Both settings only matter when the
+ *  database is created, after that the header decides.
+ *
+ *  Point writes take a shared lock on db->fd and the exclusive lock of
+ *  their shard, see lock_fd in sdbsc.h, while operations on the whole
+ *  database such as compaction take the exclusive lock on db->fd.
+ */
+typedef struct shard_hdr {
+    char magic[8];
+    int n_shards;
+    int by;                     //SHARD_BY_RANGE or SHARD_BY_HASH
+} shard_hdr_t;
+
+typedef struct shard_state {
+    shard_hdr_t hdr;
+    int per_shard;              //ids per shard when sharded by range
+    int fds[MAX_SHARDS];
+} shard_state_t;
+
+//what one scan thread reads out of its shard
+typedef struct shard_scan {
+    sdb_t *db;
+    int shard;
+    int min_id, max_id;
+    student_t *found;           //live students in id order
+    int n_found;
+    int cap;
+    int next;                   //merge position in found
+    int rc;
+} shard_scan_t;
+
+#define SHARD_MAGIC         "SDBSHRD"
+#define SHARD_HDR_EXT       ".shards"
+#define SHARD_RUN_RECORDS   (SCAN_BUFFER_SZ / STUDENT_RECORD_SIZE)
+
+static int shard_of(shard_state_t *ss, int id){
+    if (ss->hdr.by == SHARD_BY_HASH)
+        return id % ss->hdr.n_shards;
+    return id / ss->per_shard;
+}
+
+static off_t shard_slot(shard_state_t *ss, int id){
+    if (ss->hdr.by == SHARD_BY_HASH)
+        return (off_t)(id / ss->hdr.n_shards) * STUDENT_RECORD_SIZE;
+    return (off_t)(id % ss->per_shard) * STUDENT_RECORD_SIZE;
+}
+
+//first id held in slot 0 of shard, and the step between slots
+static void shard_ids(shard_state_t *ss, int shard, int *first, int *step){
+    if (ss->hdr.by == SHARD_BY_HASH) {
+        *first = shard;
+        *step = ss->hdr.n_shards;
+    } else {
+        *first = shard * ss->per_shard;
+        *step = 1;
+    }
+}
+
+static void shard_free(shard_state_t *ss){
+    for (int i = 0; i < ss->hdr.n_shards; i++) {
+        if (ss->fds[i] >= 0)
+            close(ss->fds[i]);
+    }
+    free(ss);
+}
+
+//reads the header, or writes one from the environment for a new database
+static int shard_header(int fd, shard_hdr_t *hdr){
+    ssize_t n = sdb_pread(fd, hdr, sizeof(shard_hdr_t), 0);
+    if (n == sizeof(shard_hdr_t))
+        return (memcmp(hdr->magic, SHARD_MAGIC, sizeof(SHARD_MAGIC)) == 0 &&
+                hdr->n_shards >= 1 && hdr->n_shards <= MAX_SHARDS) ? NO_ERROR : ERR_DB_FILE;
+    if (n != 0)
+        return ERR_DB_FILE;
+
+    char *count = getenv(SHARDS_ENV);
+    char *by = getenv(SHARD_BY_ENV);
+    memset(hdr, 0, sizeof(shard_hdr_t));
+    memcpy(hdr->magic, SHARD_MAGIC, sizeof(SHARD_MAGIC));
+    hdr->n_shards = (count != NULL) ? atoi(count) : DEFAULT_SHARDS;
+    hdr->by = (by != NULL && strcmp(by, "hash") == 0) ? SHARD_BY_HASH : SHARD_BY_RANGE;
+    if (hdr->n_shards < 1 || hdr->n_shards > MAX_SHARDS ||
+        (by != NULL && strcmp(by, "hash") != 0 && strcmp(by, "range") != 0)) {
+        printf(M_ERR_SHARDS, MAX_SHARDS);
+        return ERR_DB_FILE;
+    }
+
+    // A lock keeps two processes creating the database at once from both
+    // writing a header
+    if (db_lock(fd) != NO_ERROR)
+        return ERR_DB_FILE;
+    n = sdb_pread(fd, hdr, sizeof(shard_hdr_t), 0);
+    if (n == 0 && sdb_pwrite(fd, hdr, sizeof(shard_hdr_t), 0) == sizeof(shard_hdr_t))
+        n = sizeof(shard_hdr_t);
+    db_unlock(fd);
+    return (n == sizeof(shard_hdr_t)) ? NO_ERROR : ERR_DB_FILE;
+}
+
+static int shard_open(sdb_t *db, char *dbFile, bool should_truncate){
+    size_t len = strlen(dbFile);
+    char *path = malloc(len + sizeof(SHARD_HDR_EXT) + 12);
+    shard_state_t *ss = calloc(1, sizeof(shard_state_t));
+    if (path == NULL || ss == NULL) {
+        free(path);
+        free(ss);
+        return ERR_DB_FILE;
+    }
+
+    // The header survives truncation, emptying the database keeps its shards
+    sprintf(path, "%s%s", dbFile, SHARD_HDR_EXT);
+    db->fd = open_db_file(path, false);
+    int rc = (db->fd < 0) ? ERR_DB_FILE : shard_header(db->fd, &ss->hdr);
+
+    for (int i = 0; i < MAX_SHARDS; i++)
+        ss->fds[i] = -1;
+    for (int i = 0; rc == NO_ERROR && i < ss->hdr.n_shards; i++) {
+        sprintf(path, "%s.%d", dbFile, i);
+        ss->fds[i] = open_db_file(path, should_truncate);
+        if (ss->fds[i] < 0)
+            rc = ERR_DB_FILE;
+    }
+    free(path);
+
+    if (rc != NO_ERROR) {
+        if (db->fd >= 0)
+            close(db->fd);
+        db->fd = -1;
+        shard_free(ss);
+        return ERR_DB_FILE;
+    }
+
+    ss->per_shard = (MAX_STD_ID + ss->hdr.n_shards) / ss->hdr.n_shards;
+    db->state = ss;
+    return NO_ERROR;
+}
+
+static int shard_get(sdb_t *db, int id, student_t *s){
+    shard_state_t *ss = db->state;
+    ssize_t n = sdb_pread(ss->fds[shard_of(ss, id)], s, STUDENT_RECORD_SIZE, shard_slot(ss, id));
+    if (n < 0)
+        return ERR_DB_FILE;
+    if (n != STUDENT_RECORD_SIZE || s->id == DELETED_STUDENT_ID)
+        return SRCH_NOT_FOUND;
+    return NO_ERROR;
+}
+
+static int shard_put(sdb_t *db, student_t *s){
+    shard_state_t *ss = db->state;
+    if (sdb_pwrite(ss->fds[shard_of(ss, s->id)], s, STUDENT_RECORD_SIZE,
+                   shard_slot(ss, s->id)) != STUDENT_RECORD_SIZE)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+//sorted by id, students that land in adjacent slots of one shard go out
+//in a single pwrite()
+static int shard_put_many(sdb_t *db, student_t *s, int n){
+    shard_state_t *ss = db->state;
+    int i = 0;
+    while (i < n) {
+        int shard = shard_of(ss, s[i].id);
+        off_t slot = shard_slot(ss, s[i].id);
+        int run = 1;
+        while (i + run < n && run < SHARD_RUN_RECORDS &&
+               shard_of(ss, s[i + run].id) == shard &&
+               shard_slot(ss, s[i + run].id) == slot + (off_t)run * STUDENT_RECORD_SIZE)
+            run++;
+
+        ssize_t bytes = (ssize_t)run * STUDENT_RECORD_SIZE;
+        if (sdb_pwrite(ss->fds[shard], &s[i], bytes, slot) != bytes)
+            return ERR_DB_FILE;
+        i += run;
+    }
+    return NO_ERROR;
+}
+
+static int shard_del(sdb_t *db, int id){
+    shard_state_t *ss = db->state;
+    if (sdb_pwrite(ss->fds[shard_of(ss, id)], &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE,
+                   shard_slot(ss, id)) != STUDENT_RECORD_SIZE)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+/*
+ *  shard_collect
+ *
+ *  Scan thread body.  Reads the slots of one shard that can hold ids from
+ *  min_id to max_id in SCAN_BUFFER_SZ chunks and keeps the live students,
+ *  which come out in id order since slots follow ids within a shard.
+ */
+static void *shard_collect(void *arg){
+    shard_scan_t *sc = arg;
+    shard_state_t *ss = sc->db->state;
+    int fd = ss->fds[sc->shard];
+    int first, step;
+    shard_ids(ss, sc->shard, &first, &step);
+
+    // Slots of this shard that can hold ids in [min_id, max_id]
+    long lo = (sc->min_id <= first) ? 0 : (sc->min_id - first + step - 1) / step;
+    long hi = (sc->max_id < first) ? -1 : (sc->max_id - first) / step;
+    if (ss->hdr.by == SHARD_BY_RANGE && hi >= ss->per_shard)
+        hi = ss->per_shard - 1;
+
+    student_t *buff = malloc(SCAN_BUFFER_SZ);
+    if (buff == NULL) {
+        sc->rc = ERR_DB_FILE;
+        return NULL;
+    }
+
+    for (long slot = lo; slot <= hi && sc->rc == NO_ERROR; slot += SHARD_RUN_RECORDS) {
+        long want = hi - slot + 1;
+        if (want > SHARD_RUN_RECORDS)
+            want = SHARD_RUN_RECORDS;
+        ssize_t n = sdb_pread(fd, buff, want * STUDENT_RECORD_SIZE, slot * STUDENT_RECORD_SIZE);
+        if (n < 0)
+            sc->rc = ERR_DB_FILE;
+        if (n <= 0)
+            break;
+
+        for (int r = 0; r < n / STUDENT_RECORD_SIZE; r++) {
+            if (buff[r].id == DELETED_STUDENT_ID)
+                continue;
+            if (sc->n_found == sc->cap) {
+                int cap = (sc->cap == 0) ? SHARD_RUN_RECORDS : sc->cap * 2;
+                student_t *grown = realloc(sc->found, cap * sizeof(student_t));
+                if (grown == NULL) {
+                    sc->rc = ERR_DB_FILE;
+                    break;
+                }
+                sc->found = grown;
+                sc->cap = cap;
+            }
+            sc->found[sc->n_found++] = buff[r];
+        }
+        if (n < want * STUDENT_RECORD_SIZE)
+            break;
+    }
+
+    free(buff);
+    return NULL;
+}
+
+/*
+ *  shard_scan
+ *
+ *  Starts one shard_collect() thread for every shard that can hold ids in
+ *  the range and merges what they found in id order on this thread, so
+ *  fn never runs concurrently with itself.  A range that falls in a
+ *  single shard is read without starting a thread.
+ */
+static int shard_scan(sdb_t *db, int min_id, int max_id, scan_fn_t fn, void *arg){
+    shard_state_t *ss = db->state;
+    shard_scan_t scans[MAX_SHARDS];
+    pthread_t threads[MAX_SHARDS];
+    bool started[MAX_SHARDS] = {false};
+    int n = 0;
+    int rc = NO_ERROR;
+
+    if (min_id > max_id)
+        return NO_ERROR;
+
+    int first = 0;
+    int last = ss->hdr.n_shards - 1;
+    if (ss->hdr.by == SHARD_BY_RANGE) {
+        first = shard_of(ss, min_id);
+        if (shard_of(ss, max_id) < last)
+            last = shard_of(ss, max_id);
+    }
+
+    for (int shard = first; shard <= last; shard++) {
+        scans[n] = (shard_scan_t){ .db = db, .shard = shard,
+                                   .min_id = min_id, .max_id = max_id };
+        n++;
+    }
+
+    if (n == 1) {
+        shard_collect(&scans[0]);
+    } else {
+        for (int i = 0; i < n; i++)
+            started[i] = pthread_create(&threads[i], NULL, shard_collect, &scans[i]) == 0;
+        for (int i = 0; i < n; i++) {
+            if (started[i])
+                pthread_join(threads[i], NULL);
+            else
+                shard_collect(&scans[i]);
+        }
+    }
+
+    for (int i = 0; i < n && rc == NO_ERROR; i++)
+        rc = scans[i].rc;
+
+    // Every shard is in id order, so repeatedly take the smallest head
+    while (rc == NO_ERROR) {
+        int min = -1;
+        for (int i = 0; i < n; i++) {
+            shard_scan_t *sc = &scans[i];
+            if (sc->next < sc->n_found &&
+                (min < 0 || sc->found[sc->next].id < scans[min].found[scans[min].next].id))
+                min = i;
+        }
+        if (min < 0)
+            break;
+        rc = fn(&scans[min].found[scans[min].next++], arg);
+    }
+
+    for (int i = 0; i < n; i++)
+        free(scans[i].found);
+    return rc;
+}
+
+static int shard_lock_fd(sdb_t *db, int id){
+    shard_state_t *ss = db->state;
+    return ss->fds[shard_of(ss, id)];
+}
+
+//the header, which truncating keeps, then the shards in order
+static int shard_files(sdb_t *db, int i, char *name, size_t len, bool *keep){
+    shard_state_t *ss = db->state;
+    if (i < 0 || i > ss->hdr.n_shards)
+        return SRCH_NOT_FOUND;
+    if (i == 0)
+        snprintf(name, len, "%s%s", db->path, SHARD_HDR_EXT);
+    else
+        snprintf(name, len, "%s.%d", db->path, i - 1);
+    *keep = (i == 0);
+    return NO_ERROR;
+}
+
+static void shard_close(sdb_t *db){
+    if (db->state != NULL) {
+        shard_free(db->state);
+        db->state = NULL;
+    }
+    if (db->fd >= 0)
+        close(db->fd);
+}
+
+const sdb_engine_t shard_engine = {
+    .name       = "shard",
+    .open       = shard_open,
+    .get        = shard_get,
+    .put        = shard_put,
+    .put_many   = shard_put_many,
+    .del        = shard_del,
+    .scan       = shard_scan,
+    .lock_fd    = shard_lock_fd,
+    .files      = shard_files,
+    .close      = shard_close,
+    .own_layout = true,
+};
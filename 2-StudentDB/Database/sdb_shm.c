@@ -0,0 +1,550 @@
+#define _GNU_SOURCE     //needed for fallocate()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+//database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  shm engine and database daemon
+ *
+ *  sdbsc -D loads student.db into a POSIX shared memory segment and stays
+ *  running to serve it.  Processes using SDB_ENGINE=shm map the segment
+ *  read only and look students up in it without any system call, and
+ *  send their writes to the daemon over the Unix socket <db>.sock:
+ *
+ *      segment   shm_hdr_t, then one sequence number per page of
+ *                RECORDS_PER_PAGE students, then every student slot in
+ *                the student.db layout
+ *
+ *  The daemon is the only writer of the segment.  Each page has a seqlock:
+ *  the daemon makes the page's sequence number odd, changes the records
+ *  and makes it even again, and a reader copies what it needs and only
+ *  keeps the copy if the sequence number was even and did not move while
+ *  it copied.  Readers never write to shared memory, so they do not
+ *  bounce cache lines between cores and scale with the number of cores.
+ *
+ *  Clients still take db_lock() on student.db around every change and
+ *  write the change feed themselves, exactly like the file engine.  The
+ *  daemon writes the change to student.db as well as to the segment, so
+ *  the file stays the durable copy and snapshots keep working.  Changes
+ *  made with another engine while the daemon runs only reach the segment
+ *  when the daemon is started again, so while it runs every process
+ *  should use SDB_ENGINE=shm.
+ */
+typedef struct shm_hdr {
+    char magic[8];
+    int n_pages;
+    int daemon_pid;
+} shm_hdr_t;
+
+//a request from a client, answered with an int return code
+typedef struct shm_request {
+    int op;                     //SHM_OP_* below
+    int n;                      //students in records, for SHM_OP_PUT
+    int id;                     //for SHM_OP_DEL
+    student_t records[RECORDS_PER_PAGE];
+} shm_request_t;
+
+typedef struct shm_state {
+    int sock;                   //connection to the daemon
+    const shm_hdr_t *hdr;
+    const unsigned int *seq;
+    const student_t *slots;
+    size_t map_len;
+} shm_state_t;
+
+#define SHM_MAGIC           "SDBSHM1"
+#define SHM_SOCKET_EXT      ".sock"
+#define SHM_PAGES           ((MAX_STD_ID + RECORDS_PER_PAGE) / RECORDS_PER_PAGE)
+#define SHM_SEQ_OFFSET      DB_PAGE_SIZE
+#define SHM_SLOTS_OFFSET    (SHM_SEQ_OFFSET + \
+                             ((SHM_PAGES * sizeof(int) + DB_PAGE_SIZE - 1) & ~(DB_PAGE_SIZE - 1)))
+#define SHM_SIZE            (SHM_SLOTS_OFFSET + (size_t)SHM_PAGES * DB_PAGE_SIZE)
+#define SHM_MAX_CLIENTS     64
+
+#define SHM_OP_PUT          1
+#define SHM_OP_DEL          2
+#define SHM_OP_TRUNCATE     3
+#define SHM_OP_COMPACT      4
+
+//segment name for the database file, from its device and inode so every
+//process that opens the same file finds the same segment
+static void shm_name(int fd, char *name, size_t len){
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+        memset(&st, 0, sizeof(st));
+    snprintf(name, len, "/sdbsc-%lx-%lx", (unsigned long)st.st_dev, (unsigned long)st.st_ino);
+}
+
+static void socket_addr(char *dbFile, struct sockaddr_un *addr){
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    snprintf(addr->sun_path, sizeof(addr->sun_path), "%s%s", dbFile, SHM_SOCKET_EXT);
+}
+
+/*
+ *  seq_read_begin / seq_read_retry
+ *
+ *  Reader half of the page seqlocks.  seq_read_begin() waits out a write
+ *  in progress and returns the sequence number to check the copy against
+ *  with seq_read_retry(), which says whether the copy has to be redone.
+ */
+static unsigned int seq_read_begin(const unsigned int *seq){
+    unsigned int s;
+    while ((s = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1)
+        ;
+    return s;
+}
+
+static bool seq_read_retry(const unsigned int *seq, unsigned int s){
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(seq, __ATOMIC_RELAXED) != s;
+}
+
+//sends a request to the daemon and waits for its answer
+static int shm_call(shm_state_t *ss, shm_request_t *req){
+    size_t len = offsetof(shm_request_t, records) + req->n * sizeof(student_t);
+    int rc = ERR_DB_FILE;
+    if (send(ss->sock, req, len, 0) != (ssize_t)len ||
+        recv(ss->sock, &rc, sizeof(rc), 0) != sizeof(rc))
+        return ERR_DB_FILE;
+    return rc;
+}
+
+static void shm_unmap(shm_state_t *ss){
+    if (ss->hdr != NULL)
+        munmap((void *)ss->hdr, ss->map_len);
+    if (ss->sock >= 0)
+        close(ss->sock);
+    free(ss);
+}
+
+static int shm_open_db(sdb_t *db, char *dbFile, bool should_truncate){
+    char name[64];
+    struct sockaddr_un addr;
+    shm_state_t *ss = calloc(1, sizeof(shm_state_t));
+    if (ss == NULL)
+        return ERR_DB_FILE;
+    ss->sock = -1;
+
+    // student.db is opened for the write lock the callers take
+    db->fd = open_db_file(dbFile, false);
+    if (db->fd < 0) {
+        free(ss);
+        return ERR_DB_FILE;
+    }
+
+    shm_name(db->fd, name, sizeof(name));
+    int shm_fd = shm_open(name, O_RDONLY, 0);
+    if (shm_fd != -1) {
+        void *map = mmap(NULL, SHM_SIZE, PROT_READ, MAP_SHARED, shm_fd, 0);
+        close(shm_fd);
+        if (map != MAP_FAILED) {
+            ss->hdr = map;
+            ss->map_len = SHM_SIZE;
+            ss->seq = (const unsigned int *)((char *)map + SHM_SEQ_OFFSET);
+            ss->slots = (const student_t *)((char *)map + SHM_SLOTS_OFFSET);
+        }
+    }
+
+    socket_addr(dbFile, &addr);
+    ss->sock = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (ss->hdr == NULL || memcmp(ss->hdr->magic, SHM_MAGIC, sizeof(SHM_MAGIC)) != 0 ||
+        ss->sock == -1 || connect(ss->sock, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        printf(M_ERR_NO_DAEMON, dbFile);
+        shm_unmap(ss);
+        close(db->fd);
+        db->fd = -1;
+        return ERR_DB_FILE;
+    }
+
+    // The daemon empties the file and the segment for compaction and -z
+    shm_request_t req = { .op = SHM_OP_TRUNCATE };
+    if (should_truncate && shm_call(ss, &req) != NO_ERROR) {
+        shm_unmap(ss);
+        close(db->fd);
+        db->fd = -1;
+        return ERR_DB_FILE;
+    }
+
+    db->state = ss;
+    return NO_ERROR;
+}
+
+static int shm_get(sdb_t *db, int id, student_t *s){
+    shm_state_t *ss = db->state;
+    if (id < 0 || id > MAX_STD_ID)
+        return SRCH_NOT_FOUND;
+
+    const unsigned int *seq = &ss->seq[id / RECORDS_PER_PAGE];
+    unsigned int start;
+    do {
+        start = seq_read_begin(seq);
+        memcpy(s, &ss->slots[id], sizeof(student_t));
+    } while (seq_read_retry(seq, start));
+
+    return (s->id == DELETED_STUDENT_ID) ? SRCH_NOT_FOUND : NO_ERROR;
+}
+
+static int shm_put_many(sdb_t *db, student_t *s, int n){
+    shm_request_t req = { .op = SHM_OP_PUT };
+    for (int i = 0; i < n; i += RECORDS_PER_PAGE) {
+        req.n = (n - i < RECORDS_PER_PAGE) ? n - i : RECORDS_PER_PAGE;
+        memcpy(req.records, &s[i], req.n * sizeof(student_t));
+        int rc = shm_call(db->state, &req);
+        if (rc != NO_ERROR)
+            return rc;
+    }
+    return NO_ERROR;
+}
+
+static int shm_put(sdb_t *db, student_t *s){
+    return shm_put_many(db, s, 1);
+}
+
+static int shm_del(sdb_t *db, int id){
+    shm_request_t req = { .op = SHM_OP_DEL, .id = id };
+    return shm_call(db->state, &req);
+}
+
+// The daemon holds every student, so it compacts student.db itself and
+// the client has nothing to write back
+static int shm_compact(sdb_t *db){
+    shm_request_t req = { .op = SHM_OP_COMPACT };
+    return shm_call(db->state, &req);
+}
+
+//copies a page at a time under its seqlock, then calls fn outside of it
+static int shm_scan(sdb_t *db, int min_id, int max_id, scan_fn_t fn, void *arg){
+    shm_state_t *ss = db->state;
+    student_t page[RECORDS_PER_PAGE];
+
+    if (min_id < 0)
+        min_id = 0;
+    if (max_id > MAX_STD_ID)
+        max_id = MAX_STD_ID;
+
+    for (int p = min_id / RECORDS_PER_PAGE; p <= max_id / RECORDS_PER_PAGE; p++) {
+        int first = p * RECORDS_PER_PAGE;
+        int lo = (min_id > first) ? min_id - first : 0;
+        int hi = (max_id < first + RECORDS_PER_PAGE - 1) ? max_id - first : RECORDS_PER_PAGE - 1;
+        unsigned int start;
+        do {
+            start = seq_read_begin(&ss->seq[p]);
+            memcpy(&page[lo], &ss->slots[first + lo], (hi - lo + 1) * sizeof(student_t));
+        } while (seq_read_retry(&ss->seq[p], start));
+
+        for (int r = lo; r <= hi; r++) {
+            if (page[r].id == DELETED_STUDENT_ID)
+                continue;
+            int rc = fn(&page[r], arg);
+            if (rc != NO_ERROR)
+                return rc;
+        }
+    }
+    return NO_ERROR;
+}
+
+static void shm_close(sdb_t *db){
+    if (db->state != NULL) {
+        shm_unmap(db->state);
+        db->state = NULL;
+    }
+    if (db->fd >= 0)
+        close(db->fd);
+}
+
+const sdb_engine_t shm_engine = {
+    .name       = "shm",
+    .open       = shm_open_db,
+    .get        = shm_get,
+    .put        = shm_put,
+    .put_many   = shm_put_many,
+    .del        = shm_del,
+    .scan       = shm_scan,
+    .compact    = shm_compact,
+    .close      = shm_close,
+    .own_layout = true,
+};
+
+/*
+ *  The daemon.  It owns the writable mapping of the segment and applies
+ *  requests one at a time, so there is only ever one seqlock writer.
+ */
+typedef struct shm_daemon {
+    char *path;                 //student.db
+    int fd;
+    unsigned int *seq;
+    student_t *slots;
+} shm_daemon_t;
+
+static volatile sig_atomic_t serve_stop = 0;
+
+static void serve_signal(int sig){
+    (void)sig;
+    serve_stop = 1;
+}
+
+static void seq_write_begin(unsigned int *seq){
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void seq_write_end(unsigned int *seq){
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+//writes one student slot to student.db and then to the segment
+static int serve_write(shm_daemon_t *d, int id, const student_t *s){
+    off_t offset = (off_t)id * STUDENT_RECORD_SIZE;
+    if (snap_log_range(d->path, d->fd, offset, STUDENT_RECORD_SIZE) != NO_ERROR ||
+        sdb_pwrite(d->fd, s, STUDENT_RECORD_SIZE, offset) != STUDENT_RECORD_SIZE)
+        return ERR_DB_FILE;
+
+    unsigned int *seq = &d->seq[id / RECORDS_PER_PAGE];
+    seq_write_begin(seq);
+    d->slots[id] = *s;
+    seq_write_end(seq);
+    return NO_ERROR;
+}
+
+static int serve_truncate(shm_daemon_t *d){
+    struct stat st;
+    if (fstat(d->fd, &st) == -1 || snap_log_range(d->path, d->fd, 0, st.st_size) != NO_ERROR ||
+        ftruncate(d->fd, 0) == -1)
+        return ERR_DB_FILE;
+
+    for (int p = 0; p < SHM_PAGES; p++) {
+        seq_write_begin(&d->seq[p]);
+        memset(&d->slots[p * RECORDS_PER_PAGE], 0, DB_PAGE_SIZE);
+        seq_write_end(&d->seq[p]);
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  Compaction of student.db from the segment, giving the same file as
+ *  compress_db() does for the file engine: pages without a student become
+ *  holes and the file ends after the last student.  Only bytes that are
+ *  already zero are dropped, so there is no point at which a crash loses
+ *  a student.
+ */
+static int serve_compact(shm_daemon_t *d){
+    struct stat st;
+    if (fstat(d->fd, &st) == -1)
+        return ERR_DB_FILE;
+
+    off_t end = 0;
+    for (int p = 0; p < SHM_PAGES && (off_t)p * DB_PAGE_SIZE < st.st_size; p++) {
+        off_t offset = (off_t)p * DB_PAGE_SIZE;
+        const student_t *page = &d->slots[p * RECORDS_PER_PAGE];
+        int last = -1;
+        for (int r = 0; r < RECORDS_PER_PAGE; r++) {
+            if (page[r].id != DELETED_STUDENT_ID)
+                last = r;
+        }
+
+        if (last >= 0) {
+            end = offset + (off_t)(last + 1) * STUDENT_RECORD_SIZE;
+        } else if (snap_log_range(d->path, d->fd, offset, DB_PAGE_SIZE) != NO_ERROR ||
+                   (fallocate(d->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                              offset, DB_PAGE_SIZE) == -1 && errno != EOPNOTSUPP)) {
+            return ERR_DB_FILE;
+        }
+    }
+
+    if (end < st.st_size && (snap_log_range(d->path, d->fd, end, st.st_size - end) != NO_ERROR ||
+                             ftruncate(d->fd, end) == -1))
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+static int serve_request(shm_daemon_t *d, shm_request_t *req, ssize_t len){
+    switch (req->op) {
+        case SHM_OP_PUT:
+            if (req->n < 1 || req->n > RECORDS_PER_PAGE ||
+                len != (ssize_t)(offsetof(shm_request_t, records) + req->n * sizeof(student_t)))
+                return ERR_DB_OP;
+            for (int i = 0; i < req->n; i++) {
+                if (req->records[i].id < MIN_STD_ID || req->records[i].id > MAX_STD_ID)
+                    return ERR_DB_OP;
+            }
+            for (int i = 0; i < req->n; i++) {
+                if (serve_write(d, req->records[i].id, &req->records[i]) != NO_ERROR)
+                    return ERR_DB_FILE;
+            }
+            return NO_ERROR;
+        case SHM_OP_DEL:
+            if (req->id < MIN_STD_ID || req->id > MAX_STD_ID)
+                return ERR_DB_OP;
+            return serve_write(d, req->id, &EMPTY_STUDENT_RECORD);
+        case SHM_OP_TRUNCATE:
+            return serve_truncate(d);
+        case SHM_OP_COMPACT:
+            return serve_compact(d);
+    }
+    return ERR_DB_OP;
+}
+
+/*
+ *  serve_db
+ *      dbFile:  name of the database file
+ *
+ *  Runs the database daemon for dbFile until SIGINT or SIGTERM.  The file
+ *  is read into a new shared memory segment, then the daemon answers
+ *  requests from shm engine clients on <dbFile>.sock.  The segment and the
+ *  socket are removed again on the way out.
+ *
+ *  returns:  NO_ERROR on a clean shutdown, or ERR_DB_FILE
+ *
+ *  console:  M_DB_SERVING          once the clients can connect
+ *            M_ERR_DAEMON_RUNNING  another daemon already serves dbFile
+ *            M_ERR_SERVE           the segment or socket could not be set up
+ */
+int serve_db(char *dbFile){
+    char name[64];
+    struct sockaddr_un addr;
+    shm_daemon_t d = { .path = dbFile, .fd = open_db_file(dbFile, false) };
+    if (d.fd < 0) {
+        printf(M_ERR_DB_OPEN);
+        return ERR_DB_FILE;
+    }
+
+    // A socket that still takes connections belongs to a live daemon
+    socket_addr(dbFile, &addr);
+    int listen_fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (listen_fd != -1 && connect(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        printf(M_ERR_DAEMON_RUNNING, dbFile);
+        close(listen_fd);
+        close(d.fd);
+        return ERR_DB_FILE;
+    }
+    if (listen_fd != -1)
+        close(listen_fd);
+    unlink(addr.sun_path);
+
+    shm_name(d.fd, name, sizeof(name));
+    shm_unlink(name);
+    int shm_fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR | S_IRGRP);
+    char *map = MAP_FAILED;
+    if (shm_fd != -1 && ftruncate(shm_fd, SHM_SIZE) == 0)
+        map = mmap(NULL, SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    if (shm_fd != -1)
+        close(shm_fd);
+
+    if (map == MAP_FAILED) {
+        printf(M_ERR_SERVE, dbFile);
+        shm_unlink(name);
+        close(d.fd);
+        return ERR_DB_FILE;
+    }
+    d.seq = (unsigned int *)(map + SHM_SEQ_OFFSET);
+    d.slots = (student_t *)(map + SHM_SLOTS_OFFSET);
+
+    // Load under the write lock so no write lands half way through, and
+    // only publish the header once the slots are filled in
+    int rc = db_lock(d.fd);
+    if (rc == NO_ERROR) {
+        off_t got = 0;
+        while (got < (off_t)SHM_PAGES * DB_PAGE_SIZE) {
+            ssize_t n = sdb_pread(d.fd, (char *)d.slots + got,
+                                  SHM_PAGES * DB_PAGE_SIZE - got, got);
+            if (n < 0)
+                rc = ERR_DB_FILE;
+            if (n <= 0)
+                break;
+            got += n;
+        }
+        db_unlock(d.fd);
+    }
+
+    shm_hdr_t *hdr = (shm_hdr_t *)map;
+    hdr->n_pages = SHM_PAGES;
+    hdr->daemon_pid = getpid();
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(hdr->magic, SHM_MAGIC, sizeof(SHM_MAGIC));
+
+    // Clients can connect once the socket exists, so it comes last
+    listen_fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (rc != NO_ERROR || listen_fd == -1 ||
+        bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+        listen(listen_fd, SHM_MAX_CLIENTS) == -1) {
+        printf((rc != NO_ERROR) ? M_ERR_DB_READ : M_ERR_SERVE, dbFile);
+        munmap(map, SHM_SIZE);
+        shm_unlink(name);
+        if (listen_fd != -1)
+            close(listen_fd);
+        close(d.fd);
+        return ERR_DB_FILE;
+    }
+
+    struct sigaction sa = { .sa_handler = serve_signal };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf(M_DB_SERVING, dbFile, addr.sun_path);
+    fflush(stdout);
+
+    struct pollfd fds[SHM_MAX_CLIENTS + 1];
+    int n_fds = 1;
+    fds[0].fd = listen_fd;
+    fds[0].events = POLLIN;
+    shm_request_t req;
+
+    while (rc == NO_ERROR && !serve_stop) {
+        if (poll(fds, n_fds, -1) == -1) {
+            if (errno != EINTR)
+                rc = ERR_DB_FILE;
+            continue;
+        }
+
+        for (int i = n_fds - 1; i >= 1; i--) {
+            if (fds[i].revents == 0)
+                continue;
+
+            ssize_t len = recv(fds[i].fd, &req, sizeof(req), 0);
+            int answer = (len >= (ssize_t)offsetof(shm_request_t, records))
+                         ? serve_request(&d, &req, len) : ERR_DB_OP;
+            if (len <= 0 || send(fds[i].fd, &answer, sizeof(answer), 0) != sizeof(answer)) {
+                // Client went away, fill the gap with the last entry
+                close(fds[i].fd);
+                fds[i] = fds[--n_fds];
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int client = accept(listen_fd, NULL, NULL);
+            if (client != -1 && n_fds <= SHM_MAX_CLIENTS) {
+                fds[n_fds].fd = client;
+                fds[n_fds].events = POLLIN;
+                n_fds++;
+            } else if (client != -1) {
+                close(client);
+            }
+        }
+    }
+
+    for (int i = 1; i < n_fds; i++)
+        close(fds[i].fd);
+    close(listen_fd);
+    unlink(addr.sun_path);
+    munmap(map, SHM_SIZE);
+    shm_unlink(name);
+    close(d.fd);
+    return rc;
+}
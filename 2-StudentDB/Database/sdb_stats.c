@@ -0,0 +1,230 @@
+#define _GNU_SOURCE     //needed for copy_file_range()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/file.h>   //flock()
+
+//database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  Operation statistics, see STATS_OP() in sdbsc.h.
+ *
+ *  Every public database operation opens a stats scope.  While a scope is
+ *  open the sdb_*() system call wrappers below charge their calls and
+ *  bytes to that operation, and when the outermost scope closes its
+ *  latency goes into a histogram of power of two microsecond buckets.
+ *  Operations called from inside another one (del_student() looking the
+ *  student up with get_student() for example) are part of the outer
+ *  operation and are not counted on their own.  Calls made outside of any
+ *  operation, such as the change feed follower, are charged to "other".
+ *
+ *  Nothing is collected unless stats_init() found SDB_STATS set, and then
+ *  the report is written to stderr when the program exits so it never
+ *  mixes with the normal output on stdout.
+ */
+typedef struct op_stats {
+    long long calls;
+    long long total_ns;
+    long long sys[N_STAT_SYS];      //system calls by STAT_SYS_* kind
+    long long bytes_read;
+    long long bytes_written;
+    long long hist[STAT_HIST_BUCKETS];
+} op_stats_t;
+
+static const char *stat_op_names[N_STAT_OPS] = {
+    "get", "add", "del", "count", "print", "compact",
+    "load", "update", "bulk_upd", "snapshot", "zero", "export", "join",
+    "other"
+};
+
+static int stats_mode = STATS_OFF;
+static op_stats_t stats[N_STAT_OPS];
+static int stats_op = STAT_OP_OTHER;    //operation being charged
+static int stats_depth = 0;             //nesting of open scopes
+static struct timespec stats_start;     //when the outermost scope opened
+
+static void stats_report(void);
+
+/*
+ *  stats_init
+ *      mode:  "summary", "json" or NULL, usually getenv(STATS_ENV)
+ *
+ *  Turns statistics on, NULL leaves them off.  The report is printed by
+ *  an atexit() handler, so nothing else is needed to get it.
+ *
+ *  returns:  NO_ERROR        on success
+ *            EXIT_FAIL_ARGS  if mode is not one of the names above
+ *
+ *  console:  M_ERR_STATS     if mode is not one of the names above
+ */
+int stats_init(char *mode){
+    if (mode == NULL)
+        return NO_ERROR;
+
+    if (strcmp(mode, "summary") == 0) {
+        stats_mode = STATS_SUMMARY;
+    } else if (strcmp(mode, "json") == 0) {
+        stats_mode = STATS_JSON;
+    } else {
+        printf(M_ERR_STATS, mode);
+        return EXIT_FAIL_ARGS;
+    }
+
+    memset(stats, 0, sizeof(stats));
+    atexit(stats_report);
+    return NO_ERROR;
+}
+
+int stats_begin(int op){
+    if (stats_mode != STATS_OFF && stats_depth++ == 0) {
+        stats_op = op;
+        clock_gettime(CLOCK_MONOTONIC, &stats_start);
+    }
+    return op;
+}
+
+void stats_end(int *scope){
+    (void)scope;
+    if (stats_mode == STATS_OFF || stats_depth == 0 || --stats_depth > 0)
+        return;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long ns = (now.tv_sec - stats_start.tv_sec) * 1000000000LL +
+                   (now.tv_nsec - stats_start.tv_nsec);
+
+    // bucket b holds latencies below 2^b microseconds
+    int b = 0;
+    for (long long us = ns / 1000; us > 0 && b < STAT_HIST_BUCKETS - 1; us >>= 1)
+        b++;
+
+    op_stats_t *st = &stats[stats_op];
+    st->calls++;
+    st->total_ns += ns;
+    st->hist[b]++;
+    stats_op = STAT_OP_OTHER;
+}
+
+static void stats_sys(int kind, ssize_t bytes_read, ssize_t bytes_written){
+    if (stats_mode == STATS_OFF)
+        return;
+
+    // Engines may read from several threads at once, see shard_scan()
+    op_stats_t *st = &stats[stats_op];
+    __atomic_add_fetch(&st->sys[kind], 1, __ATOMIC_RELAXED);
+    if (bytes_read > 0)
+        __atomic_add_fetch(&st->bytes_read, bytes_read, __ATOMIC_RELAXED);
+    if (bytes_written > 0)
+        __atomic_add_fetch(&st->bytes_written, bytes_written, __ATOMIC_RELAXED);
+}
+
+/*
+ *  sdb_read / sdb_pread / sdb_write / sdb_pwrite / sdb_lseek / sdb_flock /
+ *  sdb_copy_file_range
+ *
+ *  The system calls the database makes on its files, with the same
+ *  arguments and results as the calls they wrap.  Each one is counted
+ *  against the current operation when statistics are on.
+ */
+ssize_t sdb_read(int fd, void *buf, size_t count){
+    ssize_t n = read(fd, buf, count);
+    stats_sys(STAT_SYS_READ, n, 0);
+    return n;
+}
+
+ssize_t sdb_pread(int fd, void *buf, size_t count, off_t offset){
+    ssize_t n = pread(fd, buf, count, offset);
+    stats_sys(STAT_SYS_READ, n, 0);
+    return n;
+}
+
+ssize_t sdb_write(int fd, const void *buf, size_t count){
+    ssize_t n = write(fd, buf, count);
+    stats_sys(STAT_SYS_WRITE, 0, n);
+    return n;
+}
+
+ssize_t sdb_pwrite(int fd, const void *buf, size_t count, off_t offset){
+    ssize_t n = pwrite(fd, buf, count, offset);
+    stats_sys(STAT_SYS_WRITE, 0, n);
+    return n;
+}
+
+off_t sdb_lseek(int fd, off_t offset, int whence){
+    off_t off = lseek(fd, offset, whence);
+    stats_sys(STAT_SYS_LSEEK, 0, 0);
+    return off;
+}
+
+int sdb_flock(int fd, int operation){
+    int rc = flock(fd, operation);
+    stats_sys(STAT_SYS_LOCK, 0, 0);
+    return rc;
+}
+
+ssize_t sdb_copy_file_range(int fd_in, off_t *off_in, int fd_out, off_t *off_out,
+                            size_t len, unsigned int flags){
+    ssize_t n = copy_file_range(fd_in, off_in, fd_out, off_out, len, flags);
+    stats_sys(STAT_SYS_WRITE, n, n);
+    return n;
+}
+
+//upper bound in microseconds of the bucket holding the pct percentile
+static long long stats_percentile(op_stats_t *st, int pct){
+    long long want = (st->calls * pct + 99) / 100;
+    long long seen = 0;
+
+    for (int b = 0; b < STAT_HIST_BUCKETS; b++) {
+        seen += st->hist[b];
+        if (seen >= want)
+            return 1LL << b;
+    }
+    return 1LL << (STAT_HIST_BUCKETS - 1);
+}
+
+static void stats_report(void){
+    fflush(stdout);
+    if (stats_mode == STATS_SUMMARY) {
+        fprintf(stderr, STATS_PRINT_HDR_STRING, "OP", "CALLS", "TOTAL_MS",
+                "P50_US", "P99_US", "READS", "WRITES", "LSEEKS", "LOCKS",
+                "BYTES_RD", "BYTES_WR");
+    }
+
+    for (int op = 0; op < N_STAT_OPS; op++) {
+        op_stats_t *st = &stats[op];
+        long long nsys = 0;
+        for (int k = 0; k < N_STAT_SYS; k++)
+            nsys += st->sys[k];
+        if (st->calls == 0 && nsys == 0)
+            continue;
+
+        long long p50 = st->calls ? stats_percentile(st, 50) : 0;
+        long long p99 = st->calls ? stats_percentile(st, 99) : 0;
+
+        if (stats_mode == STATS_SUMMARY) {
+            fprintf(stderr, STATS_PRINT_FMT_STRING, stat_op_names[op],
+                    st->calls, st->total_ns / 1000000.0, p50, p99,
+                    st->sys[STAT_SYS_READ], st->sys[STAT_SYS_WRITE],
+                    st->sys[STAT_SYS_LSEEK], st->sys[STAT_SYS_LOCK],
+                    st->bytes_read, st->bytes_written);
+            continue;
+        }
+
+        fprintf(stderr, "{\"op\":\"%s\",\"calls\":%lld,\"total_ms\":%.3f,"
+                "\"p50_us\":%lld,\"p99_us\":%lld,\"reads\":%lld,\"writes\":%lld,"
+                "\"lseeks\":%lld,\"locks\":%lld,\"bytes_read\":%lld,"
+                "\"bytes_written\":%lld,\"hist_us\":[",
+                stat_op_names[op], st->calls, st->total_ns / 1000000.0, p50, p99,
+                st->sys[STAT_SYS_READ], st->sys[STAT_SYS_WRITE],
+                st->sys[STAT_SYS_LSEEK], st->sys[STAT_SYS_LOCK],
+                st->bytes_read, st->bytes_written);
+        for (int b = 0; b < STAT_HIST_BUCKETS; b++)
+            fprintf(stderr, "%s%lld", b ? "," : "", st->hist[b]);
+        fprintf(stderr, "]}\n");
+    }
+}
@@ -1,27 +1,82 @@
+#define _GNU_SOURCE     //needed for O_DIRECT
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>      //c library for system call file routines
 #include <string.h>
+#include <stddef.h>     //offsetof()
 #include <sys/stat.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <limits.h>     //PATH_MAX
+#include <sys/file.h>   //flock()
+#include <sys/ioctl.h>
+#include <sys/inotify.h>
+#include <linux/fs.h>   //FICLONE
 
 //database include files
 #include "db.h"
 #include "sdbsc.h"
 
+//I/O mode used for full scans and bulk loads, see set_io_mode()
+static int db_io_mode = IO_MODE_BUFFERED;
+
+//storage engine used by open_db(), see set_engine()
+static const sdb_engine_t *db_engine = &file_engine;
+
+//every engine the CLI and the benchmarks know about, default first
+const sdb_engine_t *sdb_engines[] = { &file_engine, &mmap_engine, &hash_engine,
+                                      &compact_engine, &block_engine, &shard_engine,
+                                      &shm_engine, NULL };
+
 /*
- *  open_db
+ *  set_engine
+ *      name:  storage engine name, NULL selects the default engine
+ *
+ *  Picks the storage engine that later open_db() calls will use.  The
+ *  file, mmap and hash engines keep the student.db layout on disk, so a
+ *  database written by one of them can be read by the others.  The
+ *  compact, block, shard and shm engines set own_layout and store records
+ *  their own way, in files named after the database or in the daemon's
+ *  shared memory.  compress_db() and zero_db() rebuild those through
+ *  rebuild_db() and rebuild_files(), or with the engine's compact when it
+ *  has one, so open a database with the engine that wrote it.
+ *
+ *  returns:  NO_ERROR        on success
+ *            EXIT_FAIL_ARGS  if no engine has that name
+ *
+ *  console:  M_ERR_ENGINE    if no engine has that name
+ */
+int set_engine(char *name){
+    if (name == NULL) {
+        db_engine = sdb_engines[0];
+        return NO_ERROR;
+    }
+
+    for (int i = 0; sdb_engines[i] != NULL; i++) {
+        if (strcmp(name, sdb_engines[i]->name) == 0) {
+            db_engine = sdb_engines[i];
+            return NO_ERROR;
+        }
+    }
+
+    printf(M_ERR_ENGINE, name);
+    return EXIT_FAIL_ARGS;
+}
+
+/*
+ *  open_db_file
  *      dbFile:  name of the database file
  *      should_truncate:  indicates if opening the file also empties it
  * 
+ *  Opens the file behind a database, used by the storage engines.
+ *
  *  returns:  File descriptor on success, or ERR_DB_FILE on failure
  * 
- *  console:  Does not produce any console I/O on success
- *            M_ERR_DB_OPEN on error
+ *  console:  Does not produce any console I/O
  *             
  */
-int open_db(char *dbFile, bool should_truncate){
+int open_db_file(char *dbFile, bool should_truncate){
     // Set permissions: rw-rw----
     // see sys/stat.h for constants
     mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
@@ -37,17 +92,291 @@ int open_db(char *dbFile, bool should_truncate){
     int fd = open(dbFile, flags, mode);
 
     if (fd == -1) {
+        return ERR_DB_FILE;
+    }
+
+    return fd;
+}
+
+/*
+ *  open_db
+ *      db:      handle to fill in
+ *      dbFile:  name of the database file
+ *      should_truncate:  indicates if opening the file also empties it
+ * 
+ *  Opens the database with the storage engine picked by set_engine().
+ *  Every other database function takes the handle filled in here, and
+ *  close_db() releases it.
+ *
+ *  returns:  NO_ERROR on success, or ERR_DB_FILE on failure
+ * 
+ *  console:  Does not produce any console I/O on success
+ *            M_ERR_DB_OPEN on error
+ *             
+ */
+int open_db(sdb_t *db, char *dbFile, bool should_truncate){
+    memset(db, 0, sizeof(sdb_t));
+    db->engine = db_engine;
+    db->path = dbFile;
+    db->fd = -1;
+    db->cdc_fd = -1;
+
+    if (db->engine->open(db, dbFile, should_truncate) != NO_ERROR) {
         // Handle the error
         printf(M_ERR_DB_OPEN);
         return ERR_DB_FILE;
     }
 
+    return NO_ERROR;
+}
+
+void close_db(sdb_t *db){
+    db->engine->close(db);
+    db->fd = -1;
+    if (db->cdc_fd >= 0)
+        close(db->cdc_fd);
+    db->cdc_fd = -1;
+}
+
+//close and open again with the same engine, after the file was replaced
+//or truncated underneath it
+static int reopen_db(sdb_t *db){
+    db->engine->close(db);
+    db->fd = -1;
+    return db->engine->open(db, db->path, false);
+}
+
+/*
+ *  sync_db
+ *      db:  database handle from open_db()
+ *
+ *  Writes changes an engine is holding in memory back to the database
+ *  file.  Engines that write the file as they go have nothing to do.
+ *
+ *  returns:  NO_ERROR on success, or ERR_DB_FILE on failure
+ *
+ *  console:  Does not produce any console I/O
+ */
+int sync_db(sdb_t *db){
+    if (db->engine->sync == NULL)
+        return NO_ERROR;
+    return db->engine->sync(db);
+}
+
+//The file level features below (bulk load, snapshots) work on
+//db->fd directly.  FILE_OP() syncs an engine that keeps records in memory
+//when the feature starts, and loads it again from the file on every
+//return path so it sees what the feature wrote.
+static sdb_t *file_op_begin(sdb_t *db){
+    if (sync_db(db) != NO_ERROR)
+        printf(M_ERR_DB_WRITE);
+    return db;
+}
+
+static void file_op_end(sdb_t **db){
+    if ((*db)->engine->sync != NULL && reopen_db(*db) != NO_ERROR)
+        printf(M_ERR_DB_OPEN);
+}
+
+#define FILE_OP(db) \
+    sdb_t *file_op __attribute__((cleanup(file_op_end), unused)) = file_op_begin(db)
+
+/*
+ *  db_lock / db_unlock
+ *      fd:     linux file descriptor
+ *
+ *  Every operation that writes the database holds an exclusive flock() on
+ *  it for the duration of the write.  Writes are short, so this mostly
+ *  matters to snapshot_db(), which takes the same lock to pick its point in
+ *  time and again to finish, knowing that no write is half done either time.
+ *  The change feed is appended under the same lock so its order matches
+ *  the order the writes were applied in, see cdc_emit().
+ *
+ *  returns:  NO_ERROR     the lock is held
+ *            ERR_DB_FILE  the lock could not be taken
+ */
+int db_lock(int fd){
+    while (sdb_flock(fd, LOCK_EX) == -1) {
+        if (errno != EINTR)
+            return ERR_DB_FILE;
+    }
+
+    // compress_db() swaps in a new file under this lock, writing to the
+    // old one afterwards would silently lose the change
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_nlink == 0) {
+        sdb_flock(fd, LOCK_UN);
+        return ERR_DB_FILE;
+    }
+    return NO_ERROR;
+}
+
+void db_unlock(int fd){
+    sdb_flock(fd, LOCK_UN);
+}
+
+/*
+ *  record_lock / record_unlock
+ *      db:  database handle from open_db()
+ *      id:  student about to be written
+ *
+ *  The write lock for changing one student.  That is db_lock() on db->fd,
+ *  unless the engine splits the records over several files, in which case
+ *  db->fd is only locked shared and the file holding id exclusively, see
+ *  lock_fd in sdbsc.h.  Writers to different files then run side by side,
+ *  and operations on the whole database still shut them all out with
+ *  db_lock(db->fd).
+ *
+ *  returns:  the descriptor to pass to record_unlock(), or ERR_DB_FILE
+ */
+static int record_lock(sdb_t *db, int id){
+    if (db->engine->lock_fd == NULL)
+        return (db_lock(db->fd) == NO_ERROR) ? db->fd : ERR_DB_FILE;
+
+    while (sdb_flock(db->fd, LOCK_SH) == -1) {
+        if (errno != EINTR)
+            return ERR_DB_FILE;
+    }
+    int fd = db->engine->lock_fd(db, id);
+    if (db_lock(fd) != NO_ERROR) {
+        sdb_flock(db->fd, LOCK_UN);
+        return ERR_DB_FILE;
+    }
     return fd;
 }
 
+static void record_unlock(sdb_t *db, int fd){
+    db_unlock(fd);
+    if (fd != db->fd)
+        sdb_flock(db->fd, LOCK_UN);
+}
+
+//name of the file with extension ext kept next to the database dbFile
+static int db_side_file(const char *dbFile, const char *ext, char *name, size_t len){
+    return (snprintf(name, len, "%s%s", dbFile, ext) < (int)len) ? NO_ERROR : ERR_DB_FILE;
+}
+
+/*
+ *  snap_log_range
+ *      dbFile: name of the database fd belongs to
+ *      fd:     linux file descriptor, locked with db_lock()
+ *      offset: first byte about to be overwritten
+ *      len:    number of bytes about to be overwritten
+ *
+ *  Copy-on-write half of snapshot_db().  While a snapshot copy is running
+ *  dbFile plus SNAP_LOG_EXT exists, and every writer must append the
+ *  current contents (the before image) of each page it is about to change.
+ *  Writes to other databases never touch it.  The snapshot later puts
+ *  those before images back over whatever its copy picked up, which yields
+ *  the database as it was when the snapshot began.  When no snapshot is
+ *  running this costs a single failed open().
+ *
+ *  returns:  NO_ERROR     no snapshot running, or before images logged
+ *            ERR_DB_FILE  logging failed, the caller must not write
+ */
+int snap_log_range(const char *dbFile, int fd, off_t offset, off_t len){
+    char log_name[PATH_MAX];
+    if (db_side_file(dbFile, SNAP_LOG_EXT, log_name, sizeof(log_name)) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    int log_fd = open(log_name, O_WRONLY | O_APPEND);
+    if (log_fd == -1)
+        return (errno == ENOENT) ? NO_ERROR : ERR_DB_FILE;
+
+    snap_log_entry_t entry;
+    off_t first = offset & ~(off_t)(DB_PAGE_SIZE - 1);
+    int rc = NO_ERROR;
+
+    for (off_t page = first; page < offset + len; page += DB_PAGE_SIZE) {
+        ssize_t n = sdb_pread(fd, entry.page, DB_PAGE_SIZE, page);
+        if (n < 0) {
+            rc = ERR_DB_FILE;
+            break;
+        }
+        memset(entry.page + n, 0, DB_PAGE_SIZE - n);
+        entry.offset = page;
+
+        if (sdb_write(log_fd, &entry, sizeof(entry)) != sizeof(entry)) {
+            rc = ERR_DB_FILE;
+            break;
+        }
+    }
+
+    close(log_fd);
+    return rc;
+}
+
+/*
+ *  cdc_emit
+ *      db:       database handle from open_db(), holds the open feed
+ *      entries:  change records to append, seq is filled in here
+ *      n:        number of entries
+ *
+ *  Appends to the change feed, the file named after the database with
+ *  CDC_EXT added, so caches and other followers can stay current without
+ *  rescanning the database.  Entry N of the feed always lives at offset
+ *  (N-1) * sizeof(cdc_entry_t), which lets a follower remember the last
+ *  sequence number it saw and pread() from there, or wait on inotify for
+ *  the file to grow, see tail_cdc().
+ *
+ *  Callers hold db_lock(), the feed also has its own flock() so followers
+ *  never see it torn.  The next sequence number comes from the feed size
+ *  rounded down to whole entries, so a partial entry left behind by a
+ *  crash is simply overwritten by the next change.
+ *
+ *  returns:  NO_ERROR     entries appended
+ *            ERR_DB_FILE  the feed could not be written
+ */
+static int cdc_emit(sdb_t *db, cdc_entry_t *entries, int n){
+    if (n == 0)
+        return NO_ERROR;
+
+    if (db->cdc_fd == -1) {
+        char cdc_name[PATH_MAX];
+        if (db_side_file(db->path, CDC_EXT, cdc_name, sizeof(cdc_name)) != NO_ERROR)
+            return ERR_DB_FILE;
+        db->cdc_fd = open(cdc_name, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+        if (db->cdc_fd == -1)
+            return ERR_DB_FILE;
+    }
+
+    while (sdb_flock(db->cdc_fd, LOCK_EX) == -1) {
+        if (errno != EINTR)
+            return ERR_DB_FILE;
+    }
+
+    int rc = NO_ERROR;
+    struct stat st;
+    if (fstat(db->cdc_fd, &st) == -1) {
+        rc = ERR_DB_FILE;
+    } else {
+        long long next = st.st_size / sizeof(cdc_entry_t);
+        for (int i = 0; i < n; i++)
+            entries[i].seq = next + 1 + i;
+
+        ssize_t len = n * sizeof(cdc_entry_t);
+        if (sdb_pwrite(db->cdc_fd, entries, len, next * sizeof(cdc_entry_t)) != len)
+            rc = ERR_DB_FILE;
+    }
+
+    sdb_flock(db->cdc_fd, LOCK_UN);
+    return rc;
+}
+
+//append a single change, s is NULL for changes without a record
+static int cdc_emit_one(sdb_t *db, int op, int id, const student_t *s){
+    cdc_entry_t entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.op = op;
+    entry.id = id;
+    if (s != NULL)
+        entry.record = *s;
+    return cdc_emit(db, &entry, 1);
+}
+
 /*
  *  get_student
- *      fd:  linux file descriptor
+ *      db:  database handle from open_db()
  *      id:  the student id we are looking forname of the
  *      *s:  a pointer where the located (if found) student data will be
  *           copied
@@ -58,36 +387,25 @@ int open_db(char *dbFile, bool should_truncate){
  * 
  *  console:  Does not produce any console I/O used by other functions
  */
-int get_student(int fd, int id, student_t *s){
+int get_student(sdb_t *db, int id, student_t *s){
+    STATS_OP(STAT_OP_GET);
     // Validate the ID range
     if (id < MIN_STD_ID || id > MAX_STD_ID) {
         return SRCH_NOT_FOUND;
     }
 
-    // Seek to the correct positon on file
-    int offset = id * STUDENT_RECORD_SIZE;
-    if (lseek(fd, offset, SEEK_SET) == -1) {
-        printf(M_ERR_DB_READ);
-        return ERR_DB_FILE;
-    }
-
-    // Read the student record at the calculated position
-    if (read(fd, s, STUDENT_RECORD_SIZE) != STUDENT_RECORD_SIZE) {
+    // Let the storage engine find the record
+    int rc = db->engine->get(db, id, s);
+    if (rc == ERR_DB_FILE) {
         printf(M_ERR_DB_READ);
-        return ERR_DB_FILE;
-    }
-
-    // Check if the record is "empty"
-    if (s->id == 0) {
-        return SRCH_NOT_FOUND;
     }
 
-    return NO_ERROR;
+    return rc;
 }
 
 /*
  *  add_student
- *      fd:     linux file descriptor
+ *      db:     database handle from open_db()
  *      id:     student id (range is defined in db.h )
  *      fname:  student first name
  *      lname:  student last name
@@ -110,46 +428,50 @@ int get_student(int fd, int id, student_t *s){
  *            M_ERR_DB_WRITE    error writing to db file (adding student)
  *            M_ERR_STD_RNG     student ID or GPA out of range
  */
-int add_student(int fd, int id, char *fname, char *lname, int gpa){
+int add_student(sdb_t *db, int id, char *fname, char *lname, int gpa){
+    STATS_OP(STAT_OP_ADD);
     // Validate the ID and GPA range
     if (validate_range(id, gpa) != NO_ERROR) {
         printf(M_ERR_STD_RNG);
         return ERR_DB_OP;
     }
 
-    // Seek to the correct position on the file
-    int offset = id * STUDENT_RECORD_SIZE;
-    if (lseek(fd, offset, SEEK_SET) == -1) {
-        printf(M_ERR_DB_READ);
+    // Hold the write lock from the duplicate check until the write is done
+    int lock_fd = record_lock(db, id);
+    if (lock_fd < 0) {
+        printf(M_ERR_DB_WRITE);
         return ERR_DB_FILE;
     }
 
     // Check if a record already exists at this position
     student_t student;
-    if (read(fd, &student, STUDENT_RECORD_SIZE) == STUDENT_RECORD_SIZE) {
-        if (student.id != DELETED_STUDENT_ID) {
-            printf(M_ERR_DB_ADD_DUP, id);
-            return ERR_DB_OP;
-        }
+    int rc = db->engine->get(db, id, &student);
+    if (rc == NO_ERROR) {
+        printf(M_ERR_DB_ADD_DUP, id);
+        record_unlock(db, lock_fd);
+        return ERR_DB_OP;
     }
-
-    // Seek back to the calculated position
-    if (lseek(fd, offset, SEEK_SET) == -1) {
-        printf(M_ERR_DB_WRITE);
+    if (rc != SRCH_NOT_FOUND) {
+        printf(M_ERR_DB_READ);
+        record_unlock(db, lock_fd);
         return ERR_DB_FILE;
     }
 
     // Create the student
+    student = EMPTY_STUDENT_RECORD;
     student.id = id;
     strncpy(student.fname, fname, sizeof(student.fname) - 1);
     strncpy(student.lname, lname, sizeof(student.lname) - 1);
     student.gpa = gpa;
 
-    // Write the new student record to the file
-    if (write(fd, &student, STUDENT_RECORD_SIZE) != STUDENT_RECORD_SIZE) {
+    // Write the new student record through the storage engine
+    if (db->engine->put(db, &student) != NO_ERROR ||
+        cdc_emit_one(db, CDC_OP_ADD, id, &student) != NO_ERROR) {
         printf(M_ERR_DB_WRITE);
+        record_unlock(db, lock_fd);
         return ERR_DB_FILE;
     }
+    record_unlock(db, lock_fd);
 
     printf(M_STD_ADDED, id);
     return NO_ERROR;
@@ -157,7 +479,7 @@ int add_student(int fd, int id, char *fname, char *lname, int gpa){
 
 /*
  *  del_student
- *      fd:     linux file descriptor
+ *      db:     database handle from open_db()
  *      id:     student id to be deleted
  * 
  *  Removes a student to the database.  Use the get_student() function to
@@ -177,37 +499,341 @@ int add_student(int fd, int id, char *fname, char *lname, int gpa){
  *            M_ERR_DB_WRITE     error writing to db file (adding student)
  *            
  */
-int del_student(int fd, int id){
+int del_student(sdb_t *db, int id){
+    STATS_OP(STAT_OP_DEL);
+    // Hold the write lock from the lookup until the write is done
+    int lock_fd = record_lock(db, id);
+    if (lock_fd < 0) {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+
     // Get the student record
     student_t student;
-    int rc = get_student(fd, id, &student);
+    int rc = get_student(db, id, &student);
 
     // Check if the student was found
     if (rc == SRCH_NOT_FOUND) {
         printf(M_STD_NOT_FND_MSG, id);
+        record_unlock(db, lock_fd);
         return ERR_DB_OP;
     }
-
-    // Seek to the correct position on the file
-    int offset = id * STUDENT_RECORD_SIZE;
-    if (lseek(fd, offset, SEEK_SET) == -1) {
-        printf(M_ERR_DB_READ);
+    if (rc != NO_ERROR) {
+        record_unlock(db, lock_fd);
         return ERR_DB_FILE;
     }
 
-    // Write an empty student record to the file
-    if (write(fd, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != STUDENT_RECORD_SIZE) {
+    // Replace the student with an empty record through the storage engine
+    if (db->engine->del(db, id) != NO_ERROR ||
+        cdc_emit_one(db, CDC_OP_DEL, id, NULL) != NO_ERROR) {
         printf(M_ERR_DB_WRITE);
+        record_unlock(db, lock_fd);
         return ERR_DB_FILE;
     }
+    record_unlock(db, lock_fd);
 
     printf(M_STD_DEL_MSG, id);
     return NO_ERROR;
 }
 
 /*
- *  count_db_records
+ *  set_io_mode
+ *      mode:  "buffered", "nocache" or "direct", NULL selects "buffered"
+ *
+ *  Selects how scan_db() and bulk_load_db() move data between the
+ *  database file and memory.  Plain buffered I/O leaves every page of a
+ *  long scan in the page cache, evicting data other programs on the same
+ *  machine were using.  The nocache mode still reads through the cache
+ *  but tells the kernel to drop each chunk once it has been consumed, and
+ *  the direct mode skips the cache altogether with O_DIRECT.
+ *
+ *  returns:  NO_ERROR        on success
+ *            EXIT_FAIL_ARGS  if mode is not one of the names above
+ *
+ *  console:  M_ERR_IO_MODE   if mode is not one of the names above
+ */
+int set_io_mode(char *mode){
+    if (mode == NULL || strcmp(mode, "buffered") == 0) {
+        db_io_mode = IO_MODE_BUFFERED;
+    } else if (strcmp(mode, "nocache") == 0) {
+        db_io_mode = IO_MODE_NOCACHE;
+    } else if (strcmp(mode, "direct") == 0) {
+        db_io_mode = IO_MODE_DIRECT;
+    } else {
+        printf(M_ERR_IO_MODE, mode);
+        return EXIT_FAIL_ARGS;
+    }
+
+    return NO_ERROR;
+}
+
+/*
+ *  io_begin / io_end
  *      fd:     linux file descriptor
+ *
+ *  Bracket a scan or bulk load.  In direct mode O_DIRECT is switched on
+ *  for the descriptor with fcntl() so the rest of the program keeps using
+ *  normal buffered I/O.  File systems such as tmpfs refuse O_DIRECT; in
+ *  that case we quietly fall back to the nocache behaviour.  io_begin()
+ *  returns the I/O mode that is actually in effect and io_end() puts the
+ *  descriptor flags back.
+ */
+static int io_begin(int fd, int *saved_flags){
+    *saved_flags = -1;
+
+    if (db_io_mode == IO_MODE_DIRECT) {
+        int flags = fcntl(fd, F_GETFL);
+        if (flags != -1 && fcntl(fd, F_SETFL, flags | O_DIRECT) == 0) {
+            *saved_flags = flags;
+            return IO_MODE_DIRECT;
+        }
+    }
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return (db_io_mode == IO_MODE_BUFFERED) ? IO_MODE_BUFFERED : IO_MODE_NOCACHE;
+}
+
+static void io_end(int fd, int saved_flags){
+    if (saved_flags != -1) {
+        fcntl(fd, F_SETFL, saved_flags);
+    } else {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_NORMAL);
+    }
+}
+
+/*
+ *  file engine
+ *
+ *  The default storage engine, plain pread()/pwrite() on the database
+ *  file.  Student id N lives at byte offset N * STUDENT_RECORD_SIZE and an
+ *  all zero record is an empty slot, so the file is sparse and a lookup is
+ *  one system call.
+ *
+ *  The only state is the access pattern of recent gets, which drives
+ *  file_readahead().
+ */
+typedef struct file_state {
+    bool readahead;         //false with SDB_READAHEAD=off
+    int last_id;            //id of the previous get
+    int run;                //forward steps in a row
+    off_t ra_end;           //end of the range already asked for
+    off_t ra_window;        //bytes to ask for next time
+} file_state_t;
+
+static int file_open(sdb_t *db, char *dbFile, bool should_truncate){
+    file_state_t *fs = calloc(1, sizeof(file_state_t));
+    if (fs == NULL)
+        return ERR_DB_FILE;
+
+    char *env = getenv(READAHEAD_ENV);
+    fs->readahead = (env == NULL || strcmp(env, "off") != 0);
+    fs->ra_window = READAHEAD_MIN;
+
+    db->fd = open_db_file(dbFile, should_truncate);
+    if (db->fd < 0) {
+        free(fs);
+        return ERR_DB_FILE;
+    }
+    db->state = fs;
+    return NO_ERROR;
+}
+
+/*
+ *  file_readahead
+ *
+ *  A get is one 64 byte pread(), and the kernel's own readahead only grows
+ *  once whole pages are read in order, so a batch job walking up the ids
+ *  waits on the disk about once per page.  Once READAHEAD_TRIGGER gets in
+ *  a row have each moved forward by at most READAHEAD_MAX_GAP ids, we ask
+ *  for the pages ahead with POSIX_FADV_WILLNEED, which starts the reads in
+ *  the background and returns.  The request goes out again when the
+ *  reader is half way through what was asked for last time, with the
+ *  window doubling up to READAHEAD_MAX, and any other move starts over.
+ *  The pages land in the page cache, so writes by other processes are
+ *  seen the same as without it.
+ */
+static void file_readahead(sdb_t *db, int id){
+    file_state_t *fs = db->state;
+    int gap = id - fs->last_id;
+    fs->last_id = id;
+
+    if (gap <= 0 || gap > READAHEAD_MAX_GAP) {
+        fs->run = 0;
+        fs->ra_end = 0;
+        fs->ra_window = READAHEAD_MIN;
+        return;
+    }
+    if (++fs->run < READAHEAD_TRIGGER)
+        return;
+
+    off_t offset = (off_t)id * STUDENT_RECORD_SIZE;
+    if (fs->ra_end - offset > fs->ra_window / 2)
+        return;
+
+    off_t start = offset & ~(off_t)(DB_PAGE_SIZE - 1);
+    if (start < fs->ra_end)
+        start = fs->ra_end;
+    posix_fadvise(db->fd, start, fs->ra_window, POSIX_FADV_WILLNEED);
+    fs->ra_end = start + fs->ra_window;
+    if (fs->ra_window < READAHEAD_MAX)
+        fs->ra_window *= 2;
+}
+
+static int file_get(sdb_t *db, int id, student_t *s){
+    if (((file_state_t *)db->state)->readahead)
+        file_readahead(db, id);
+
+    ssize_t n = sdb_pread(db->fd, s, STUDENT_RECORD_SIZE, (off_t)id * STUDENT_RECORD_SIZE);
+    if (n < 0)
+        return ERR_DB_FILE;
+
+    // Slots past the end of the file were never written
+    if (n != STUDENT_RECORD_SIZE || s->id == DELETED_STUDENT_ID)
+        return SRCH_NOT_FOUND;
+
+    return NO_ERROR;
+}
+
+static int file_put(sdb_t *db, student_t *s){
+    off_t offset = (off_t)s->id * STUDENT_RECORD_SIZE;
+    if (snap_log_range(db->path, db->fd, offset, STUDENT_RECORD_SIZE) != NO_ERROR ||
+        sdb_pwrite(db->fd, s, STUDENT_RECORD_SIZE, offset) != STUDENT_RECORD_SIZE)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+static int file_del(sdb_t *db, int id){
+    off_t offset = (off_t)id * STUDENT_RECORD_SIZE;
+    if (snap_log_range(db->path, db->fd, offset, STUDENT_RECORD_SIZE) != NO_ERROR ||
+        sdb_pwrite(db->fd, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE, offset) != STUDENT_RECORD_SIZE)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+/*
+ *  file_scan
+ *
+ *  Walks the ids from min_id to max_id in SCAN_BUFFER_SZ chunks instead of
+ *  one read() per record, calling fn() for every slot that is not all zeros.
+ *  Chunks start on a page boundary and the chunk buffer comes from
+ *  posix_memalign(), so the same loop works with O_DIRECT, see
+ *  set_io_mode().
+ */
+static int file_scan(sdb_t *db, int min_id, int max_id, scan_fn_t fn, void *arg){
+    int fd = db->fd;
+    char *buff;
+    if (posix_memalign((void **)&buff, DB_PAGE_SIZE, SCAN_BUFFER_SZ) != 0) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    int saved_flags;
+    int mode = io_begin(fd, &saved_flags);
+
+    int rc = NO_ERROR;
+    off_t first = (off_t)min_id * STUDENT_RECORD_SIZE;
+    off_t last = (off_t)max_id * STUDENT_RECORD_SIZE;
+    off_t offset = first & ~(off_t)(DB_PAGE_SIZE - 1);
+    off_t end = (last + STUDENT_RECORD_SIZE + DB_PAGE_SIZE - 1) & ~(off_t)(DB_PAGE_SIZE - 1);
+    ssize_t n = 0;
+    ssize_t want = 0;
+    while (rc == NO_ERROR && offset <= last) {
+        // Stop at the page holding max_id so narrow ranges read little
+        want = (end - offset < SCAN_BUFFER_SZ) ? end - offset : SCAN_BUFFER_SZ;
+        if ((n = sdb_pread(fd, buff, want, offset)) <= 0)
+            break;
+
+        for (ssize_t i = 0; i + STUDENT_RECORD_SIZE <= n; i += STUDENT_RECORD_SIZE) {
+            if (offset + i < first || offset + i > last)
+                continue;
+
+            student_t *student = (student_t *)(buff + i);
+            if (memcmp(student, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0) {
+                rc = fn(student, arg);
+                if (rc != NO_ERROR)
+                    break;
+            }
+        }
+
+        if (mode == IO_MODE_NOCACHE)
+            posix_fadvise(fd, offset, n, POSIX_FADV_DONTNEED);
+
+        // A short read means we hit EOF, and with O_DIRECT the next offset
+        // would no longer be aligned anyway
+        offset += n;
+        if (n < want)
+            break;
+    }
+
+    if (n < 0) {
+        printf(M_ERR_DB_READ);
+        rc = ERR_DB_FILE;
+    }
+
+    io_end(fd, saved_flags);
+    free(buff);
+    return rc;
+}
+
+static void file_close(sdb_t *db){
+    free(db->state);
+    db->state = NULL;
+    if (db->fd >= 0)
+        close(db->fd);
+}
+
+const sdb_engine_t file_engine = {
+    .name   = "file",
+    .open   = file_open,
+    .get    = file_get,
+    .put    = file_put,
+    .del    = file_del,
+    .scan   = file_scan,
+    .close  = file_close,
+};
+
+/*
+ *  scan_db
+ *      db:      database handle from open_db()
+ *      min_id:  first student id of interest
+ *      max_id:  last student id of interest
+ *      fn:      callback invoked for every student in that range, in id order
+ *      arg:     passed through to fn
+ *
+ *  Visits the students with the storage engine's scan.  If fn() returns
+ *  anything other than NO_ERROR the scan stops and that value is returned.
+ *
+ *  returns:  NO_ERROR       on success
+ *            ERR_DB_FILE    database file I/O issue
+ *            <other>        whatever fn() returned to stop the scan
+ *
+ *  console:  M_ERR_DB_READ  error reading the database file
+ */
+int scan_db(sdb_t *db, int min_id, int max_id, scan_fn_t fn, void *arg){
+    return db->engine->scan(db, min_id, max_id, fn, arg);
+}
+
+//scan_db() callbacks used by count_db_records() and print_db()
+static int count_record(student_t *s, void *arg){
+    (void)s;
+    (*(int *)arg)++;
+    return NO_ERROR;
+}
+
+static int print_record(student_t *s, void *arg){
+    int *header_printed = arg;
+    if (!*header_printed) {
+        printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME", "LAST_NAME", "GPA");
+        *header_printed = 1;
+    }
+    printf(STUDENT_PRINT_FMT_STRING, s->id, s->fname, s->lname, s->gpa / 100.0);
+    return NO_ERROR;
+}
+
+/*
+ *  count_db_records
+ *      db:     database handle from open_db()
+ *      filter: only count the students that match, NULL counts everyone
  * 
  *  Counts the number of records in the database.  Start by reading the 
  *  database at the beginning, and continue reading individual records
@@ -225,192 +851,1961 @@ int del_student(int fd, int id){
  * 
  *  console:  M_DB_RECORD_CNT  on success, to report the number of students in db
  *            M_DB_EMPTY       on success if the record count in db is zero
+ *            M_DB_MATCH_CNT   instead of the above when there is a filter
+ *            M_DB_NO_MATCH    when there is a filter and nobody matches
  *            M_ERR_DB_READ    error reading or seeking the database file
  *            M_ERR_DB_WRITE   error writing to db file (adding student)
  *            
  */
-int count_db_records(int fd){
-    // Seek to the beginning of the file
-    if (lseek(fd, 0, SEEK_SET) == -1) {
-        printf(M_ERR_DB_READ);
+int count_db_records(sdb_t *db, filter_t *filter){
+    STATS_OP(STAT_OP_COUNT);
+    // Count the number of records in the database
+    int count = 0;
+    int rc = scan_filtered(db, filter, count_record, &count);
+    if (rc < 0) {
+        return rc;
+    }
+
+    // Print the number of records in the database
+    if (filter != NULL) {
+        printf(count ? M_DB_MATCH_CNT : M_DB_NO_MATCH, count);
+    } else if (count == 0) {
+        printf(M_DB_EMPTY);
+    } else {
+        printf(M_DB_RECORD_CNT, count);
+    }
+
+    return count;
+}
+
+/*
+ *  print_db
+ *      db:     database handle from open_db()
+ *      filter: only print the students that match, NULL prints everyone
+ * 
+ *  Prints all records in the database.  Start by reading the 
+ *  database at the beginning, and continue reading individual records
+ *  until you it EOF.  EOF is when the read() syscall returns 0. Check
+ *  if a slot is empty or previously deleted by investigating if all of 
+ *  the bytes in the record read are zeros - I would suggest using memory
+ *  compare memcmp() for this. Be careful as the database might be empty.
+ *  on the first real row encountered print the header for the required output:
+ * 
+ *     printf(STUDENT_PRINT_HDR_STRING, "ID", 
+ *                  "FIRST NAME", "LAST_NAME", "GPA");
+ * 
+ *  then for each valid record encountered print the required output: 
+ * 
+ *     printf(STUDENT_PRINT_FMT_STRING, student.id, student.fname, 
+ *                    student.lname, calculated_gpa_from_student);
+ * 
+ *  The code above assumes you are reading student records into a local
+ *  variable named student that is of type student_t. Also dont forget that
+ *  the GPA in the student structure is an int, to convert it into a real
+ *  gpa divide by 100.0 and store in a float variable.
+ * 
+ *  returns:  NO_ERROR       on success
+ *            ERR_DB_FILE    database file I/O issue
+ * 
+ * 
+ *  console:  <see above>      on success, print table or database empty
+ *            M_DB_NO_MATCH    instead of database empty when there is a filter
+ *            M_ERR_DB_READ    error reading or seeking the database file
+ *            
+ */
+int print_db(sdb_t *db, filter_t *filter){
+    STATS_OP(STAT_OP_PRINT);
+    // Print all records in the database
+    int header_printed = 0;
+    int rc = scan_filtered(db, filter, print_record, &header_printed);
+    if (rc < 0) {
+        return rc;
+    }
+
+    // If database is empty, print a message
+    if (header_printed == 0) {
+        printf(filter ? M_DB_NO_MATCH : M_DB_EMPTY);
+    }
+
+    return NO_ERROR;
+}
+
+/*
+ *  print_student
+ *      *s:   a pointer to a student_t structure that should
+ *            contain a valid student to be printed
+ * 
+ *  Start by ensuring that provided student pointer is valid.  To do this
+ *  make sure it is not NULL and that s->id is not zero.  After ensuring 
+ *  that the student is valid, print it the exact way that is described
+ *  in the print_db() function by first printing the header then the
+ *  student data:
+ * 
+ *     printf(STUDENT_PRINT_HDR_STRING, "ID", 
+ *                  "FIRST NAME", "LAST_NAME", "GPA");
+ * 
+ *     printf(STUDENT_PRINT_FMT_STRING, s->id, s->fname, 
+ *                    student.lname, calculated_gpa_from_s);
+ * 
+ *  Dont forget that  the GPA in the student structure is an int, to convert 
+ *  it into a real gpa divide by 100.0 and store in a float variable. 
+ * 
+ *  returns:  nothing, this is a void function
+ * 
+ * 
+ *  console:  <see above>      on success, print table or database empty
+ *            M_ERR_STD_PRINT  if the function argument s is NULL or if
+ *                             s->id is zero
+ *            
+ */
+void print_student(student_t *s){
+    // Check if the student is valid
+    if (s == NULL || s->id == 0) {
+        printf(M_ERR_STD_PRINT);
+        return;
+    }
+
+    // Print the header for the student database
+    printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME", "LAST_NAME", "GPA");
+
+    // Print the student record
+    printf(STUDENT_PRINT_FMT_STRING, s->id, s->fname, s->lname, s->gpa / 100.0);
+}
+
+//compress_db() helpers, see compact_state_t in sdbsc.h
+static int compact_flush(compact_state_t *cs){
+    if (cs->len > 0 && sdb_pwrite(cs->tmp_fd, cs->buff, cs->len, cs->start) != cs->len)
+        return ERR_DB_FILE;
+    cs->start += cs->len;
+    cs->len = 0;
+    return NO_ERROR;
+}
+
+//scan_db() callback, batches runs of adjacent records into one write
+static int compact_record(student_t *s, void *arg){
+    compact_state_t *cs = arg;
+    off_t offset = (off_t)s->id * STUDENT_RECORD_SIZE;
+
+    if (offset != cs->start + cs->len || cs->len == SCAN_BUFFER_SZ) {
+        if (compact_flush(cs) != NO_ERROR)
+            return ERR_DB_FILE;
+        cs->start = offset;
+    }
+
+    memcpy(cs->buff + cs->len, s, STUDENT_RECORD_SIZE);
+    cs->len += STUDENT_RECORD_SIZE;
+    cs->end = offset + STUDENT_RECORD_SIZE;
+    return NO_ERROR;
+}
+
+/*
+ *  Engines with their own file layout
+ *
+ *  Engines that set own_layout in sdb_engine_t do not store records in the
+ *  student.db layout, so the file level features cannot patch pages or
+ *  copy db->fd for them.  The helpers below give those features the same
+ *  results through the engine's get, put and scan instead.  Callers hold
+ *  db_lock() unless noted.
+ */
+
+//growing array of students filled in by a scan
+typedef struct record_list {
+    student_t *records;
+    int count;
+    int capacity;
+} record_list_t;
+
+//scan_db() callback, appends every student to a record_list_t
+static int collect_record(student_t *s, void *arg){
+    record_list_t *list = arg;
+    if (list->count == list->capacity) {
+        list->capacity = (list->capacity == 0) ? 1024 : list->capacity * 2;
+        student_t *grown = realloc(list->records, list->capacity * sizeof(student_t));
+        if (grown == NULL)
+            return ERR_DB_FILE;
+        list->records = grown;
+    }
+    list->records[list->count++] = *s;
+    return NO_ERROR;
+}
+
+//puts students sorted by id, in one go if the engine can
+static int put_records(sdb_t *db, student_t *students, int count){
+    if (db->engine->put_many != NULL)
+        return db->engine->put_many(db, students, count);
+
+    for (int i = 0; i < count; i++) {
+        if (db->engine->put(db, &students[i]) != NO_ERROR)
+            return ERR_DB_FILE;
+    }
+    return NO_ERROR;
+}
+
+//defined with the snapshot code below
+static int copy_sparse(int src, int dst, off_t size);
+
+#define REBUILD_SEED        0   //copy the files open keeps to the new database
+#define REBUILD_SYNC        1   //fsync the new files
+#define REBUILD_RENAME      2   //move the new files over the old ones
+#define REBUILD_UNLINK      3   //remove what is left of the new files
+
+/*
+ *  rebuild_files
+ *      db:        database handle of the old database
+ *      tmp_path:  name the new database is built under
+ *      step:      REBUILD_* above
+ *
+ *  Does one step of rebuild_db() to every file the engine lists.  File i
+ *  of the new database has the name of file i of the old one with
+ *  tmp_path in place of db->path.  File 0 goes last, so it is the last
+ *  file renamed.
+ */
+static int rebuild_files(sdb_t *db, char *tmp_path, int step){
+    char name[PATH_MAX];
+    char tmp_name[PATH_MAX];
+    bool keep;
+    int n = 0;
+    int rc = NO_ERROR;
+
+    while (db->engine->files(db, n, name, sizeof(name), &keep) == NO_ERROR)
+        n++;
+
+    for (int k = 1; k <= n && rc == NO_ERROR; k++) {
+        db->engine->files(db, k % n, name, sizeof(name), &keep);
+        snprintf(tmp_name, sizeof(tmp_name), "%s%s", tmp_path, name + strlen(db->path));
+
+        int src = -1, dst = -1;
+        struct stat st;
+        switch (step) {
+            case REBUILD_SEED:
+                if (!keep)
+                    break;
+                src = open(name, O_RDONLY);
+                dst = open(tmp_name, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+                if (src == -1 || dst == -1 || fstat(src, &st) == -1 ||
+                    copy_sparse(src, dst, st.st_size) != NO_ERROR)
+                    rc = ERR_DB_FILE;
+                break;
+            case REBUILD_SYNC:
+                dst = open(tmp_name, O_RDONLY);
+                if (dst == -1 || fsync(dst) == -1)
+                    rc = ERR_DB_FILE;
+                break;
+            case REBUILD_RENAME:
+                if (rename(tmp_name, name) == -1)
+                    rc = ERR_DB_FILE;
+                break;
+            default:
+                unlink(tmp_name);
+                break;
+        }
+        if (src != -1)
+            close(src);
+        if (dst != -1)
+            close(dst);
+    }
+    return rc;
+}
+
+/*
+ *  rebuild_db
+ *      db:      database handle, locked with db_lock()
+ *      keep:    put the current students back into the rebuilt database
+ *      cdc_op:  change feed entry to emit once the rebuild is done
+ *
+ *  Compaction and zeroing for engines with their own layout.  The engine
+ *  is opened on a new database named db->path plus REBUILD_TMP_EXT, the
+ *  students are written to it when keep is set, and once its files are
+ *  synced they are renamed over the old ones while the lock is held.  The
+ *  old files are not touched before that, so a crash or a failed write
+ *  part way leaves the database as it was.  Engines without files of
+ *  their own are emptied in place instead, which is only done when
+ *  nothing is kept.  Closing the old handle releases the caller's lock,
+ *  so the caller must not call db_unlock() afterwards.
+ */
+static int rebuild_db(sdb_t *db, bool keep, int cdc_op){
+    record_list_t list = {0};
+    char *tmp_path = NULL;
+    int rc = NO_ERROR;
+
+    if (keep && db->engine->files == NULL)
+        rc = ERR_DB_OP;
+    if (rc == NO_ERROR && keep)
+        rc = scan_db(db, MIN_STD_ID, MAX_STD_ID, collect_record, &list);
+
+    sdb_t fresh = *db;
+    fresh.fd = -1;
+    fresh.cdc_fd = -1;
+    fresh.state = NULL;
+    if (rc == NO_ERROR && db->engine->files != NULL) {
+        tmp_path = malloc(strlen(db->path) + sizeof(REBUILD_TMP_EXT));
+        if (tmp_path == NULL) {
+            rc = ERR_DB_FILE;
+        } else {
+            sprintf(tmp_path, "%s%s", db->path, REBUILD_TMP_EXT);
+            fresh.path = tmp_path;
+            rc = rebuild_files(db, tmp_path, REBUILD_SEED);
+        }
+    }
+    if (rc == NO_ERROR && db->engine->open(&fresh, fresh.path, true) != NO_ERROR)
+        rc = ERR_DB_FILE;
+
+    if (rc == NO_ERROR)
+        rc = put_records(&fresh, list.records, list.count);
+    free(list.records);
+
+    if (rc == NO_ERROR && tmp_path != NULL)
+        rc = rebuild_files(db, tmp_path, REBUILD_SYNC);
+
+    // Up to here the old database is untouched and the new one can go.
+    // Writers that queue on the new files wait until the rename is done.
+    if (rc != NO_ERROR && tmp_path != NULL) {
+        if (fresh.fd >= 0)
+            close_db(&fresh);
+        fresh.fd = -1;
+        rebuild_files(db, tmp_path, REBUILD_UNLINK);
+    }
+    if (rc == NO_ERROR && tmp_path != NULL) {
+        rc = db_lock(fresh.fd);
+        if (rc == NO_ERROR)
+            rc = rebuild_files(db, tmp_path, REBUILD_RENAME);
+    }
+    fresh.path = db->path;
+    free(tmp_path);
+
+    if (rc == NO_ERROR)
+        rc = cdc_emit_one(db, cdc_op, 0, NULL);
+
+    if (fresh.fd < 0) {
+        db_unlock(db->fd);
+        return rc;
+    }
+    fresh.cdc_fd = db->cdc_fd;
+    db->cdc_fd = -1;
+    close_db(db);
+    db_unlock(fresh.fd);
+    *db = fresh;
+    return rc;
+}
+
+/*
+ *  put_new_records
+ *      db:        database handle from open_db(), not locked
+ *      students:  students to add, sorted by id
+ *      count:     number of students
+ *      failed:    incremented for every student that already exists
+ *
+ *  Bulk load for engines with their own layout, adds each student that is
+ *  not in the database yet through the engine.
+ *
+ *  returns:  number of students added, or ERR_DB_FILE
+ *
+ *  console:  M_ERR_DB_ADD_DUP  for every student that already exists
+ */
+static int put_new_records(sdb_t *db, student_t *students, int count, int *failed){
+    cdc_entry_t changes[RECORDS_PER_PAGE];
+    int loaded = 0;
+    int rc = NO_ERROR;
+    student_t current;
+
+    if (db_lock(db->fd) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    // Move the students that are not in the database yet to the front
+    for (int i = 0; i < count && rc == NO_ERROR; i++) {
+        rc = db->engine->get(db, students[i].id, &current);
+        if (rc == NO_ERROR) {
+            printf(M_ERR_DB_ADD_DUP, students[i].id);
+            (*failed)++;
+        } else if (rc == SRCH_NOT_FOUND) {
+            students[loaded++] = students[i];
+            rc = NO_ERROR;
+        }
+    }
+
+    if (rc == NO_ERROR)
+        rc = put_records(db, students, loaded);
+
+    for (int i = 0; i < loaded && rc == NO_ERROR; i += RECORDS_PER_PAGE) {
+        int changed = (loaded - i < RECORDS_PER_PAGE) ? loaded - i : RECORDS_PER_PAGE;
+        memset(changes, 0, sizeof(changes));
+        for (int c = 0; c < changed; c++) {
+            changes[c].op = CDC_OP_ADD;
+            changes[c].id = students[i + c].id;
+            changes[c].record = students[i + c];
+        }
+        rc = cdc_emit(db, changes, changed);
+    }
+
+    db_unlock(db->fd);
+    return (rc == NO_ERROR) ? loaded : ERR_DB_FILE;
+}
+
+//applies one field update to a student through the engine, the student
+//as it is after the change is copied to *s
+//Updates go through get and put for engines with their own layout, and
+//for engines holding records in memory, which would otherwise have to be
+//synced and loaded again around every patch of the file
+static bool patch_through_engine(sdb_t *db){
+    return db->engine->own_layout || db->engine->sync != NULL;
+}
+
+static int patch_record(sdb_t *db, field_update_t *u, student_t *s){
+    int rc = db->engine->get(db, u->id, s);
+    if (rc != NO_ERROR)
+        return rc;
+
+    memcpy((char *)s + u->offset, u->bytes, u->len);
+    return db->engine->put(db, s);
+}
+
+/*
+ *  patch_records
+ *      db:       database handle from open_db(), not locked
+ *      updates:  field updates sorted by id
+ *      count:    number of updates
+ *      failed:   incremented for every update of a missing student
+ *
+ *  Bulk update for engines with their own layout or records in memory.
+ *
+ *  returns:  number of updates applied, or ERR_DB_FILE
+ *
+ *  console:  M_STD_NOT_FND_MSG  for every update of a missing student
+ */
+static int patch_records(sdb_t *db, field_update_t *updates, int count, int *failed){
+    cdc_entry_t changes[RECORDS_PER_PAGE];
+    int changed = 0;
+    int applied = 0;
+    int rc = NO_ERROR;
+    student_t student;
+
+    if (db_lock(db->fd) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    for (int i = 0; i < count && rc == NO_ERROR; i++) {
+        rc = patch_record(db, &updates[i], &student);
+        if (rc == SRCH_NOT_FOUND) {
+            printf(M_STD_NOT_FND_MSG, updates[i].id);
+            (*failed)++;
+            rc = NO_ERROR;
+            continue;
+        }
+        if (rc != NO_ERROR)
+            break;
+        applied++;
+
+        // One feed entry per student, with every update applied
+        if (changed == 0 || changes[changed - 1].id != updates[i].id) {
+            if (changed == RECORDS_PER_PAGE) {
+                rc = cdc_emit(db, changes, changed);
+                changed = 0;
+            }
+            memset(&changes[changed], 0, sizeof(cdc_entry_t));
+            changes[changed].op = CDC_OP_UPDATE;
+            changes[changed].id = updates[i].id;
+            changed++;
+        }
+        changes[changed - 1].record = student;
+    }
+    if (rc == NO_ERROR)
+        rc = cdc_emit(db, changes, changed);
+
+    db_unlock(db->fd);
+    return (rc == NO_ERROR) ? applied : ERR_DB_FILE;
+}
+
+/*
+ *  NOTE IMPLEMENTING THIS FUNCTION IS EXTRA CREDIT
+ *
+ *  compress_db
+ *      db:     database handle from open_db()
+ * 
+ *  This assignment takes advantage of the way Linux handles sparse files
+ *  on disk. Thus if there is a large hole between student records, Linux
+ *  will not use any physical storage.  However, when a database record is
+ *  deleted storage is used to write a blank - see EMPTY_STUDENT_RECORD from
+ *  db.h - record.  
+ * 
+ *  Since Linux provides no way to delete data in the middle of a file, and
+ *  deleted records take up physical storage, this function will compress the
+ *  database by rewriting a new database file that only includes valid student
+ *  records. There are a number of ways to do this, but since this is extra credit
+ *  you need to figure this out on your own. 
+ * 
+ *  At a high level create a temporary database file then copy all valid students from
+ *  the active database (passed in via fd) to the temporary file. When this is done
+ *  rename the temporary database file to the name of the real database file. See
+ *  the constants in db.h for required file names:
+ *
+ *         #define DB_FILE     "student.db"        //name of database file
+ *         #define TMP_DB_FILE ".tmp_student.db"   //for extra credit 
+ * 
+ *  Note that you are passed in the fd of the database file to be compressed, 
+ *  it is very likely you will need to close it to overwrite it with the
+ *  compressed version of the file.  To ensure the caller can work with the
+ *  compressed file after you create it, it is a good design to return the fd
+ *  of the new compressed file from this function
+ * 
+ *  The handle passed in is reopened on the compressed file, so the
+ *  caller can keep using it.
+ *
+ *  returns:  NO_ERROR       on success, db now refers to the compressed file
+ *            ERR_DB_FILE    database file I/O issue
+ * 
+ * 
+ *  console:  M_DB_COMPRESSED_OK  on success, the db was successfully compressed.
+ *            M_ERR_DB_OPEN    error when opening/creating temporary database file.
+ *                             this error should also be returned after you
+ *                             compressed the database file and if you are unable
+ *                             to open it to pass the fd back to the caller
+ *            M_ERR_DB_CREATE  error creating the db file. For instance the
+ *                             inability to copy the temporary file back as
+ *                             the primary database file. 
+ *            M_ERR_DB_READ    error reading or seeking the the db or tempdb file
+ *            M_ERR_DB_WRITE   error writing to db or tempdb file (adding student)
+ *            
+ */
+int compress_db(sdb_t *db){
+    STATS_OP(STAT_OP_COMPACT);
+    mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
+
+    // Holding the write lock for the whole rewrite keeps other writers out,
+    // and db_lock() turns them away once the old file has been replaced.
+    // Changes still in memory have to reach the old file before that.
+    if (sync_db(db) != NO_ERROR || db_lock(db->fd) != NO_ERROR) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    // Engines with their own layout compact by writing everything again,
+    // unless they can do it where the data is
+    if (db->engine->own_layout && db->engine->compact != NULL) {
+        int rc = db->engine->compact(db);
+        if (rc == NO_ERROR)
+            rc = cdc_emit_one(db, CDC_OP_COMPACT, 0, NULL);
+        db_unlock(db->fd);
+        if (rc != NO_ERROR) {
+            printf(M_ERR_DB_WRITE);
+            return ERR_DB_FILE;
+        }
+        printf(M_DB_COMPRESSED_OK);
+        return NO_ERROR;
+    }
+    if (db->engine->own_layout) {
+        if (rebuild_db(db, true, CDC_OP_COMPACT) != NO_ERROR) {
+            printf(M_ERR_DB_WRITE);
+            return ERR_DB_FILE;
+        }
+        printf(M_DB_COMPRESSED_OK);
+        return NO_ERROR;
+    }
+
+    compact_state_t cs = {0};
+    cs.tmp_fd = open(TMP_DB_FILE, O_RDWR | O_CREAT | O_TRUNC, mode);
+    cs.buff = malloc(SCAN_BUFFER_SZ);
+    if (cs.tmp_fd == -1 || cs.buff == NULL) {
+        printf(M_ERR_DB_OPEN);
+        if (cs.tmp_fd != -1)
+            close(cs.tmp_fd);
+        free(cs.buff);
+        db_unlock(db->fd);
+        return ERR_DB_FILE;
+    }
+
+    // Only live students are written, deleted slots and holes become holes
+    int rc = scan_db(db, MIN_STD_ID, MAX_STD_ID, compact_record, &cs);
+    if (rc == NO_ERROR && compact_flush(&cs) != NO_ERROR)
+        rc = ERR_DB_FILE;
+    if (rc == NO_ERROR && (ftruncate(cs.tmp_fd, cs.end) == -1 || fsync(cs.tmp_fd) == -1))
+        rc = ERR_DB_FILE;
+    free(cs.buff);
+    close(cs.tmp_fd);
+
+    if (rc != NO_ERROR) {
+        printf(M_ERR_DB_WRITE);
+        unlink(TMP_DB_FILE);
+        db_unlock(db->fd);
+        return ERR_DB_FILE;
+    }
+
+    if (rename(TMP_DB_FILE, db->path) == -1) {
+        printf(M_ERR_DB_CREATE);
+        unlink(TMP_DB_FILE);
+        db_unlock(db->fd);
+        return ERR_DB_FILE;
+    }
+
+    // The student data did not change, but followers may want to know
+    // the file they are watching was replaced
+    if (cdc_emit_one(db, CDC_OP_COMPACT, 0, NULL) != NO_ERROR)
+        printf(M_ERR_DB_WRITE);
+    db_unlock(db->fd);
+
+    // Point the storage engine at the compressed file
+    if (reopen_db(db) != NO_ERROR) {
+        printf(M_ERR_DB_OPEN);
+        return ERR_DB_FILE;
+    }
+
+    printf(M_DB_COMPRESSED_OK);
+    return NO_ERROR;
+}
+
+//orders students by last name, then first name, then id
+static int cmp_student_name(const void *a, const void *b){
+    const student_t *x = a;
+    const student_t *y = b;
+    int rc = strncmp(x->lname, y->lname, sizeof(x->lname));
+    if (rc == 0)
+        rc = strncmp(x->fname, y->fname, sizeof(x->fname));
+    if (rc == 0)
+        rc = x->id - y->id;
+    return rc;
+}
+
+//sorts the run in memory and writes it to a temporary file
+static int sort_spill(sort_state_t *ss){
+    qsort(ss->run, ss->len, sizeof(student_t), cmp_student_name);
+
+    FILE *fp = tmpfile();
+    if (fp == NULL)
+        return ERR_DB_FILE;
+    ss->spills[ss->n_spills++] = fp;
+
+    if (fwrite(ss->run, sizeof(student_t), ss->len, fp) != (size_t)ss->len ||
+        fflush(fp) != 0 || fseek(fp, 0, SEEK_SET) != 0)
+        return ERR_DB_FILE;
+    ss->len = 0;
+    return NO_ERROR;
+}
+
+//scan_db() callback, collects students into runs
+static int sort_record(student_t *s, void *arg){
+    sort_state_t *ss = arg;
+    if (ss->len == SORT_RUN_RECORDS && sort_spill(ss) != NO_ERROR)
+        return ERR_DB_FILE;
+    ss->run[ss->len++] = *s;
+    return NO_ERROR;
+}
+
+/*
+ *  scan_sorted
+ *      db:      database handle from open_db()
+ *      filter:  only sort the students that match, NULL sorts everyone
+ *      fn:      called for each student
+ *      arg:     passed to fn
+ *
+ *  Like scan_db(), but calls fn in last name, first name, id order.  This
+ *  is an external sort: the scan fills runs of SORT_RUN_RECORDS students,
+ *  every full run is sorted and spilled to a temporary file, and the runs
+ *  are merged by repeatedly taking the smallest head.  A database that
+ *  fits in one run is sorted in memory without touching a temporary file.
+ *
+ *  returns:  NO_ERROR on success, ERR_DB_FILE on I/O errors, or the
+ *            first value fn returns that is not NO_ERROR
+ *
+ *  console:  Does not produce any console I/O
+ */
+int scan_sorted(sdb_t *db, filter_t *filter, scan_fn_t fn, void *arg){
+    sort_state_t ss = {0};
+    ss.run = malloc(SORT_RUN_RECORDS * sizeof(student_t));
+    if (ss.run == NULL)
+        return ERR_DB_FILE;
+
+    int rc = scan_filtered(db, filter, sort_record, &ss);
+
+    if (rc == NO_ERROR && ss.n_spills == 0) {
+        // Everything fit in one run
+        qsort(ss.run, ss.len, sizeof(student_t), cmp_student_name);
+        for (int i = 0; i < ss.len && rc == NO_ERROR; i++)
+            rc = fn(&ss.run[i], arg);
+    } else if (rc == NO_ERROR) {
+        if (ss.len > 0)
+            rc = sort_spill(&ss);
+
+        // The run buffer now holds the head of every spill file
+        bool *live = calloc(ss.n_spills, sizeof(bool));
+        if (live == NULL)
+            rc = ERR_DB_FILE;
+        for (int r = 0; rc == NO_ERROR && r < ss.n_spills; r++)
+            live[r] = fread(&ss.run[r], sizeof(student_t), 1, ss.spills[r]) == 1;
+
+        while (rc == NO_ERROR) {
+            int min = -1;
+            for (int r = 0; r < ss.n_spills; r++) {
+                if (live[r] && (min < 0 || cmp_student_name(&ss.run[r], &ss.run[min]) < 0))
+                    min = r;
+            }
+            if (min < 0)
+                break;
+
+            rc = fn(&ss.run[min], arg);
+            live[min] = fread(&ss.run[min], sizeof(student_t), 1, ss.spills[min]) == 1;
+        }
+        free(live);
+    }
+
+    for (int r = 0; r < ss.n_spills; r++)
+        fclose(ss.spills[r]);
+    free(ss.run);
+    return rc;
+}
+
+//scan_sorted() callback, writes a student as a bulk load line
+static int export_record(student_t *s, void *arg){
+    export_state_t *es = arg;
+    if (fprintf(es->fp, "%d %.24s %.32s %d\n", s->id, s->fname, s->lname, s->gpa) < 0)
+        return ERR_DB_FILE;
+    es->count++;
+    return NO_ERROR;
+}
+
+/*
+ *  export_db
+ *      db:          database handle from open_db()
+ *      exportFile:  file to write
+ *      filter:      only export the students that match, NULL exports everyone
+ *
+ *  Writes every student to exportFile in last name, first name order, one
+ *  "id first_name last_name gpa" line each.  That is the bulk load format,
+ *  so an export can be loaded into another database with -l.
+ *
+ *  returns:  NO_ERROR on success, or ERR_DB_FILE on failure
+ *
+ *  console:  M_DB_EXPORTED   on success
+ *            M_ERR_EXPORT    if exportFile cannot be created
+ *            M_ERR_DB_WRITE  on any other error
+ */
+int export_db(sdb_t *db, char *exportFile, filter_t *filter){
+    STATS_OP(STAT_OP_EXPORT);
+    export_state_t es = { .fp = fopen(exportFile, "w") };
+    if (es.fp == NULL) {
+        printf(M_ERR_EXPORT, exportFile);
+        return ERR_DB_FILE;
+    }
+
+    int rc = scan_sorted(db, filter, export_record, &es);
+    if (fclose(es.fp) != 0)
+        rc = ERR_DB_FILE;
+
+    if (rc != NO_ERROR) {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+
+    printf(M_DB_EXPORTED, es.count, exportFile);
+    return NO_ERROR;
+}
+
+//length of the last name that starts a roster line, cut to the field size
+static size_t join_key_len(const char *line){
+    size_t len = strcspn(line, " \t");
+    return (len < sizeof(((student_t *)0)->lname) - 1) ? len : sizeof(((student_t *)0)->lname) - 1;
+}
+
+//compares the last name that starts a roster line with name
+static int join_cmp(const char *line, const char *name){
+    size_t len = join_key_len(line);
+    int rc = strncmp(line, name, len);
+    if (rc == 0 && name[len] != '\0')
+        rc = -1;
+    return rc;
+}
+
+//reads the next roster line into js->next, "" at the end of the roster or
+//when the roster turns out not to be sorted
+static void join_advance(join_state_t *js){
+    char prev[sizeof(js->next)];
+    strcpy(prev, js->next);
+
+    if (fgets(js->next, sizeof(js->next), js->roster) == NULL) {
+        js->next[0] = '\0';
+        return;
+    }
+    js->line_no++;
+    js->next[strcspn(js->next, "\n")] = '\0';
+
+    prev[join_key_len(prev)] = '\0';
+    if (js->line_no > 1 && join_cmp(js->next, prev) < 0) {
+        printf(M_ERR_ROSTER_ORDER, js->line_no);
+        js->next[0] = '\0';
+        js->rc = ERR_DB_OP;
+    }
+}
+
+/*
+ *  join_record
+ *
+ *  scan_sorted() callback for join_db().  Students arrive in last name
+ *  order, so the roster only ever moves forward: lines with a smaller last
+ *  name are skipped, and the lines that match are kept in js->group for as
+ *  long as students with that last name keep coming.
+ */
+static int join_record(student_t *s, void *arg){
+    join_state_t *js = arg;
+
+    if (strncmp(js->key, s->lname, sizeof(js->key)) != 0) {
+        for (int i = 0; i < js->group_len; i++)
+            free(js->group[i]);
+        js->group_len = 0;
+        memcpy(js->key, s->lname, sizeof(js->key));
+
+        while (js->next[0] != '\0' && join_cmp(js->next, s->lname) < 0)
+            join_advance(js);
+
+        while (js->next[0] != '\0' && join_cmp(js->next, s->lname) == 0) {
+            if (js->group_len == js->group_cap) {
+                js->group_cap = (js->group_cap == 0) ? 16 : js->group_cap * 2;
+                char **grown = realloc(js->group, js->group_cap * sizeof(char *));
+                if (grown == NULL)
+                    return js->rc = ERR_DB_FILE;
+                js->group = grown;
+            }
+            char *rest = js->next + strcspn(js->next, " \t");
+            js->group[js->group_len++] = strdup(rest + strspn(rest, " \t"));
+            join_advance(js);
+        }
+    }
+    if (js->rc != NO_ERROR)
+        return js->rc;
+
+    for (int i = 0; i < js->group_len; i++) {
+        printf(JOIN_PRINT_FMT_STRING, s->id, s->fname, s->lname, s->gpa / 100.0, js->group[i]);
+        js->matches++;
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  join_db
+ *      db:          database handle from open_db()
+ *      rosterFile:  roster sorted by last name, "last_name anything" lines
+ *
+ *  Merge join of the database against a roster on last name.  The
+ *  students come out of scan_sorted() in last name order and the roster
+ *  is read once from top to bottom, so neither side has to fit in memory.
+ *  Every student is printed once for each roster line with the same last
+ *  name, followed by the rest of that line.
+ *
+ *  returns:  NO_ERROR     on success
+ *            ERR_DB_OP    if the roster is not sorted
+ *            ERR_DB_FILE  on I/O errors
+ *
+ *  console:  JOIN_PRINT_FMT_STRING for every match, then M_DB_JOINED
+ *            M_ERR_LOAD_OPEN     if the roster cannot be opened
+ *            M_ERR_ROSTER_ORDER  if the roster is not sorted
+ */
+int join_db(sdb_t *db, char *rosterFile){
+    STATS_OP(STAT_OP_JOIN);
+    join_state_t js = {0};
+    js.roster = fopen(rosterFile, "r");
+    if (js.roster == NULL) {
+        printf(M_ERR_LOAD_OPEN, rosterFile);
+        return ERR_DB_FILE;
+    }
+
+    join_advance(&js);
+    int rc = scan_sorted(db, NULL, join_record, &js);
+    if (rc == NO_ERROR)
+        rc = js.rc;
+
+    for (int i = 0; i < js.group_len; i++)
+        free(js.group[i]);
+    free(js.group);
+    fclose(js.roster);
+
+    if (rc != NO_ERROR)
+        return rc;
+
+    printf(M_DB_JOINED, js.matches);
+    return NO_ERROR;
+}
+
+/*
+ *  tail_cdc
+ *      dbFile:    database whose change feed to print
+ *      from_seq:  first sequence number to print, 1 is the start of the feed
+ *      follow:    keep waiting for new changes instead of returning
+ *
+ *  Prints the change feed from from_seq on.  Entries are fixed size, so
+ *  this is a single seek to (from_seq-1) * sizeof(cdc_entry_t) no matter
+ *  how long the feed is.  With follow set the function waits on inotify
+ *  for the feed to grow and prints new entries as they land, like tail -f.
+ *
+ *  returns:  NO_ERROR       on success
+ *            ERR_DB_FILE    the feed could not be read or watched
+ *
+ *  console:  one line per change, or M_CDC_EMPTY if there were none
+ *            M_ERR_DB_READ  error reading the feed
+ */
+static void print_cdc_entry(cdc_entry_t *e){
+    static const char *ops[] = { "?", "add", "del", "update", "compact", "zero" };
+    const char *op = (e->op > 0 && e->op <= CDC_OP_ZERO) ? ops[e->op] : ops[0];
+    printf(CDC_PRINT_FMT_STRING, e->seq, op, e->id,
+           e->record.fname, e->record.lname, e->record.gpa / 100.0);
+}
+
+int tail_cdc(const char *dbFile, long long from_seq, bool follow){
+    char cdc_name[PATH_MAX];
+    if (db_side_file(dbFile, CDC_EXT, cdc_name, sizeof(cdc_name)) != NO_ERROR) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    int feed = open(cdc_name, O_RDONLY | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (feed == -1) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    int watch = -1;
+    if (follow) {
+        watch = inotify_init1(IN_CLOEXEC);
+        if (watch == -1 || inotify_add_watch(watch, cdc_name, IN_MODIFY) == -1) {
+            printf(M_ERR_DB_READ);
+            if (watch != -1)
+                close(watch);
+            close(feed);
+            return ERR_DB_FILE;
+        }
+    }
+
+    if (from_seq < 1)
+        from_seq = 1;
+    off_t offset = (from_seq - 1) * sizeof(cdc_entry_t);
+
+    cdc_entry_t entries[RECORDS_PER_PAGE];
+    int printed = 0;
+    int rc = NO_ERROR;
+    for (;;) {
+        ssize_t n;
+        while ((n = sdb_pread(feed, entries, sizeof(entries), offset)) >= (ssize_t)sizeof(cdc_entry_t)) {
+            int whole = n / sizeof(cdc_entry_t);
+            for (int i = 0; i < whole; i++) {
+                if (printed++ == 0)
+                    printf(CDC_PRINT_HDR_STRING, "SEQ", "OP", "ID", "FIRST NAME", "LAST_NAME", "GPA");
+                print_cdc_entry(&entries[i]);
+            }
+            offset += whole * sizeof(cdc_entry_t);
+        }
+        if (n < 0) {
+            printf(M_ERR_DB_READ);
+            rc = ERR_DB_FILE;
+            break;
+        }
+        if (!follow)
+            break;
+
+        // Sleep until a writer appends, then pick up from our offset
+        fflush(stdout);
+        char events[4096];
+        if (read(watch, events, sizeof(events)) < 0 && errno != EINTR) {
+            rc = ERR_DB_FILE;
+            break;
+        }
+    }
+
+    if (rc == NO_ERROR && printed == 0)
+        printf(M_CDC_EMPTY);
+
+    if (watch != -1)
+        close(watch);
+    close(feed);
+    return rc;
+}
+
+/*
+ *  bulk_load_db
+ *      db:        database handle from open_db()
+ *      loadFile:  text file with one "id first_name last_name gpa" per line,
+ *                 gpa is a 3 digit int just like the -a option
+ *
+ *  Adds many students at once.  The load file is parsed up front and sorted
+ *  by id, then applied one database page at a time: every page that will
+ *  receive new students is read once, patched in memory and written back
+ *  once.  That turns N adds into roughly one read and one write per page and
+ *  lets the load run with O_DIRECT, which only accepts whole aligned pages.
+ *  Lines that do not parse, are out of range, or collide with an existing
+ *  student are reported and skipped, the rest of the load still happens.
+ *
+ *  returns:  NO_ERROR       every record in the load file was added
+ *            ERR_DB_FILE    database or load file I/O issue
+ *            ERR_DB_OP      one or more records were skipped
+ *
+ *  console:  M_DB_LOADED       number of students added on success
+ *            M_ERR_LOAD_OPEN   the load file could not be opened
+ *            M_ERR_LOAD_LINE   a line was malformed or out of range
+ *            M_ERR_DB_ADD_DUP  student already exists
+ *            M_ERR_DB_READ     error reading the database file
+ *            M_ERR_DB_WRITE    error writing the database file
+ */
+static int cmp_student_id(const void *a, const void *b){
+    const student_t *sa = a;
+    const student_t *sb = b;
+    return (sa->id > sb->id) - (sa->id < sb->id);
+}
+
+int bulk_load_db(sdb_t *db, char *loadFile){
+    STATS_OP(STAT_OP_LOAD);
+    FILE_OP(db);
+    int fd = db->fd;
+    FILE *fp = fopen(loadFile, "r");
+    if (fp == NULL) {
+        printf(M_ERR_LOAD_OPEN, loadFile);
+        return ERR_DB_FILE;
+    }
+
+    // Parse the whole load file first so records can be applied in id order
+    student_t *students = NULL;
+    int count = 0;
+    int capacity = 0;
+    int failed = 0;
+    int line_no = 0;
+    char line[256];
+    char fname[64];
+    char lname[64];
+    int id, gpa;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line_no++;
+        if (sscanf(line, "%d %63s %63s %d", &id, fname, lname, &gpa) != 4 ||
+            validate_range(id, gpa) != NO_ERROR) {
+            printf(M_ERR_LOAD_LINE, line_no);
+            failed++;
+            continue;
+        }
+
+        if (count == capacity) {
+            capacity = (capacity == 0) ? 1024 : capacity * 2;
+            student_t *grown = realloc(students, capacity * sizeof(student_t));
+            if (grown == NULL) {
+                printf(M_ERR_DB_WRITE);
+                free(students);
+                fclose(fp);
+                return ERR_DB_FILE;
+            }
+            students = grown;
+        }
+
+        // Names longer than the record fields are cut off, same as -a
+        student_t *s = &students[count++];
+        memset(s, 0, sizeof(student_t));
+        s->id = id;
+        memcpy(s->fname, fname, strnlen(fname, sizeof(s->fname) - 1));
+        memcpy(s->lname, lname, strnlen(lname, sizeof(s->lname) - 1));
+        s->gpa = gpa;
+    }
+    fclose(fp);
+
+    qsort(students, count, sizeof(student_t), cmp_student_id);
+
+    if (db->engine->own_layout) {
+        int loaded = put_new_records(db, students, count, &failed);
+        free(students);
+        if (loaded < 0) {
+            printf(M_ERR_DB_WRITE);
+            return ERR_DB_FILE;
+        }
+        printf(M_DB_LOADED, loaded);
+        return (failed == 0) ? NO_ERROR : ERR_DB_OP;
+    }
+
+    char *page;
+    if (posix_memalign((void **)&page, DB_PAGE_SIZE, DB_PAGE_SIZE) != 0) {
+        printf(M_ERR_DB_WRITE);
+        free(students);
+        return ERR_DB_FILE;
+    }
+
+    // Pages are read, patched and written back whole, so no other writer
+    // may touch the file until the load is done
+    struct stat st;
+    if (db_lock(fd) != NO_ERROR || fstat(fd, &st) == -1) {
+        printf(M_ERR_DB_READ);
+        db_unlock(fd);
+        free(page);
+        free(students);
+        return ERR_DB_FILE;
+    }
+    off_t db_size = st.st_size;
+
+    int saved_flags;
+    int mode = io_begin(fd, &saved_flags);
+
+    cdc_entry_t changes[RECORDS_PER_PAGE];
+    int rc = NO_ERROR;
+    int loaded = 0;
+    int i = 0;
+    while (i < count) {
+        off_t page_off = ((off_t)students[i].id * STUDENT_RECORD_SIZE) & ~(off_t)(DB_PAGE_SIZE - 1);
+
+        ssize_t n = sdb_pread(fd, page, DB_PAGE_SIZE, page_off);
+        if (n < 0) {
+            printf(M_ERR_DB_READ);
+            rc = ERR_DB_FILE;
+            break;
+        }
+        memset(page + n, 0, DB_PAGE_SIZE - n);
+
+        // Patch every new student that lives in this page
+        int lo = DB_PAGE_SIZE;
+        int hi = 0;
+        int changed = 0;
+        for (; i < count; i++) {
+            off_t slot = (off_t)students[i].id * STUDENT_RECORD_SIZE - page_off;
+            if (slot >= DB_PAGE_SIZE)
+                break;
+
+            student_t *current = (student_t *)(page + slot);
+            if (current->id != DELETED_STUDENT_ID) {
+                printf(M_ERR_DB_ADD_DUP, students[i].id);
+                failed++;
+                continue;
+            }
+            memcpy(current, &students[i], STUDENT_RECORD_SIZE);
+            loaded++;
+
+            memset(&changes[changed], 0, sizeof(cdc_entry_t));
+            changes[changed].op = CDC_OP_ADD;
+            changes[changed].id = students[i].id;
+            changes[changed].record = students[i];
+            changed++;
+
+            if (slot < lo)
+                lo = slot;
+            if (slot + STUDENT_RECORD_SIZE > hi)
+                hi = slot + STUDENT_RECORD_SIZE;
+        }
+
+        if (hi == 0)
+            continue;
+
+        if (snap_log_range(db->path, fd, page_off, DB_PAGE_SIZE) != NO_ERROR) {
+            printf(M_ERR_DB_WRITE);
+            rc = ERR_DB_FILE;
+            break;
+        }
+
+        // O_DIRECT only takes whole pages, otherwise just write the changed span
+        if (mode == IO_MODE_DIRECT) {
+            lo = 0;
+            if (sdb_pwrite(fd, page, DB_PAGE_SIZE, page_off) != DB_PAGE_SIZE) {
+                printf(M_ERR_DB_WRITE);
+                rc = ERR_DB_FILE;
+                break;
+            }
+        } else if (sdb_pwrite(fd, page + lo, hi - lo, page_off + lo) != hi - lo) {
+            printf(M_ERR_DB_WRITE);
+            rc = ERR_DB_FILE;
+            break;
+        }
+
+        if (cdc_emit(db, changes, changed) != NO_ERROR) {
+            printf(M_ERR_DB_WRITE);
+            rc = ERR_DB_FILE;
+            break;
+        }
+
+        if (page_off + hi > db_size)
+            db_size = page_off + hi;
+    }
+
+    // Whole page writes can leave the file padded past the last record
+    if (mode == IO_MODE_DIRECT && ftruncate(fd, db_size) == -1) {
+        printf(M_ERR_DB_WRITE);
+        rc = ERR_DB_FILE;
+    }
+
+    // Dirty pages cannot be dropped until they reach the disk
+    if (mode == IO_MODE_NOCACHE) {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+
+    io_end(fd, saved_flags);
+    db_unlock(fd);
+    free(page);
+    free(students);
+
+    if (rc != NO_ERROR)
+        return rc;
+
+    printf(M_DB_LOADED, loaded);
+    return (failed == 0) ? NO_ERROR : ERR_DB_OP;
+}
+
+/*
+ *  make_update
+ *      id:     student to update
+ *      field:  "fname", "lname" or "gpa"
+ *      value:  new value, gpa is a 3 digit int just like the -a option
+ *      u:      filled in with the bytes to write
+ *
+ *  returns:  NO_ERROR        u describes the update
+ *            ERR_DB_OP       field is not one we know how to update
+ *            UPD_BAD_VALUE   gpa value is not a whole number
+ *            EXIT_FAIL_ARGS  id or gpa out of range
+ */
+#define UPD_BAD_VALUE   -4
+
+static int make_update(int id, char *field, char *value, field_update_t *u){
+    memset(u, 0, sizeof(field_update_t));
+    u->id = id;
+
+    if (strcmp(field, "gpa") == 0) {
+        // atoi() would turn "abc" into 0 and "3x9" into 3
+        char *end;
+        errno = 0;
+        long value_gpa = strtol(value, &end, 10);
+        if (end == value || *end != '\0' || errno == ERANGE)
+            return UPD_BAD_VALUE;
+        if (value_gpa < MIN_STD_GPA || value_gpa > MAX_STD_GPA)
+            return EXIT_FAIL_ARGS;
+
+        // the bytes go straight into student_t.gpa, so copy them out of an int
+        int gpa = (int)value_gpa;
+        if (validate_range(id, gpa) != NO_ERROR)
+            return EXIT_FAIL_ARGS;
+        u->offset = offsetof(student_t, gpa);
+        u->len = sizeof(gpa);
+        memcpy(u->bytes, &gpa, sizeof(gpa));
+    } else if (strcmp(field, "fname") == 0 || strcmp(field, "lname") == 0) {
+        if (validate_range(id, MIN_STD_GPA) != NO_ERROR)
+            return EXIT_FAIL_ARGS;
+        u->offset = (field[0] == 'f') ? offsetof(student_t, fname) : offsetof(student_t, lname);
+        u->len = (field[0] == 'f') ? sizeof(((student_t *)0)->fname) : sizeof(((student_t *)0)->lname);
+        memcpy(u->bytes, value, strnlen(value, u->len - 1));
+    } else {
+        return ERR_DB_OP;
+    }
+
+    return NO_ERROR;
+}
+
+/*
+ *  update_student
+ *      db:     database handle from open_db()
+ *      id:     student id to update
+ *      field:  "fname", "lname" or "gpa"
+ *      value:  new value for the field
+ *
+ *  Changes one field of an existing student without the delete and add
+ *  round trip, so there is never a moment where the student is missing.
+ *  Under the write lock the id is read to make sure the student exists and
+ *  only the bytes of the changed field are written back with one pwrite().
+ *
+ *  returns:  NO_ERROR       student updated
+ *            ERR_DB_FILE    database file I/O issue
+ *            ERR_DB_OP      student not in database, bad field or value
+ *
+ *  console:  M_STD_UPDATED      on success
+ *            M_STD_NOT_FND_MSG  student not in database
+ *            M_ERR_UPD_FIELD    field is not fname, lname or gpa
+ *            M_ERR_UPD_VALUE    gpa value is not a whole number
+ *            M_ERR_STD_RNG      student ID or GPA out of range
+ *            M_ERR_DB_READ      error reading the database file
+ *            M_ERR_DB_WRITE     error writing the database file
+ */
+int update_student(sdb_t *db, int id, char *field, char *value){
+    STATS_OP(STAT_OP_UPDATE);
+    int fd = db->fd;
+    field_update_t u;
+    int rc = make_update(id, field, value, &u);
+    if (rc == ERR_DB_OP) {
+        printf(M_ERR_UPD_FIELD, field);
+        return ERR_DB_OP;
+    }
+    if (rc == UPD_BAD_VALUE) {
+        printf(M_ERR_UPD_VALUE, value);
+        return ERR_DB_OP;
+    }
+    if (rc != NO_ERROR) {
+        printf(M_ERR_STD_RNG);
+        return ERR_DB_OP;
+    }
+
+    int lock_fd = record_lock(db, id);
+    if (lock_fd < 0) {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+
+    student_t student;
+    if (patch_through_engine(db)) {
+        rc = patch_record(db, &u, &student);
+        if (rc == NO_ERROR)
+            rc = cdc_emit_one(db, CDC_OP_UPDATE, id, &student);
+        record_unlock(db, lock_fd);
+
+        if (rc == SRCH_NOT_FOUND) {
+            printf(M_STD_NOT_FND_MSG, id);
+            return ERR_DB_OP;
+        }
+        if (rc != NO_ERROR) {
+            printf(M_ERR_DB_WRITE);
+            return ERR_DB_FILE;
+        }
+        printf(M_STD_UPDATED, id);
+        return NO_ERROR;
+    }
+
+    off_t offset = (off_t)id * STUDENT_RECORD_SIZE;
+    int current_id = DELETED_STUDENT_ID;
+    if (sdb_pread(fd, &current_id, sizeof(int), offset) < 0) {
+        printf(M_ERR_DB_READ);
+        record_unlock(db, lock_fd);
+        return ERR_DB_FILE;
+    }
+    if (current_id == DELETED_STUDENT_ID) {
+        printf(M_STD_NOT_FND_MSG, id);
+        record_unlock(db, lock_fd);
+        return ERR_DB_OP;
+    }
+
+    if (snap_log_range(db->path, fd, offset + u.offset, u.len) != NO_ERROR ||
+        sdb_pwrite(fd, u.bytes, u.len, offset + u.offset) != u.len) {
+        printf(M_ERR_DB_WRITE);
+        record_unlock(db, lock_fd);
+        return ERR_DB_FILE;
+    }
+
+    // Followers get the whole record as it is after the change
+    if (sdb_pread(fd, &student, STUDENT_RECORD_SIZE, offset) != STUDENT_RECORD_SIZE ||
+        cdc_emit_one(db, CDC_OP_UPDATE, id, &student) != NO_ERROR) {
+        printf(M_ERR_DB_WRITE);
+        record_unlock(db, lock_fd);
+        return ERR_DB_FILE;
+    }
+    record_unlock(db, lock_fd);
+
+    printf(M_STD_UPDATED, id);
+    return NO_ERROR;
+}
+
+/*
+ *  bulk_update_db
+ *      db:          database handle from open_db()
+ *      updateFile:  text file with one "id field value" per line
+ *
+ *  Applies a whole file of field updates in one pass over the database.
+ *  The updates are sorted by id, keeping file order for the same student,
+ *  then every page that has updates is read once, patched in memory and
+ *  the changed span written back once, all under a single write lock.
+ *  Bad lines and updates for students that do not exist are reported and
+ *  skipped, the rest are still applied.
+ *
+ *  returns:  NO_ERROR       every update was applied
+ *            ERR_DB_FILE    database or update file I/O issue
+ *            ERR_DB_OP      one or more updates were skipped
+ *
+ *  console:  M_DB_UPDATED       number of updates applied on success
+ *            M_ERR_LOAD_OPEN    the update file could not be opened
+ *            M_ERR_LOAD_LINE    a line was malformed or out of range
+ *            M_STD_NOT_FND_MSG  student not in database
+ *            M_ERR_DB_READ      error reading the database file
+ *            M_ERR_DB_WRITE     error writing the database file
+ */
+static int cmp_update_id(const void *a, const void *b){
+    const field_update_t *ua = a;
+    const field_update_t *ub = b;
+    if (ua->id != ub->id)
+        return (ua->id > ub->id) - (ua->id < ub->id);
+    return (ua->seq > ub->seq) - (ua->seq < ub->seq);
+}
+
+int bulk_update_db(sdb_t *db, char *updateFile){
+    STATS_OP(STAT_OP_BULK_UPDATE);
+    int fd = db->fd;
+    FILE *fp = fopen(updateFile, "r");
+    if (fp == NULL) {
+        printf(M_ERR_LOAD_OPEN, updateFile);
+        return ERR_DB_FILE;
+    }
+
+    field_update_t *updates = NULL;
+    int count = 0;
+    int capacity = 0;
+    int failed = 0;
+    int line_no = 0;
+    char line[256];
+    char field[16];
+    char value[64];
+    int id;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line_no++;
+
+        if (count == capacity) {
+            capacity = (capacity == 0) ? 1024 : capacity * 2;
+            field_update_t *grown = realloc(updates, capacity * sizeof(field_update_t));
+            if (grown == NULL) {
+                printf(M_ERR_DB_WRITE);
+                free(updates);
+                fclose(fp);
+                return ERR_DB_FILE;
+            }
+            updates = grown;
+        }
+
+        if (sscanf(line, "%d %15s %63s", &id, field, value) != 3 ||
+            make_update(id, field, value, &updates[count]) != NO_ERROR) {
+            printf(M_ERR_LOAD_LINE, line_no);
+            failed++;
+            continue;
+        }
+        updates[count].seq = count;
+        count++;
+    }
+    fclose(fp);
+
+    qsort(updates, count, sizeof(field_update_t), cmp_update_id);
+
+    if (patch_through_engine(db)) {
+        int applied = patch_records(db, updates, count, &failed);
+        free(updates);
+        if (applied < 0) {
+            printf(M_ERR_DB_WRITE);
+            return ERR_DB_FILE;
+        }
+        printf(M_DB_UPDATED, applied);
+        return (failed == 0) ? NO_ERROR : ERR_DB_OP;
+    }
+
+    if (db_lock(fd) != NO_ERROR) {
+        printf(M_ERR_DB_WRITE);
+        free(updates);
+        return ERR_DB_FILE;
+    }
+
+    char page[DB_PAGE_SIZE];
+    cdc_entry_t changes[RECORDS_PER_PAGE];
+    int rc = NO_ERROR;
+    int applied = 0;
+    int i = 0;
+    while (i < count) {
+        off_t page_off = ((off_t)updates[i].id * STUDENT_RECORD_SIZE) & ~(off_t)(DB_PAGE_SIZE - 1);
+
+        ssize_t n = sdb_pread(fd, page, DB_PAGE_SIZE, page_off);
+        if (n < 0) {
+            printf(M_ERR_DB_READ);
+            rc = ERR_DB_FILE;
+            break;
+        }
+        memset(page + n, 0, DB_PAGE_SIZE - n);
+
+        // Patch every update that lands in this page
+        int lo = DB_PAGE_SIZE;
+        int hi = 0;
+        int changed = 0;
+        for (; i < count; i++) {
+            off_t slot = (off_t)updates[i].id * STUDENT_RECORD_SIZE - page_off;
+            if (slot >= DB_PAGE_SIZE)
+                break;
+
+            student_t *current = (student_t *)(page + slot);
+            if (current->id == DELETED_STUDENT_ID) {
+                printf(M_STD_NOT_FND_MSG, updates[i].id);
+                failed++;
+                continue;
+            }
+
+            int start = slot + updates[i].offset;
+            memcpy(page + start, updates[i].bytes, updates[i].len);
+            applied++;
+
+            // One feed entry per student, with every update applied
+            if (changed == 0 || changes[changed - 1].id != updates[i].id) {
+                memset(&changes[changed], 0, sizeof(cdc_entry_t));
+                changes[changed].op = CDC_OP_UPDATE;
+                changes[changed].id = updates[i].id;
+                changed++;
+            }
+            changes[changed - 1].record = *current;
+
+            if (start < lo)
+                lo = start;
+            if (start + updates[i].len > hi)
+                hi = start + updates[i].len;
+        }
+
+        if (hi == 0)
+            continue;
+
+        if (snap_log_range(db->path, fd, page_off + lo, hi - lo) != NO_ERROR ||
+            sdb_pwrite(fd, page + lo, hi - lo, page_off + lo) != hi - lo ||
+            cdc_emit(db, changes, changed) != NO_ERROR) {
+            printf(M_ERR_DB_WRITE);
+            rc = ERR_DB_FILE;
+            break;
+        }
+    }
+
+    db_unlock(fd);
+    free(updates);
+
+    if (rc != NO_ERROR)
+        return rc;
+
+    printf(M_DB_UPDATED, applied);
+    return (failed == 0) ? NO_ERROR : ERR_DB_OP;
+}
+
+/*
+ *  zero_db
+ *      db:     database handle from open_db()
+ *
+ *  Removes every record by truncating the database file to zero bytes.
+ *  The truncate happens in place under the write lock, and the pages that
+ *  held data are saved first if a snapshot is running, see snapshot_db().
+ *
+ *  returns:  NO_ERROR       on success
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  M_DB_ZERO_OK    on success
+ *            M_ERR_DB_WRITE  error truncating the database file
+ */
+int zero_db(sdb_t *db){
+    STATS_OP(STAT_OP_ZERO);
+    int fd = db->fd;
+
+    // Nothing may be left in memory to be written over the empty file
+    if (sync_db(db) != NO_ERROR || db_lock(fd) != NO_ERROR) {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+
+    int rc = NO_ERROR;
+    if (db->engine->own_layout) {
+        rc = rebuild_db(db, false, CDC_OP_ZERO);
+        if (rc != NO_ERROR) {
+            printf(M_ERR_DB_WRITE);
+            return rc;
+        }
+        printf(M_DB_ZERO_OK);
+        return NO_ERROR;
+    }
+
+    // Holes read back as zeros before and after, only data needs saving
+    off_t data = 0;
+    while ((data = sdb_lseek(fd, data, SEEK_DATA)) != -1) {
+        off_t hole = sdb_lseek(fd, data, SEEK_HOLE);
+        if (hole == -1 || snap_log_range(db->path, fd, data, hole - data) != NO_ERROR) {
+            rc = ERR_DB_FILE;
+            break;
+        }
+        data = hole;
+    }
+    if (data == -1 && errno != ENXIO)
+        rc = ERR_DB_FILE;
+
+    if (rc == NO_ERROR && (ftruncate(fd, 0) == -1 ||
+                           cdc_emit_one(db, CDC_OP_ZERO, 0, NULL) != NO_ERROR))
+        rc = ERR_DB_FILE;
+    db_unlock(fd);
+
+    // Engines that cache the file size or contents must start over
+    if (rc == NO_ERROR)
+        rc = reopen_db(db);
+
+    if (rc != NO_ERROR) {
+        printf(M_ERR_DB_WRITE);
+        return rc;
+    }
+
+    printf(M_DB_ZERO_OK);
+    return NO_ERROR;
+}
+
+/*
+ *  copy_range
+ *      src, dst:  file descriptors, offsets are the same in both files
+ *      offset:    where the range starts
+ *      len:       number of bytes to copy
+ *
+ *  Copies with copy_file_range() so the kernel can share or clone blocks
+ *  where the file system allows it, falling back to pread()/pwrite() when
+ *  the kernel or file system cannot do that.
+ */
+static int copy_range(int src, int dst, off_t offset, off_t len){
+    off_t in_off = offset;
+    off_t out_off = offset;
+    off_t end = offset + len;
+
+    while (in_off < end) {
+        ssize_t n = sdb_copy_file_range(src, &in_off, dst, &out_off, end - in_off, 0);
+        if (n > 0)
+            continue;
+        if (n == 0)
+            return NO_ERROR;    // source shrank under us, the log fixes it up
+        if (errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP)
+            return ERR_DB_FILE;
+
+        char buff[SCAN_BUFFER_SZ];
+        while (in_off < end) {
+            size_t want = (end - in_off < SCAN_BUFFER_SZ) ? end - in_off : SCAN_BUFFER_SZ;
+            ssize_t got = sdb_pread(src, buff, want, in_off);
+            if (got < 0)
+                return ERR_DB_FILE;
+            if (got == 0)
+                return NO_ERROR;
+            if (sdb_pwrite(dst, buff, got, in_off) != got)
+                return ERR_DB_FILE;
+            in_off += got;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+/*
+ *  copy_sparse
+ *      src, dst:  file descriptors
+ *      size:      logical size of the copy
+ *
+ *  Copies only the data extents of src, found with SEEK_DATA/SEEK_HOLE,
+ *  and sizes dst with ftruncate() so the holes stay holes.  A database with
+ *  students 1 and 99999 is 6.4 MB long but only two pages of it are data.
+ */
+static int copy_sparse(int src, int dst, off_t size){
+    off_t data = 0;
+
+    while (data < size) {
+        data = sdb_lseek(src, data, SEEK_DATA);
+        if (data == -1) {
+            if (errno == ENXIO)
+                break;          // no more data before EOF
+            // no SEEK_DATA support, copy it all
+            return (copy_range(src, dst, 0, size) == NO_ERROR &&
+                    ftruncate(dst, size) == 0) ? NO_ERROR : ERR_DB_FILE;
+        }
+        if (data >= size)
+            break;
+
+        off_t hole = sdb_lseek(src, data, SEEK_HOLE);
+        if (hole == -1 || hole > size)
+            hole = size;
+
+        if (copy_range(src, dst, data, hole - data) != NO_ERROR)
+            return ERR_DB_FILE;
+        data = hole;
+    }
+
+    return (ftruncate(dst, size) == 0) ? NO_ERROR : ERR_DB_FILE;
+}
+
+/*
+ *  snap_apply_log
+ *      log_fd:  the snapshot log, positioned at the start
+ *      dst:     the snapshot copy
+ *      size:    size of the database when the snapshot started
+ *
+ *  Puts the before images saved by writers back into the copy.  Only the
+ *  first image logged for a page is the one from the snapshot start, later
+ *  ones were taken after an earlier write already changed the page.  All
+ *  zero images are punched out of the copy rather than written, so pages
+ *  that were holes at the start stay holes in the snapshot.
+ */
+static int snap_apply_log(int log_fd, int dst, off_t size){
+    off_t pages = (size + DB_PAGE_SIZE - 1) / DB_PAGE_SIZE;
+    unsigned char *applied = calloc(pages / 8 + 1, 1);
+    if (applied == NULL)
+        return ERR_DB_FILE;
+
+    static const char zero_page[DB_PAGE_SIZE];
+    snap_log_entry_t entry;
+    int rc = NO_ERROR;
+    ssize_t n;
+
+    while ((n = sdb_read(log_fd, &entry, sizeof(entry))) == sizeof(entry)) {
+        off_t page = entry.offset / DB_PAGE_SIZE;
+        if (entry.offset < 0 || page >= pages || (applied[page / 8] & (1 << (page % 8))))
+            continue;
+        applied[page / 8] |= 1 << (page % 8);
+
+        // Never grow the copy past the size the database had at the start
+        off_t len = (size - entry.offset < DB_PAGE_SIZE) ? size - entry.offset : DB_PAGE_SIZE;
+
+        if (memcmp(entry.page, zero_page, len) == 0 &&
+            fallocate(dst, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, entry.offset, len) == 0)
+            continue;
+
+        if (sdb_pwrite(dst, entry.page, len, entry.offset) != len) {
+            rc = ERR_DB_FILE;
+            break;
+        }
+    }
+    if (n != 0 && rc == NO_ERROR)
+        rc = ERR_DB_FILE;
+
+    free(applied);
+    return rc;
+}
+
+//true if path names the database or a file kept next to it
+static bool is_db_file(sdb_t *db, char *path){
+    struct stat target, st;
+    char name[PATH_MAX];
+    bool keep;
+
+    if (stat(path, &target) == -1)
+        return false;
+    if (fstat(db->fd, &st) == 0 && st.st_dev == target.st_dev && st.st_ino == target.st_ino)
+        return true;
+
+    char log_name[PATH_MAX] = "";
+    char cdc_name[PATH_MAX] = "";
+    db_side_file(db->path, SNAP_LOG_EXT, log_name, sizeof(log_name));
+    db_side_file(db->path, CDC_EXT, cdc_name, sizeof(cdc_name));
+    char *sidecars[] = { db->path, TMP_DB_FILE, log_name, cdc_name };
+    for (size_t i = 0; i < sizeof(sidecars) / sizeof(sidecars[0]); i++) {
+        if (stat(sidecars[i], &st) == 0 && st.st_dev == target.st_dev && st.st_ino == target.st_ino)
+            return true;
+    }
+    for (int i = 0; db->engine->files != NULL &&
+                    db->engine->files(db, i, name, sizeof(name), &keep) == NO_ERROR; i++) {
+        if (stat(name, &st) == 0 && st.st_dev == target.st_dev && st.st_ino == target.st_ino)
+            return true;
+    }
+    return false;
+}
+
+//moves a finished snapshot over snapFile, so a failed one never replaces it
+static int snapshot_publish(char *tmpFile, char *snapFile){
+    if (rename(tmpFile, snapFile) == -1) {
+        printf(M_ERR_SNAP_CREATE, snapFile);
+        unlink(tmpFile);
+        return ERR_DB_FILE;
+    }
+    printf(M_DB_SNAPSHOT_OK, snapFile);
+    return NO_ERROR;
+}
+
+/*
+ *  snapshot_db
+ *      db:        database handle from open_db()
+ *      snapFile:  name of the point in time copy to create
+ *
+ *  Writes a consistent copy of the database without making writers wait
+ *  for the copy.  The point in time is chosen while holding the write lock,
+ *  so no add or delete is half done at that moment.
+ *
+ *  If the file system supports reflinks (btrfs, xfs) the snapshot is a
+ *  FICLONE of the database taken under the lock, which is instant and
+ *  shares every block with the original.
+ *
+ *  Otherwise the snapshot creates the log, the database name plus
+ *  SNAP_LOG_EXT so other databases never share it, under the lock, drops
+ *  the lock and copies the data extents while writers keep going.  Each writer
+ *  saves the before image of the page it changes into the log, see
+ *  snap_log_range().  Once the copy is done the lock is taken again just
+ *  long enough to remove the log, and the saved before images are written
+ *  over the copy.  Holes are preserved throughout.
+ *
+ *  The copy is written to snapFile plus SNAP_TMP_EXT and only renamed to
+ *  snapFile once it is complete, so a failed snapshot leaves an existing
+ *  snapFile alone.  A snapFile that is the database or one of its files
+ *  is refused.
+ *
+ *  returns:  NO_ERROR       snapshot written
+ *            ERR_DB_FILE    database or snapshot file I/O issue
+ *            ERR_DB_OP      another snapshot is already running, or snapFile
+ *                           is part of the database
+ *
+ *  console:  M_DB_SNAPSHOT_OK   on success
+ *            M_ERR_SNAP_CREATE  snapshot or log file could not be created
+ *            M_ERR_SNAP_BUSY    another snapshot is already running
+ *            M_ERR_SNAP_SELF    snapFile is the database or one of its files
+ *            M_ERR_DB_READ      error reading the database file
+ *            M_ERR_DB_WRITE     error writing the snapshot
+ */
+int snapshot_db(sdb_t *db, char *snapFile){
+    STATS_OP(STAT_OP_SNAPSHOT);
+    FILE_OP(db);
+    int fd = db->fd;
+    mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
+    char tmpFile[PATH_MAX];
+
+    // Writing into the database itself would destroy it
+    if (snprintf(tmpFile, sizeof(tmpFile), "%s%s", snapFile, SNAP_TMP_EXT) >= (int)sizeof(tmpFile)) {
+        printf(M_ERR_SNAP_CREATE, snapFile);
         return ERR_DB_FILE;
     }
-
-    // Count the number of records in the database
-    student_t student;
-    int count = 0;
-    while (read(fd, &student, STUDENT_RECORD_SIZE) == STUDENT_RECORD_SIZE) {
-        if (memcmp(&student, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0) {
-            count++;
-        }
+    if (is_db_file(db, snapFile) || is_db_file(db, tmpFile)) {
+        printf(M_ERR_SNAP_SELF, snapFile);
+        return ERR_DB_OP;
     }
 
-    // Print the number of records in the database
-    if (count == 0) {
-        printf(M_DB_EMPTY);
-    } else {
-        printf(M_DB_RECORD_CNT, count);
+    int dst = open(tmpFile, O_WRONLY | O_CREAT | O_TRUNC, mode);
+    if (dst == -1) {
+        printf(M_ERR_SNAP_CREATE, tmpFile);
+        return ERR_DB_FILE;
     }
 
-    return count;
-}
-
-/*
- *  print_db
- *      fd:     linux file descriptor
- * 
- *  Prints all records in the database.  Start by reading the 
- *  database at the beginning, and continue reading individual records
- *  until you it EOF.  EOF is when the read() syscall returns 0. Check
- *  if a slot is empty or previously deleted by investigating if all of 
- *  the bytes in the record read are zeros - I would suggest using memory
- *  compare memcmp() for this. Be careful as the database might be empty.
- *  on the first real row encountered print the header for the required output:
- * 
- *     printf(STUDENT_PRINT_HDR_STRING, "ID", 
- *                  "FIRST NAME", "LAST_NAME", "GPA");
- * 
- *  then for each valid record encountered print the required output: 
- * 
- *     printf(STUDENT_PRINT_FMT_STRING, student.id, student.fname, 
- *                    student.lname, calculated_gpa_from_student);
- * 
- *  The code above assumes you are reading student records into a local
- *  variable named student that is of type student_t. Also dont forget that
- *  the GPA in the student structure is an int, to convert it into a real
- *  gpa divide by 100.0 and store in a float variable.
- * 
- *  returns:  NO_ERROR       on success
- *            ERR_DB_FILE    database file I/O issue
- * 
- * 
- *  console:  <see above>      on success, print table or database empty
- *            M_ERR_DB_READ    error reading or seeking the database file
- *            
- */
-int print_db(int fd){
-    // Seek to the beginning of the file
-    if (lseek(fd, 0, SEEK_SET) == -1) {
+    if (db_lock(fd) != NO_ERROR) {
         printf(M_ERR_DB_READ);
+        close(dst);
         return ERR_DB_FILE;
     }
 
-    // Print all records in the database
-    student_t student;
-    int header_printed = 0;
-    while (read(fd, &student, STUDENT_RECORD_SIZE) == STUDENT_RECORD_SIZE) {
-        if (memcmp(&student, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0) {
-            if (!header_printed) {
-                printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME", "LAST_NAME", "GPA");
-                header_printed = 1;
-            }
-            printf(STUDENT_PRINT_FMT_STRING, student.id, student.fname, student.lname, student.gpa / 100.0);
+    // Engines with their own layout are written out in the student.db
+    // layout, with writers held off for the whole copy
+    if (db->engine->own_layout) {
+        compact_state_t cs = { .tmp_fd = dst, .buff = malloc(SCAN_BUFFER_SZ) };
+        int rc = (cs.buff == NULL) ? ERR_DB_FILE :
+                 scan_db(db, MIN_STD_ID, MAX_STD_ID, compact_record, &cs);
+        if (rc == NO_ERROR && (compact_flush(&cs) != NO_ERROR ||
+                               ftruncate(dst, cs.end) == -1 || fsync(dst) == -1))
+            rc = ERR_DB_FILE;
+        db_unlock(fd);
+        free(cs.buff);
+        close(dst);
+
+        if (rc != NO_ERROR) {
+            printf(M_ERR_DB_WRITE);
+            unlink(tmpFile);
+            return rc;
         }
+        return snapshot_publish(tmpFile, snapFile);
     }
 
-    // If database is empty, print a message
-    if (header_printed == 0) {
-        printf(M_DB_EMPTY);
+    if (ioctl(dst, FICLONE, fd) == 0) {
+        db_unlock(fd);
+        close(dst);
+        return snapshot_publish(tmpFile, snapFile);
     }
 
-    return NO_ERROR;
-}
-
-/*
- *  print_student
- *      *s:   a pointer to a student_t structure that should
- *            contain a valid student to be printed
- * 
- *  Start by ensuring that provided student pointer is valid.  To do this
- *  make sure it is not NULL and that s->id is not zero.  After ensuring 
- *  that the student is valid, print it the exact way that is described
- *  in the print_db() function by first printing the header then the
- *  student data:
- * 
- *     printf(STUDENT_PRINT_HDR_STRING, "ID", 
- *                  "FIRST NAME", "LAST_NAME", "GPA");
- * 
- *     printf(STUDENT_PRINT_FMT_STRING, s->id, s->fname, 
- *                    student.lname, calculated_gpa_from_s);
- * 
- *  Dont forget that  the GPA in the student structure is an int, to convert 
- *  it into a real gpa divide by 100.0 and store in a float variable. 
- * 
- *  returns:  nothing, this is a void function
- * 
- * 
- *  console:  <see above>      on success, print table or database empty
- *            M_ERR_STD_PRINT  if the function argument s is NULL or if
- *                             s->id is zero
- *            
- */
-void print_student(student_t *s){
-    // Check if the student is valid
-    if (s == NULL || s->id == 0) {
-        printf(M_ERR_STD_PRINT);
-        return;
+    // A log left behind by a snapshot that crashed is unlocked and can be
+    // reused, one that is still locked belongs to a running snapshot
+    char log_name[PATH_MAX];
+    int log_fd = -1;
+    if (db_side_file(db->path, SNAP_LOG_EXT, log_name, sizeof(log_name)) == NO_ERROR)
+        log_fd = open(log_name, O_RDWR | O_CREAT, mode);
+    if (log_fd == -1) {
+        db_unlock(fd);
+        close(dst);
+        unlink(tmpFile);
+        printf(M_ERR_SNAP_CREATE, log_name);
+        return ERR_DB_FILE;
+    }
+    if (sdb_flock(log_fd, LOCK_EX | LOCK_NB) == -1) {
+        db_unlock(fd);
+        close(log_fd);
+        close(dst);
+        unlink(tmpFile);
+        printf(M_ERR_SNAP_BUSY);
+        return ERR_DB_OP;
     }
 
-    // Print the header for the student database
-    printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME", "LAST_NAME", "GPA");
+    struct stat st;
+    int rc = NO_ERROR;
+    if (ftruncate(log_fd, 0) == -1 || fstat(fd, &st) == -1)
+        rc = ERR_DB_FILE;
+    db_unlock(fd);
 
-    // Print the student record
-    printf(STUDENT_PRINT_FMT_STRING, s->id, s->fname, s->lname, s->gpa / 100.0);
+    // Writers are running again from here on
+    if (rc == NO_ERROR)
+        rc = copy_sparse(fd, dst, st.st_size);
+
+    // Stop the logging, no writer can be between its log and its write
+    // while we hold the lock
+    if (db_lock(fd) != NO_ERROR)
+        rc = ERR_DB_FILE;
+    unlink(log_name);
+    db_unlock(fd);
+
+    if (rc == NO_ERROR && sdb_lseek(log_fd, 0, SEEK_SET) == 0)
+        rc = snap_apply_log(log_fd, dst, st.st_size);
+    if (rc == NO_ERROR && fsync(dst) == -1)
+        rc = ERR_DB_FILE;
+
+    close(log_fd);
+    close(dst);
+
+    if (rc != NO_ERROR) {
+        printf(M_ERR_DB_WRITE);
+        unlink(tmpFile);
+        return rc;
+    }
+
+    return snapshot_publish(tmpFile, snapFile);
 }
 
 /*
- *  NOTE IMPLEMENTING THIS FUNCTION IS EXTRA CREDIT
+ *  run_session
+ *      db:  database handle from open_db()
+ *      in:  commands, one per line
  *
- *  compress_db
- *      fd:     linux file descriptor
- * 
- *  This assignment takes advantage of the way Linux handles sparse files
- *  on disk. Thus if there is a large hole between student records, Linux
- *  will not use any physical storage.  However, when a database record is
- *  deleted storage is used to write a blank - see EMPTY_STUDENT_RECORD from
- *  db.h - record.  
- * 
- *  Since Linux provides no way to delete data in the middle of a file, and
- *  deleted records take up physical storage, this function will compress the
- *  database by rewriting a new database file that only includes valid student
- *  records. There are a number of ways to do this, but since this is extra credit
- *  you need to figure this out on your own. 
- * 
- *  At a high level create a temporary database file then copy all valid students from
- *  the active database (passed in via fd) to the temporary file. When this is done
- *  rename the temporary database file to the name of the real database file. See
- *  the constants in db.h for required file names:
+ *  Runs many operations against one open database, which is where engines
+ *  that load the database into memory pay off.  Each line is one of the
+ *  command line operations without the dash:
  *
- *         #define DB_FILE     "student.db"        //name of database file
- *         #define TMP_DB_FILE ".tmp_student.db"   //for extra credit 
- * 
- *  Note that you are passed in the fd of the database file to be compressed, 
- *  it is very likely you will need to close it to overwrite it with the
- *  compressed version of the file.  To ensure the caller can work with the
- *  compressed file after you create it, it is a good design to return the fd
- *  of the new compressed file from this function
- * 
- *  returns:  <number>       returns the fd of the compressed database file
- *            ERR_DB_FILE    database file I/O issue
- * 
- * 
- *  console:  M_DB_COMPRESSED_OK  on success, the db was successfully compressed.
- *            M_ERR_DB_OPEN    error when opening/creating temporary database file.
- *                             this error should also be returned after you
- *                             compressed the database file and if you are unable
- *                             to open it to pass the fd back to the caller
- *            M_ERR_DB_CREATE  error creating the db file. For instance the
- *                             inability to copy the temporary file back as
- *                             the primary database file. 
- *            M_ERR_DB_READ    error reading or seeking the the db or tempdb file
- *            M_ERR_DB_WRITE   error writing to db or tempdb file (adding student)
- *            
+ *      a id first_name last_name gpa
+ *      d id
+ *      f id
+ *      u id field value
+ *      c
+ *      p
+ *      w                   sync changes held in memory to disk
+ *
+ *  Blank lines and lines starting with # are skipped.
+ *
+ *  returns:  NO_ERROR       every command worked
+ *            ERR_DB_OP      one or more commands failed or were invalid
+ *            ERR_DB_FILE    a sync failed
+ *
+ *  console:  whatever each operation prints
+ *            M_ERR_SESSION  for a line that is not a valid command
+ *            M_DB_SYNCED    after a w command
  */
-int compress_db(int fd){
-    printf(M_NOT_IMPL);
-    return fd;
-}
+int run_session(sdb_t *db, FILE *in){
+    char line[256];
+    char cmd[8], a1[64], a2[64], a3[64];
+    int line_no = 0;
+    int failed = 0;
+    int id, gpa, n, rc;
+    student_t student;
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+        line_no++;
+        n = sscanf(line, "%7s %63s %63s %63s %d", cmd, a1, a2, a3, &gpa);
+        if (n < 1 || cmd[0] == '#')
+            continue;
+
+        id = (n >= 2) ? atoi(a1) : 0;
+        rc = ERR_DB_OP;
+        if (strcmp(cmd, "a") == 0 && n == 5) {
+            rc = add_student(db, id, a2, a3, gpa);
+        } else if (strcmp(cmd, "d") == 0 && n == 2) {
+            rc = del_student(db, id);
+        } else if (strcmp(cmd, "f") == 0 && n == 2) {
+            rc = get_student(db, id, &student);
+            if (rc == NO_ERROR)
+                print_student(&student);
+            else if (rc == SRCH_NOT_FOUND)
+                printf(M_STD_NOT_FND_MSG, id);
+        } else if (strcmp(cmd, "u") == 0 && n == 4) {
+            rc = update_student(db, id, a2, a3);
+        } else if (strcmp(cmd, "c") == 0 && n == 1) {
+            rc = count_db_records(db, NULL);
+        } else if (strcmp(cmd, "p") == 0 && n == 1) {
+            rc = print_db(db, NULL);
+        } else if (strcmp(cmd, "w") == 0 && n == 1) {
+            if (sync_db(db) != NO_ERROR) {
+                printf(M_ERR_DB_WRITE);
+                return ERR_DB_FILE;
+            }
+            printf(M_DB_SYNCED);
+            rc = NO_ERROR;
+        } else {
+            printf(M_ERR_SESSION, line_no);
+        }
+
+        if (rc < 0)
+            failed++;
+    }
 
+    return (failed == 0) ? NO_ERROR : ERR_DB_OP;
+}
 
 /*
  *  validate_range
@@ -450,22 +2845,46 @@ int validate_range(int id, int gpa){
  *            
  */
 void usage(char *exename){
-    printf("usage: %s -[h|a|c|d|f|p|z] options.  Where:\n", exename);
+    printf("usage: %s -[h|a|c|d|D|e|E|f|j|o|p|l|s|S|u|U|x|z] options.  Where:\n", exename);
     printf("\t-h:  prints help\n");
     printf("\t-a id first_name last_name gpa(as 3 digit int):  adds a student\n");
-    printf("\t-c:  counts the records in the database\n");
+    printf("\t-c [filter]:  counts the records in the database, or those matching filter\n");
     printf("\t-d id:  deletes a student\n");
     printf("\t-f id:  finds and prints a student in the database\n");
-    printf("\t-p:  prints all records in the student database\n");
+    printf("\t-p [filter]:  prints all records in the student database, or those matching filter\n");
+    printf("\t-u id field value:  updates fname, lname or gpa of a student in place\n");
+    printf("\t-U file:  applies a file of updates, one \"id field value\" per line\n");
+    printf("\t-s file:  writes a point in time snapshot of the database to file\n");
+    printf("\t-l file:  bulk loads students, one \"id first_name last_name gpa\" per line\n");
+    printf("\t-o file [filter]:  exports students sorted by last and first name, in -l format\n");
+    printf("\t-j file:  joins a roster sorted by last name, \"last_name ...\" lines, on last name\n");
     printf("\t-x:  compress the database file [EXTRA CREDIT]\n");
+    printf("\t-e seq:  prints the change feed starting at sequence number seq\n");
+    printf("\t-E seq:  like -e, then keeps following the feed for new changes\n");
+    printf("\t-S:  runs commands from stdin against one open database, see run_session()\n");
+    printf("\t-D:  serves the database from shared memory to %s=shm until stopped\n", ENGINE_ENV);
     printf("\t-z:  zero db file (remove all records)\n");
+    printf("filter:  terms joined by and, each \"field op value\" or \"field in lo..hi\"\n");
+    printf("\tfields id, gpa, fname, lname, ops = != < <= > >=, e.g. \"gpa>=350 and id in 1..99\"\n");
+    printf("environment:\n");
+    printf("\t%s=buffered|nocache|direct:  I/O mode for -c, -p and -l\n", IO_MODE_ENV);
+    printf("\t%s=", ENGINE_ENV);
+    for (int i = 0; sdb_engines[i] != NULL; i++)
+        printf("%s%s", (i > 0) ? "|" : "", sdb_engines[i]->name);
+    printf(":  storage engine, default %s\n", sdb_engines[0]->name);
+    printf("\t%s=seconds:  how often in memory engines sync while writing, default on exit only\n", SYNC_SECS_ENV);
+    printf("\t%s=summary|json:  print operation statistics to stderr at exit\n", STATS_ENV);
+    printf("\t%s=off:  no read ahead for gets walking up the ids\n", READAHEAD_ENV);
+    printf("\t%s=1..%d, %s=range|hash:  how the shard engine splits new databases\n",
+           SHARDS_ENV, MAX_SHARDS, SHARD_BY_ENV);
 }
 
 
+#ifndef SDBSC_NO_MAIN
 //Welcome to main()
 int main(int argc, char *argv[]){
     char opt;           //user selected option
-    int fd;             //file descriptor of database files
+    sdb_t db;           //handle of the open database
     int rc;             //return code from various operations
     int exit_code;      //exit code to shell
     int id;             //userid from argv[2]
@@ -476,6 +2895,9 @@ int main(int argc, char *argv[]){
     //and print_student(). 
     student_t student = {0};
 
+    //filter expression for -c, -p and -o, compiled from the trailing args
+    filter_t filter;
+
     //This function must have at least one arg, and the arg must start
     //with a dash
     if ((argc < 2) || (*argv[1] != '-')){
@@ -493,11 +2915,24 @@ int main(int argc, char *argv[]){
         exit(EXIT_OK);
     }
 
+    //pick the storage engine, the I/O mode for scans and bulk loads, and
+    //whether to report operation statistics at exit
+    if (set_engine(getenv(ENGINE_ENV)) != NO_ERROR ||
+        set_io_mode(getenv(IO_MODE_ENV)) != NO_ERROR ||
+        stats_init(getenv(STATS_ENV)) != NO_ERROR){
+        exit(EXIT_FAIL_ARGS);
+    }
+
+    //the daemon serves the database to shm engine clients until it is
+    //stopped, it opens the file itself
+    if (opt == 'D'){
+        exit((serve_db(DB_FILE) == NO_ERROR) ? EXIT_OK : EXIT_FAIL_DB);
+    }
+
     //now lets open the file and continue if there is no error
     //note we are not truncating the file using the second
     //parameter
-    fd = open_db(DB_FILE, false);
-    if (fd < 0){
+    if (open_db(&db, DB_FILE, false) != NO_ERROR){
         exit(EXIT_FAIL_DB);
     }
 
@@ -529,18 +2964,22 @@ int main(int argc, char *argv[]){
                 break;
             }
 
-            rc = add_student(fd, id, argv[3], argv[4], gpa);
+            rc = add_student(&db, id, argv[3], argv[4], gpa);
             if (rc < 0)
                 exit_code = EXIT_FAIL_DB;
 
             break;
 
         case 'c':
-            //    arv[0] arv[1]    
-            //prog_name     -c 
-            //-----------------
-            //example:  prog_name -c  
-            rc = count_db_records(fd);
+            //    arv[0] arv[1]  arv[2...]
+            //prog_name     -c  [filter]
+            //--------------------------
+            //example:  prog_name -c gpa\>=350 and lname=doe
+            if (filter_compile(argv + 2, argc - 2, &filter) != NO_ERROR){
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+            rc = count_db_records(&db, (argc > 2) ? &filter : NULL);
             if (rc < 0)
                 exit_code = EXIT_FAIL_DB;
             break;
@@ -556,7 +2995,7 @@ int main(int argc, char *argv[]){
                 break;
             }
             id = atoi(argv[2]);
-            rc = del_student(fd, id);
+            rc = del_student(&db, id);
             if (rc < 0)
                 exit_code = EXIT_FAIL_DB;
 
@@ -573,7 +3012,7 @@ int main(int argc, char *argv[]){
                 break;
             }
             id = atoi(argv[2]);
-            rc = get_student(fd, id, &student);
+            rc = get_student(&db, id, &student);
 
            
             switch (rc){
@@ -592,11 +3031,30 @@ int main(int argc, char *argv[]){
             break;
 
         case 'p':
-            //    arv[0] arv[1]    
-            //prog_name     -p 
-            //-----------------
-            //example:  prog_name -p  
-            rc = print_db(fd);
+            //    arv[0] arv[1]  arv[2...]
+            //prog_name     -p  [filter]
+            //--------------------------
+            //example:  prog_name -p "id in 1000..2000"
+            if (filter_compile(argv + 2, argc - 2, &filter) != NO_ERROR){
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+            rc = print_db(&db, (argc > 2) ? &filter : NULL);
+            if (rc < 0)
+                exit_code = EXIT_FAIL_DB;
+            break;
+
+        case 'l':
+            //    arv[0] arv[1]  arv[2]
+            //prog_name     -l    file
+            //-------------------------
+            //example:  prog_name -l students.txt
+            if (argc != 3){
+                usage(argv[0]);
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+            rc = bulk_load_db(&db, argv[2]);
             if (rc < 0)
                 exit_code = EXIT_FAIL_DB;
             break;
@@ -607,28 +3065,129 @@ int main(int argc, char *argv[]){
             //-----------------
             //example:  prog_name -x 
 
-            //remember compress_db returns a fd of the compressed database.
+            //compress_db reopens the handle on the compressed database,
             //we close it after this switch statement 
-            fd = compress_db(fd);
-            if (fd < 0)
+            rc = compress_db(&db);
+            if (rc < 0)
+                exit_code = EXIT_FAIL_DB;
+            break;
+
+        case 'u':
+            //   arv[0] arv[1]  arv[2] arv[3] arv[4]
+            //prog_name     -u      id  field  value
+            //---------------------------------------
+            //example:  prog_name -u 1 gpa 355
+            if (argc != 5){
+                usage(argv[0]);
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+            id = atoi(argv[2]);
+            rc = update_student(&db, id, argv[3], argv[4]);
+            if (rc < 0)
+                exit_code = EXIT_FAIL_DB;
+            break;
+
+        case 'U':
+            //    arv[0] arv[1]  arv[2]
+            //prog_name     -U    file
+            //-------------------------
+            //example:  prog_name -U updates.txt
+            if (argc != 3){
+                usage(argv[0]);
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+            rc = bulk_update_db(&db, argv[2]);
+            if (rc < 0)
+                exit_code = EXIT_FAIL_DB;
+            break;
+
+        case 's':
+            //    arv[0] arv[1]  arv[2]
+            //prog_name     -s    file
+            //-------------------------
+            //example:  prog_name -s backup.db
+            if (argc != 3){
+                usage(argv[0]);
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+            rc = snapshot_db(&db, argv[2]);
+            if (rc < 0)
+                exit_code = EXIT_FAIL_DB;
+            break;
+
+        case 'S':
+            //    arv[0] arv[1]
+            //prog_name     -S   < commands
+            //-----------------------------
+            //example:  SDB_ENGINE=hash prog_name -S < session.txt
+            rc = run_session(&db, stdin);
+            if (rc < 0)
+                exit_code = EXIT_FAIL_DB;
+            break;
+
+        case 'o':
+            //    arv[0] arv[1]  arv[2] arv[3...]
+            //prog_name     -o    file  [filter]
+            //----------------------------------
+            //example:  prog_name -o by_name.txt gpa\>=350
+            if (argc < 3){
+                usage(argv[0]);
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+            if (filter_compile(argv + 3, argc - 3, &filter) != NO_ERROR){
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+            rc = export_db(&db, argv[2], (argc > 3) ? &filter : NULL);
+            if (rc < 0)
+                exit_code = EXIT_FAIL_DB;
+            break;
+
+        case 'j':
+            //    arv[0] arv[1]  arv[2]
+            //prog_name     -j    file
+            //-------------------------
+            //example:  prog_name -j roster.txt
+            if (argc != 3){
+                usage(argv[0]);
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+            rc = join_db(&db, argv[2]);
+            if (rc < 0)
+                exit_code = EXIT_FAIL_DB;
+            break;
+
+        case 'e':
+        case 'E':
+            //    arv[0] arv[1]  arv[2]
+            //prog_name  -e|-E     seq
+            //-------------------------
+            //example:  prog_name -e 1
+            if (argc != 3){
+                usage(argv[0]);
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+            rc = tail_cdc(DB_FILE, atoll(argv[2]), opt == 'E');
+            if (rc < 0)
                 exit_code = EXIT_FAIL_DB;
             break;
 
         case 'z':
             //    arv[0] arv[1]    
-            //prog_name     -x 
+            //prog_name     -z 
             //-----------------
-            //example:  prog_name -x 
-            //HINT:  close the db file, we already have fd 
-            //       and reopen db indicating truncate=true
-            close(fd);
-            fd = open_db(DB_FILE, true);
-            if (fd < 0){
+            //example:  prog_name -z 
+            //truncates in place so a running snapshot can save the
+            //pages first, see zero_db()
+            rc = zero_db(&db);
+            if (rc < 0)
                 exit_code = EXIT_FAIL_DB;
-                break;
-            }
-            printf(M_DB_ZERO_OK);
-            exit_code = EXIT_OK;
             break;
         default:
             usage(argv[0]);
@@ -637,6 +3196,7 @@ int main(int argc, char *argv[]){
 
     //dont forget to close the file before exiting, and setting the 
     //proper exit code - see the header file for expected values
-    close(fd);
+    close_db(&db);
     exit(exit_code);
 }
+#endif
@@ -1,19 +1,164 @@
 #ifndef __SDB_H__
+    #define __SDB_H__
 
 #include "db.h" //get student record type
 
+//Storage engines.  Every database function takes an sdb_t handle from
+//open_db(), and the handle's engine decides how records are stored and
+//found.  Most engines keep the student.db file layout (student id N at
+//offset N * STUDENT_RECORD_SIZE, all zero records are empty slots), so the
+//file level features such as bulk loads, snapshots and compaction work on
+//db->fd no matter which of them is in use.  Engines that set own_layout
+//store records some other way in files named after db->path, and the
+//file level features go through get, put and scan for them instead.
+//  open   sets up db->fd and any engine state in db->state
+//  get    SRCH_NOT_FOUND if the slot is empty, ERR_DB_FILE on I/O errors
+//  put    stores a whole record at slot s->id, replacing what was there
+//  put_many  optional, puts n records sorted by id in one go, used by bulk
+//         loads and compaction of engines with their own layout
+//  del    empties the slot for id
+//  scan   calls fn for each student from min_id to max_id in id order, and
+//         stops early returning fn's value if it is not NO_ERROR
+//  sync   only for engines that keep records in memory, writes changes
+//         back to db->fd.  The file level features sync first and reload
+//         such engines afterwards, since they work on the file directly.
+//  lock_fd  optional, for engines that split the records over several
+//         files, the file whose lock guards writes to id.  Writes of one
+//         student then hold a shared lock on db->fd and db_lock() on that
+//         file, so writers to different files never wait for each other.
+//  files  optional, for engines with their own layout that keep their
+//         records in files named after db->path.  Puts the name of file i
+//         into name and returns NO_ERROR, or SRCH_NOT_FOUND past the last
+//         one.  File 0 is the one db->fd refers to.  *keep is set for a
+//         file that open leaves as it is when truncating, such as the
+//         shard header.  Compaction and zeroing build a new database from
+//         these and rename it over the old one, see rebuild_db().
+//  compact  optional, for engines with their own layout but no files of
+//         their own, compacts the database where it is without ever
+//         leaving it partly written
+//  close  releases everything open acquired, syncing first if needed
+//Writes are made under db_lock() by the caller, and engines that write
+//db->fd must call snap_log_range() first so snapshots stay consistent.
+typedef struct sdb sdb_t;
+typedef int (*scan_fn_t)(student_t *s, void *arg);
+
+typedef struct sdb_engine {
+    const char *name;
+    int  (*open)(sdb_t *db, char *dbFile, bool should_truncate);
+    int  (*get)(sdb_t *db, int id, student_t *s);
+    int  (*put)(sdb_t *db, student_t *s);
+    int  (*put_many)(sdb_t *db, student_t *s, int n);
+    int  (*del)(sdb_t *db, int id);
+    int  (*scan)(sdb_t *db, int min_id, int max_id, scan_fn_t fn, void *arg);
+    int  (*sync)(sdb_t *db);
+    int  (*lock_fd)(sdb_t *db, int id);
+    int  (*files)(sdb_t *db, int i, char *name, size_t len, bool *keep);
+    int  (*compact)(sdb_t *db);
+    void (*close)(sdb_t *db);
+    bool own_layout;    //files are not in the student.db layout
+} sdb_engine_t;
+
+struct sdb {
+    const sdb_engine_t *engine;
+    char *path;         //database file name
+    int fd;             //database file, opened by the engine
+    int cdc_fd;         //change feed, opened on the first change
+    void *state;        //engine private data
+};
+
+extern const sdb_engine_t file_engine;      //pread/pwrite, the default
+extern const sdb_engine_t mmap_engine;      //shared memory map of the file
+extern const sdb_engine_t hash_engine;      //in memory hash table, synced back
+extern const sdb_engine_t compact_engine;   //16 byte records, shared names
+extern const sdb_engine_t block_engine;     //compressed blocks of 64 records
+extern const sdb_engine_t shard_engine;     //ids split over SDB_SHARDS files
+extern const sdb_engine_t shm_engine;       //shared memory served by sdbsc -D
+extern const sdb_engine_t *sdb_engines[];   //all of the above, NULL ends it
+
+//A compiled filter expression, see filter_compile() in sdb_filter.c.  The
+//id terms are folded into [min_id, max_id], which bounds the scan, and
+//every other term is tested against each student the scan finds.
+typedef struct filter_term {
+    int field;          //FILTER_* field below
+    int op;             //FILTER_OP_* comparison below
+    int lo, hi;         //value, or the bounds of an "in lo..hi" range
+    char str[32];       //value of a name comparison
+} filter_term_t;
+
+#define MAX_FILTER_TERMS    8
+
+typedef struct filter {
+    int min_id, max_id;
+    int n_terms;
+    filter_term_t terms[MAX_FILTER_TERMS];
+} filter_t;
+
 //prototypes for functions go below for this assignment
-int open_db(char *dbFile, bool should_truncate);
-int add_student(int fd, int id, char *fname, char *lname, int gpa);
-int get_student(int fd, int id, student_t *s);
-int del_student(int fd, int id);
-int compress_db(int fd);
+int open_db(sdb_t *db, char *dbFile, bool should_truncate);
+void close_db(sdb_t *db);
+int sync_db(sdb_t *db);
+int add_student(sdb_t *db, int id, char *fname, char *lname, int gpa);
+int get_student(sdb_t *db, int id, student_t *s);
+int del_student(sdb_t *db, int id);
+int compress_db(sdb_t *db);
 void print_student(student_t *s);
 int validate_range(int id, int gpa);
-int count_db_records(int fd);
-int print_db(int fd);
+int count_db_records(sdb_t *db, filter_t *filter);
+int print_db(sdb_t *db, filter_t *filter);
 void usage(char *);
 
+//engine selection and helpers shared by the engines
+int set_engine(char *name);
+int open_db_file(char *dbFile, bool should_truncate);
+int db_lock(int fd);
+void db_unlock(int fd);
+int snap_log_range(const char *dbFile, int fd, off_t offset, off_t len);
+
+//full database scans and bulk loads
+int set_io_mode(char *mode);
+int scan_db(sdb_t *db, int min_id, int max_id, scan_fn_t fn, void *arg);
+int bulk_load_db(sdb_t *db, char *loadFile);
+
+//in place updates of single fields
+int update_student(sdb_t *db, int id, char *field, char *value);
+int bulk_update_db(sdb_t *db, char *updateFile);
+
+//change data capture feed
+int tail_cdc(const char *dbFile, long long from_seq, bool follow);
+
+//many operations against one open database
+int run_session(sdb_t *db, FILE *in);
+
+//filter expressions for print, count and export, see sdb_filter.c
+int filter_compile(char **words, int n_words, filter_t *filter);
+bool filter_match(filter_t *filter, student_t *s);
+int scan_filtered(sdb_t *db, filter_t *filter, scan_fn_t fn, void *arg);
+
+//students in last name, first name order
+int scan_sorted(sdb_t *db, filter_t *filter, scan_fn_t fn, void *arg);
+int export_db(sdb_t *db, char *exportFile, filter_t *filter);
+int join_db(sdb_t *db, char *rosterFile);
+
+//point in time snapshots
+int snapshot_db(sdb_t *db, char *snapFile);
+int zero_db(sdb_t *db);
+
+//shared memory database daemon, see sdb_shm.c
+int serve_db(char *dbFile);
+
+//operation statistics, see sdb_stats.c
+int stats_init(char *mode);
+int stats_begin(int op);
+void stats_end(int *scope);
+ssize_t sdb_read(int fd, void *buf, size_t count);
+ssize_t sdb_pread(int fd, void *buf, size_t count, off_t offset);
+ssize_t sdb_write(int fd, const void *buf, size_t count);
+ssize_t sdb_pwrite(int fd, const void *buf, size_t count, off_t offset);
+off_t sdb_lseek(int fd, off_t offset, int whence);
+int sdb_flock(int fd, int operation);
+ssize_t sdb_copy_file_range(int fd_in, off_t *off_in, int fd_out, off_t *off_out,
+                            size_t len, unsigned int flags);
+
 //error codes to be returned from individual functions
 // NO_ERROR is returned if there are no errors
 // ERR_DB_FILE is returned if there is are any issues with the database file itself
@@ -25,6 +170,196 @@ void usage(char *);
 #define SRCH_NOT_FOUND  -3
 #define NOT_IMPLEMENTED_YET 0
 
+//Storage engine is picked with the SDB_ENGINE environment variable, and
+//engines that keep records in memory also sync every SDB_SYNC_SECS
+//seconds while they are being written to
+#define ENGINE_ENV          "SDB_ENGINE"
+#define SYNC_SECS_ENV       "SDB_SYNC_SECS"
+
+//Compaction and zeroing of engines with their own layout write the new
+//database under the old name followed by REBUILD_TMP_EXT, then rename its
+//files into place, see rebuild_db()
+#define REBUILD_TMP_EXT     ".tmp"
+
+//The shard engine splits the ids over SDB_SHARDS files, by equal ranges
+//of ids or with SDB_SHARD_BY=hash by id modulo the number of shards.
+//Both are read when the database is created and kept in its header.
+#define SHARDS_ENV          "SDB_SHARDS"
+#define SHARD_BY_ENV        "SDB_SHARD_BY"
+#define DEFAULT_SHARDS      4
+#define MAX_SHARDS          64
+#define SHARD_BY_RANGE      0
+#define SHARD_BY_HASH       1
+
+//The file engine watches for get_student() calls walking up the ids and
+//asks the kernel to read ahead of them, see file_readahead().  After
+//READAHEAD_TRIGGER forward steps of at most READAHEAD_MAX_GAP ids the
+//next READAHEAD_MIN bytes are requested, and the window doubles up to
+//READAHEAD_MAX while the walk goes on.  Walks with bigger steps read a
+//new page every get, and the kernel's own readahead handles those better.
+//SDB_READAHEAD=off turns it off.
+#define READAHEAD_ENV       "SDB_READAHEAD"
+#define READAHEAD_TRIGGER   4
+#define READAHEAD_MAX_GAP   (RECORDS_PER_PAGE / 4)
+#define READAHEAD_MIN       (16 * DB_PAGE_SIZE)
+#define READAHEAD_MAX       (256 * DB_PAGE_SIZE)
+
+//I/O modes used by full database scans (print, count) and bulk loads. The
+//mode is picked with the SDB_IO_MODE environment variable:
+// IO_MODE_BUFFERED  go through the page cache, hint sequential access
+// IO_MODE_NOCACHE   go through the page cache, drop pages behind the scan
+// IO_MODE_DIRECT    bypass the page cache with O_DIRECT, falls back to
+//                   IO_MODE_NOCACHE if the file system does not support it
+#define IO_MODE_ENV         "SDB_IO_MODE"
+#define IO_MODE_BUFFERED    0
+#define IO_MODE_NOCACHE     1
+#define IO_MODE_DIRECT      2
+
+//O_DIRECT needs buffers, offsets and lengths aligned to the device block
+//size.  Scans read SCAN_BUFFER_SZ bytes at a time from page aligned
+//offsets into a page aligned buffer, which satisfies that for any device.
+#define DB_PAGE_SIZE        4096
+#define RECORDS_PER_PAGE    (DB_PAGE_SIZE / 64)
+#define SCAN_BUFFER_SZ      (64 * DB_PAGE_SIZE)
+
+//One field of one student to rewrite in place, see update_student().
+//offset and len give the bytes of student_t that change and bytes holds
+//their new value, names are zero padded to the full field width.
+typedef struct field_update {
+    int id;
+    int offset;
+    int len;
+    int seq;            //position in a bulk update file, keeps sorts stable
+    char bytes[32];
+} field_update_t;
+
+//Change feed entry, appended to the database's CDC_EXT file by every
+//operation that changes the database.  seq starts at 1 and entry seq
+//lives at file offset (seq-1) * sizeof(cdc_entry_t).  record is the
+//student after the change, it is empty for deletes and for the
+//whole-database operations.
+typedef struct cdc_entry {
+    long long seq;
+    int op;
+    int id;
+    student_t record;
+} cdc_entry_t;
+
+#define CDC_OP_ADD          1
+#define CDC_OP_DEL          2
+#define CDC_OP_UPDATE       3
+#define CDC_OP_COMPACT      4   //file rewritten, student data unchanged
+#define CDC_OP_ZERO         5   //every student removed
+
+//State for compress_db() while it copies live records to TMP_DB_FILE
+typedef struct compact_state {
+    int tmp_fd;
+    char *buff;         //run of adjacent records waiting to be written
+    long long start;    //file offset of buff[0]
+    int len;
+    long long end;      //end of the last live record, new file size
+} compact_state_t;
+
+//Statistics are turned on with the SDB_STATS environment variable, set to
+//"summary" for a table or "json" for one JSON object per operation, both
+//written to stderr at exit.  Each public operation starts with
+//STATS_OP(), which opens a scope that closes on every return path, and
+//the database files are only touched through the sdb_*() system call
+//wrappers so their calls and bytes land on the right operation.
+#define STATS_ENV           "SDB_STATS"
+#define STATS_OFF           0
+#define STATS_SUMMARY       1
+#define STATS_JSON          2
+
+#define STATS_OP(op) \
+    int stats_scope __attribute__((cleanup(stats_end), unused)) = stats_begin(op)
+
+#define STAT_OP_GET         0
+#define STAT_OP_ADD         1
+#define STAT_OP_DEL         2
+#define STAT_OP_COUNT       3
+#define STAT_OP_PRINT       4
+#define STAT_OP_COMPACT     5
+#define STAT_OP_LOAD        6
+#define STAT_OP_UPDATE      7
+#define STAT_OP_BULK_UPDATE 8
+#define STAT_OP_SNAPSHOT    9
+#define STAT_OP_ZERO        10
+#define STAT_OP_EXPORT      11
+#define STAT_OP_JOIN        12
+#define STAT_OP_OTHER       13  //system calls made outside of an operation
+#define N_STAT_OPS          14
+
+#define STAT_SYS_READ       0   //read(), pread()
+#define STAT_SYS_WRITE      1   //write(), pwrite(), copy_file_range()
+#define STAT_SYS_LSEEK      2
+#define STAT_SYS_LOCK       3   //flock()
+#define N_STAT_SYS          4
+
+//latency bucket b counts operations that took less than 2^b microseconds
+#define STAT_HIST_BUCKETS   24
+
+//Fields and comparisons of a filter_term_t
+#define FILTER_ID           0
+#define FILTER_GPA          1
+#define FILTER_FNAME        2
+#define FILTER_LNAME        3
+
+#define FILTER_OP_EQ        0
+#define FILTER_OP_NE        1
+#define FILTER_OP_LT        2
+#define FILTER_OP_LE        3
+#define FILTER_OP_GT        4
+#define FILTER_OP_GE        5
+#define FILTER_OP_IN        6   //lo <= value <= hi
+
+//State for scan_filtered() while it passes matches on to the callback
+typedef struct filter_scan {
+    filter_t *filter;
+    scan_fn_t fn;
+    void *arg;
+} filter_scan_t;
+
+//scan_sorted() sorts at most SORT_RUN_RECORDS students in memory at a
+//time.  Each full batch is sorted and spilled to a temporary file as a
+//run, and the runs are merged at the end, so memory stays bounded no
+//matter how big the database is.
+#define SORT_RUN_RECORDS    8192
+
+//State for scan_sorted() while it fills and spills runs
+typedef struct sort_state {
+    student_t *run;
+    int len;
+    FILE *spills[MAX_STD_ID / SORT_RUN_RECORDS + 1];
+    int n_spills;
+} sort_state_t;
+
+//State for export_db()
+typedef struct export_state {
+    FILE *fp;
+    int count;
+} export_state_t;
+
+//State for join_db() while it walks the sorted roster, see join_record()
+typedef struct join_state {
+    FILE *roster;
+    int line_no;
+    char next[256];     //next roster line not joined yet, "" at EOF
+    char key[32];       //last name the lines in group belong to
+    char **group;       //roster lines for key, the part after the name
+    int group_len;
+    int group_cap;
+    int matches;
+    int rc;
+} join_state_t;
+
+//Writers append the before image of every page they change to the
+//snapshot log while a snapshot copy is running, see snapshot_db()
+typedef struct snap_log_entry {
+    long long offset;
+    char page[DB_PAGE_SIZE];
+} snap_log_entry_t;
+
 
 //error codes to be returned to the shell
 // EXIT_OK          program executed without error
@@ -53,6 +388,35 @@ void usage(char *);
 #define M_DB_EMPTY        "Database contains no student records.\n"
 #define M_DB_RECORD_CNT   "Database contains %d student record(s).\n"
 #define M_NOT_IMPL        "The requested operation is not implemented yet!\n"
+#define M_ERR_ENGINE      "Unknown storage engine %s!\n"
+#define M_ERR_IO_MODE     "Unknown I/O mode %s, use buffered, nocache or direct!\n"
+#define M_ERR_LOAD_OPEN   "Error opening load file %s, exiting!\n"
+#define M_ERR_LOAD_LINE   "Skipping invalid load record on line %d.\n"
+#define M_DB_LOADED       "%d student(s) loaded into database.\n"
+#define M_STD_UPDATED     "Student %d updated in database.\n"
+#define M_DB_UPDATED      "%d update(s) applied to database.\n"
+#define M_ERR_UPD_FIELD   "Cant update field %s, use fname, lname or gpa!\n"
+#define M_ERR_UPD_VALUE   "Cant update gpa to %s, use a 3 digit number like 345!\n"
+#define M_CDC_EMPTY       "No changes in the feed from that sequence number.\n"
+#define M_DB_SNAPSHOT_OK  "Database snapshot written to %s.\n"
+#define M_ERR_SNAP_CREATE "Error creating snapshot file %s, exiting!\n"
+#define M_ERR_SNAP_BUSY   "Another snapshot is already in progress!\n"
+#define M_ERR_SNAP_SELF   "Snapshot file %s is part of the database, exiting!\n"
+#define M_ERR_SESSION     "Skipping invalid session command on line %d.\n"
+#define M_DB_SYNCED       "Database synced to disk.\n"
+#define M_DB_EXPORTED     "%d student(s) exported to %s.\n"
+#define M_DB_JOINED       "%d roster match(es) found.\n"
+#define M_ERR_EXPORT      "Error creating export file %s, exiting!\n"
+#define M_ERR_ROSTER_ORDER "Roster is not sorted by last name at line %d!\n"
+#define M_ERR_FILTER      "Invalid filter at \"%s\", use field op value joined by and!\n"
+#define M_DB_NO_MATCH     "No student records match the filter.\n"
+#define M_DB_MATCH_CNT    "%d student record(s) match the filter.\n"
+#define M_ERR_SHARDS      "Invalid shard settings, use SDB_SHARDS=1..%d and SDB_SHARD_BY=range|hash!\n"
+#define M_DB_SERVING      "Serving %s from shared memory, writes on %s.\n"
+#define M_ERR_SERVE       "Error setting up shared memory for %s, exiting!\n"
+#define M_ERR_DAEMON_RUNNING "A daemon is already serving %s!\n"
+#define M_ERR_NO_DAEMON   "No daemon is serving %s, start one with -D!\n"
+#define M_ERR_STATS       "Unknown stats mode %s, use summary or json!\n"
 
 //useful format strings for print students
 //For example to print the header in the required output:
@@ -61,4 +425,15 @@ void usage(char *);
 #define  STUDENT_PRINT_HDR_STRING   "%-6s %-24s %-32s %-3s\n"
 #define  STUDENT_PRINT_FMT_STRING   "%-6d %-24.24s %-32.32s %-3.2f\n"
 
+//join_db() output, the student followed by the rest of the roster line
+#define  JOIN_PRINT_FMT_STRING  "%-6d %-24.24s %-32.32s %-3.2f %s\n"
+
+//summary table printed at exit when SDB_STATS=summary
+#define  STATS_PRINT_HDR_STRING "%-9s %8s %10s %8s %8s %8s %8s %8s %8s %12s %12s\n"
+#define  STATS_PRINT_FMT_STRING "%-9s %8lld %10.3f %8lld %8lld %8lld %8lld %8lld %8lld %12lld %12lld\n"
+
+//change feed lines printed by tail_cdc()
+#define  CDC_PRINT_HDR_STRING   "%-8s %-7s %-6s %-24s %-32s %-3s\n"
+#define  CDC_PRINT_FMT_STRING   "%-8lld %-7s %-6d %-24.24s %-32.32s %-3.2f\n"
+
 #endif
\ No newline at end of file